@@ -138,11 +138,15 @@ SOURCES += \
 	src/test/bignum_tests.cpp \
 	src/test/getarg_tests.cpp \
 	src/test/hmac_tests.cpp \
+	src/test/mempool_tests.cpp \
         src/test/merkle_tests.cpp \
         src/test/mruset_tests.cpp \
 	src/test/netbase_tests.cpp \
+	src/test/script_cache_tests.cpp \
 	src/test/serialize_tests.cpp \
+	src/test/sha256_tests.cpp \
 	src/test/sigopcount_tests.cpp \
+	src/test/txdb_tests.cpp \
 	src/test/uint160_tests.cpp \
 	src/test/uint256_tests.cpp \
 	src/test/cfractions_tests.cpp \
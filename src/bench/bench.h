@@ -0,0 +1,28 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITBAY_BENCH_BENCH_H
+#define BITBAY_BENCH_BENCH_H
+
+#include <stdint.h>
+#include <string>
+
+// Timing runs kept out of test_bitcoin, see bitbay-bench.pro.
+// Every BENCHMARK(name) body times its own loops and prints them with BenchReport.
+
+typedef void (*BenchFunction)();
+
+class CBenchRegister {
+public:
+    CBenchRegister(const char* pszName, BenchFunction fn);
+};
+
+/** Print one timing line: items processed, elapsed micros and the rate */
+void BenchReport(const std::string& strName, int64_t nItems, int64_t nMicros);
+
+#define BENCHMARK(name)                                        \
+    static void name();                                        \
+    static CBenchRegister bench_register_##name(#name, name); \
+    static void name()
+
+#endif // BITBAY_BENCH_BENCH_H
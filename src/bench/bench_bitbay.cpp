@@ -0,0 +1,68 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "crypto/sha256.h"
+#include "main.h"
+#include "wallet.h"
+
+#include <iostream>
+#include <map>
+
+CWallet* pwalletMain;
+CClientUIInterface uiInterface;
+bool fConfChange = false;
+unsigned int nNodeLifespan = 7;
+unsigned int nMinerSleep = 500;
+bool fUseFastIndex = true;
+
+extern bool fPrintToConsole;
+extern void noui_connect();
+extern void InitParamsOnStart();
+
+void Shutdown(void* parg)
+{
+  exit(0);
+}
+
+void StartShutdown()
+{
+  exit(0);
+}
+
+static std::map<std::string, BenchFunction>& Benchmarks()
+{
+    static std::map<std::string, BenchFunction> benchmarks;
+    return benchmarks;
+}
+
+CBenchRegister::CBenchRegister(const char* pszName, BenchFunction fn)
+{
+    Benchmarks()[pszName] = fn;
+}
+
+void BenchReport(const std::string& strName, int64_t nItems, int64_t nMicros)
+{
+    nMicros = std::max<int64_t>(nMicros, 1);
+    std::cout << strName << ": " << nItems << " in " << nMicros << "us, "
+              << nItems * 1000000 / nMicros << "/s" << std::endl;
+}
+
+// usage: bitbay-bench [name prefix]
+int main(int argc, char* argv[])
+{
+    fPrintToConsole = true;
+    noui_connect();
+    InitParamsOnStart();
+    std::cout << "sha256: " << SHA256AutoDetect() << std::endl;
+
+    std::string strFilter = argc > 1 ? argv[1] : "";
+    for (const auto& item : Benchmarks()) {
+        if (item.first.compare(0, strFilter.size(), strFilter) != 0)
+            continue;
+        std::cout << "# " << item.first << std::endl;
+        item.second();
+    }
+    return 0;
+}
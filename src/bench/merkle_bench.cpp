@@ -0,0 +1,80 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include <ethc/keccak256.h>
+
+#include "merklecpp/merklecpp.h"
+
+#include "peg.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <iostream>
+
+using namespace std;
+
+// pair hash of the bridge merkle trees, lower hash first
+static void keccak_sorted_pair(const merkle::HashT<32>& l,
+                               const merkle::HashT<32>& r,
+                               merkle::HashT<32>& out,
+                               bool& swap)
+{
+    uint8_t block[32 * 2];
+    swap = memcmp(l.bytes, r.bytes, 32) >= 0;
+    memcpy(&block[0], swap ? r.bytes : l.bytes, 32);
+    memcpy(&block[32], swap ? l.bytes : r.bytes, 32);
+    eth_keccak256(out.bytes, block, 32 * 2);
+}
+
+BENCHMARK(merkle_mint_proofs)
+{
+    // leaf + 16 level proof per mint, as validated in FetchInputs
+    vector<int64_t> sections(38, 123456789);
+    vector<unsigned char> from = ParseHex("93aafed0319b064de0acc8233283f293ee6aa8e0");
+    vector<MerkleHash> proofs;
+    for (int i = 0; i < 16; i++) {
+        MerkleHash proof;
+        eth_keccak256(proof.data(), (uint8_t*)&i, sizeof(i));
+        proofs.push_back(proof);
+    }
+
+    const int nMints = 5000;
+    int nFailed = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nMints; i++) {
+        MerkleHash leaf, root;
+        if (!ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", sections, 7, i, from, leaf) ||
+            !ComputeMintMerkleRoot(leaf, proofs, root))
+            nFailed++;
+    }
+    BenchReport("mint proofs", nMints - nFailed, GetTimeMicros() - nStart);
+}
+
+BENCHMARK(merkle_batch_tree)
+{
+    CMerkleBatchTree batch;
+    for (size_t n : {10000, 100000, 1000000}) {
+        vector<MerkleHash> leaves(n);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t seed = i;
+            eth_keccak256(leaves[i].data(), (uint8_t*)&seed, sizeof(seed));
+        }
+
+        int64_t nStart = GetTimeMicros();
+        merkle::TreeT<32, keccak_sorted_pair> tree;
+        for (const MerkleHash& leaf : leaves) {
+            tree.insert(leaf.data());
+        }
+        std::string tree_root = tree.root().to_string();
+        BenchReport(strprintf("merklecpp tree %u leaves", n), n, GetTimeMicros() - nStart);
+
+        nStart = GetTimeMicros();
+        batch.Build(leaves);
+        const MerkleHash& root = batch.Root();
+        BenchReport(strprintf("batch tree %u leaves", n), n, GetTimeMicros() - nStart);
+        if (HexStr(root.begin(), root.end()) != tree_root)
+            std::cout << "batch tree root mismatch" << std::endl;
+    }
+}
@@ -0,0 +1,43 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "util.h"
+
+#include <iostream>
+
+using namespace std;
+
+// every instruction set extension turned off, the generic code
+static const unsigned int nDisableMasks = SHA256_USE_SSE41 | SHA256_USE_AVX2 | SHA256_USE_SHANI;
+
+BENCHMARK(sha256d64_nodes)
+{
+    // merkle nodes of a few thousand transaction blocks
+    const size_t nNodes = 1 << 16;
+    vector<unsigned char> in(64 * nNodes), out(32 * nNodes);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (unsigned char)i;
+
+    int64_t nStart = GetTimeMicros();
+    for (size_t i = 0; i < nNodes; i++) {
+        uint256 hash = Hash(in.begin() + 64 * i, in.begin() + 64 * (i + 1));
+        memcpy(&out[32 * i], hash.begin(), 32);
+    }
+    BenchReport("sha256d64 openssl", nNodes, GetTimeMicros() - nStart);
+
+    for (unsigned int nDisable : {nDisableMasks, 0u}) {
+        string strImpl = SHA256AutoDetect(nDisable);
+        nStart = GetTimeMicros();
+        SHA256D64(out.data(), in.data(), nNodes);
+        BenchReport("sha256d64 " + strImpl, nNodes, GetTimeMicros() - nStart);
+    }
+    SHA256AutoDetect();
+
+    uint256 hash = Hash(in.end() - 64, in.end());
+    if (memcmp(hash.begin(), &out[32 * (nNodes - 1)], 32) != 0)
+        std::cout << "sha256d64 result mismatch" << std::endl;
+}
@@ -49,3 +49,11 @@ std::pair<std::unordered_map<uint256, CBlockIndex*>::iterator, bool> CBlockIndex
 bool CBlockIndexMap::remove(const uint256& hashBlock) {
 	return mapBlockIndex.erase(hashBlock) > 0;
 }
+
+void CBlockIndexMap::reserve(size_t nSize) {
+	mapBlockIndex.reserve(nSize);
+}
+
+void CBlockIndexMap::clear() {
+	mapBlockIndex.clear();
+}
@@ -33,6 +33,8 @@ public:
         const uint256& hashBlock,
         CBlockIndex*   pindex);
     bool remove(const uint256& hashBlock);
+    void reserve(size_t nSize);
+    void clear();
 };
 
 #endif
@@ -70,10 +70,12 @@ SOURCES += \
 HEADERS += \
     $$PWD/crypto/pbkdf2.h \
     $$PWD/crypto/scrypt.h \
+    $$PWD/crypto/sha256.h \
 
 SOURCES += \
     $$PWD/crypto/pbkdf2.cpp \
     $$PWD/crypto/scrypt.cpp \
+    $$PWD/crypto/sha256.cpp \
 
 INCLUDEPATH += $$PWD/rpc
 
@@ -0,0 +1,427 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define USE_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define SHA256_INLINE inline __attribute__((always_inline))
+#if !defined(__clang__)
+// the lane templates are always inlined into the target specific functions,
+// the vector calling convention of the helpers never matters
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#else
+#define SHA256_INLINE inline
+#endif
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t InitState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                               0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// K[i] + W[i] of the padding block which follows a 64 byte message,
+// the second block of every SHA256D64 input needs no message schedule
+const uint32_t KPad64[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+inline uint32_t ReadBE32(const unsigned char* p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline void WriteBE32(unsigned char* p, uint32_t x) {
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >> 8;
+	p[3] = x;
+}
+
+inline void WriteBE64(unsigned char* p, uint64_t x) {
+	WriteBE32(p, x >> 32);
+	WriteBE32(p + 4, x);
+}
+
+// The round functions are written once for a uint32_t and for the vector
+// types of the multi lane code, where every lane hashes its own input.
+
+inline void SetLane(uint32_t& v, int, uint32_t x) { v = x; }
+inline uint32_t GetLane(const uint32_t& v, int) { return v; }
+
+template <typename V>
+SHA256_INLINE void SetLane(V& v, int l, uint32_t x) {
+	v[l] = x;
+}
+template <typename V>
+SHA256_INLINE uint32_t GetLane(const V& v, int l) {
+	return v[l];
+}
+
+template <typename V>
+SHA256_INLINE V Ror(const V& x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+template <typename V>
+SHA256_INLINE V Ch(const V& x, const V& y, const V& z) {
+	return z ^ (x & (y ^ z));
+}
+template <typename V>
+SHA256_INLINE V Maj(const V& x, const V& y, const V& z) {
+	return (x & y) | (z & (x | y));
+}
+template <typename V>
+SHA256_INLINE V Sigma0(const V& x) {
+	return Ror(x, 2) ^ Ror(x, 13) ^ Ror(x, 22);
+}
+template <typename V>
+SHA256_INLINE V Sigma1(const V& x) {
+	return Ror(x, 6) ^ Ror(x, 11) ^ Ror(x, 25);
+}
+template <typename V>
+SHA256_INLINE V sigma0(const V& x) {
+	return Ror(x, 7) ^ Ror(x, 18) ^ (x >> 3);
+}
+template <typename V>
+SHA256_INLINE V sigma1(const V& x) {
+	return Ror(x, 17) ^ Ror(x, 19) ^ (x >> 10);
+}
+
+template <typename V>
+SHA256_INLINE void Round(const V& a, const V& b, const V& c, V& d, const V& e, const V& f,
+                         const V& g, V& h, const V& k) {
+	V t1 = h + Sigma1(e) + Ch(e, f, g) + k;
+	V t2 = Sigma0(a) + Maj(a, b, c);
+	d += t1;
+	h = t1 + t2;
+}
+
+// 64 rounds on s, with k(i) the round constant plus message word i
+template <typename V, typename KW>
+SHA256_INLINE void Rounds(V* s, const KW& k) {
+	V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+	for (int i = 0; i < 64; i += 8) {
+		Round(a, b, c, d, e, f, g, h, k(i + 0));
+		Round(h, a, b, c, d, e, f, g, k(i + 1));
+		Round(g, h, a, b, c, d, e, f, k(i + 2));
+		Round(f, g, h, a, b, c, d, e, k(i + 3));
+		Round(e, f, g, h, a, b, c, d, k(i + 4));
+		Round(d, e, f, g, h, a, b, c, k(i + 5));
+		Round(c, d, e, f, g, h, a, b, k(i + 6));
+		Round(b, c, d, e, f, g, h, a, k(i + 7));
+	}
+	s[0] += a;
+	s[1] += b;
+	s[2] += c;
+	s[3] += d;
+	s[4] += e;
+	s[5] += f;
+	s[6] += g;
+	s[7] += h;
+}
+
+template <typename V>
+struct KWSchedule {
+	V w[64];
+	SHA256_INLINE explicit KWSchedule(const V* m) {
+		for (int i = 0; i < 16; i++)
+			w[i] = m[i];
+		for (int i = 16; i < 64; i++)
+			w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+	}
+	SHA256_INLINE V operator()(int i) const { return w[i] + K[i]; }
+};
+
+template <typename V>
+struct KWPad64 {
+	SHA256_INLINE V operator()(int i) const { return V() + KPad64[i]; }
+};
+
+template <typename V>
+SHA256_INLINE void Compress(V* s, const V* m) {
+	Rounds(s, KWSchedule<V>(m));
+}
+
+// Double SHA-256 of N 64 byte inputs, one per lane of V
+template <typename V, int N>
+SHA256_INLINE void TransformD64Lanes(unsigned char* out, const unsigned char* in) {
+	V s[8], m[16];
+	for (int i = 0; i < 8; i++)
+		s[i] = V() + InitState[i];
+	for (int i = 0; i < 16; i++)
+		for (int l = 0; l < N; l++)
+			SetLane(m[i], l, ReadBE32(in + 64 * l + 4 * i));
+	Compress(s, m);
+	Rounds(s, KWPad64<V>());
+
+	// the 32 byte digest padded out to one block
+	for (int i = 0; i < 8; i++) {
+		m[i] = s[i];
+		s[i] = V() + InitState[i];
+	}
+	m[8] = V() + 0x80000000;
+	for (int i = 9; i < 15; i++)
+		m[i] = V();
+	m[15] = V() + 256;
+	Compress(s, m);
+
+	for (int i = 0; i < 8; i++)
+		for (int l = 0; l < N; l++)
+			WriteBE32(out + 32 * l + 4 * i, GetLane(s[i], l));
+}
+
+void TransformGeneric(uint32_t* s, const unsigned char* chunk, size_t nBlocks) {
+	while (nBlocks--) {
+		uint32_t m[16];
+		for (int i = 0; i < 16; i++)
+			m[i] = ReadBE32(chunk + 4 * i);
+		Compress(s, m);
+		chunk += 64;
+	}
+}
+
+void TransformD64Generic(unsigned char* out, const unsigned char* in) {
+	TransformD64Lanes<uint32_t, 1>(out, in);
+}
+
+#if defined(USE_SHA256_X86)
+
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+
+__attribute__((target("sse4.1"))) void TransformD64SSE41(unsigned char* out,
+                                                         const unsigned char* in) {
+	TransformD64Lanes<v4u32, 4>(out, in);
+}
+
+__attribute__((target("avx2"))) void TransformD64AVX2(unsigned char* out,
+                                                      const unsigned char* in) {
+	TransformD64Lanes<v8u32, 8>(out, in);
+}
+
+// Four rounds with the SHA extensions, state kept as ABEF and CDGH
+__attribute__((target("sha,sse4.1"))) SHA256_INLINE void QuadRound(__m128i& abef, __m128i& cdgh,
+                                                                    __m128i m, int i) {
+	m    = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)&K[i]));
+	cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);
+	abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(m, 0x0e));
+}
+
+__attribute__((target("sha,sse4.1"))) void TransformSHANI(uint32_t* s, const unsigned char* chunk,
+                                                          size_t nBlocks) {
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	__m128i dcba = _mm_loadu_si128((const __m128i*)&s[0]);
+	__m128i hgfe = _mm_loadu_si128((const __m128i*)&s[4]);
+	__m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+	__m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+	__m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+	__m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+	while (nBlocks--) {
+		__m128i abef0 = abef, cdgh0 = cdgh;
+		__m128i m0    = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 0)), mask);
+		__m128i m1    = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), mask);
+		__m128i m2    = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), mask);
+		__m128i m3    = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), mask);
+		QuadRound(abef, cdgh, m0, 0);
+		QuadRound(abef, cdgh, m1, 4);
+		QuadRound(abef, cdgh, m2, 8);
+		QuadRound(abef, cdgh, m3, 12);
+		for (int i = 16; i < 64; i += 4) {
+			__m128i m = _mm_sha256msg1_epu32(m0, m1);
+			m         = _mm_add_epi32(m, _mm_alignr_epi8(m3, m2, 4));
+			m         = _mm_sha256msg2_epu32(m, m3);
+			QuadRound(abef, cdgh, m, i);
+			m0 = m1;
+			m1 = m2;
+			m2 = m3;
+			m3 = m;
+		}
+		abef  = _mm_add_epi32(abef, abef0);
+		cdgh  = _mm_add_epi32(cdgh, cdgh0);
+		chunk += 64;
+	}
+
+	__m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+	__m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i*)&s[0], _mm_blend_epi16(feba, dchg, 0xf0));
+	_mm_storeu_si128((__m128i*)&s[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+void TransformD64SHANI(unsigned char* out, const unsigned char* in) {
+	static const unsigned char pad64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	                                        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	                                        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	                                        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+	uint32_t      s[8];
+	unsigned char buf[64] = {0};
+	memcpy(s, InitState, sizeof(s));
+	TransformSHANI(s, in, 1);
+	TransformSHANI(s, pad64, 1);
+	for (int i = 0; i < 8; i++)
+		WriteBE32(buf + 4 * i, s[i]);
+	buf[32] = 0x80;
+	buf[62] = 1;
+	memcpy(s, InitState, sizeof(s));
+	TransformSHANI(s, buf, 1);
+	for (int i = 0; i < 8; i++)
+		WriteBE32(out + 4 * i, s[i]);
+}
+
+#endif
+
+typedef void (*TransformFn)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Fn)(unsigned char*, const unsigned char*);
+
+TransformFn    Transform         = TransformGeneric;
+TransformD64Fn TransformD64      = TransformD64Generic;
+TransformD64Fn TransformD64_4Way = NULL;
+TransformD64Fn TransformD64_8Way = NULL;
+
+}  // namespace
+
+std::string SHA256AutoDetect(unsigned int nDisable) {
+	std::string strRet = "generic";
+	Transform          = TransformGeneric;
+	TransformD64       = TransformD64Generic;
+	TransformD64_4Way  = NULL;
+	TransformD64_8Way  = NULL;
+
+#if defined(USE_SHA256_X86)
+	bool     fSSE41 = false, fAVX2 = false, fSHANI = false;
+	uint32_t a, b, c, d;
+	uint32_t nMaxLeaf = __get_cpuid_max(0, NULL);
+	if (nMaxLeaf >= 1) {
+		__cpuid_count(1, 0, a, b, c, d);
+		fSSE41 = (c >> 19) & 1;
+		// AVX needs the os to save the ymm registers
+		if (((c >> 27) & 1) && ((c >> 28) & 1)) {
+			uint32_t xcr0_lo, xcr0_hi;
+			__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+			if ((xcr0_lo & 6) == 6 && nMaxLeaf >= 7) {
+				__cpuid_count(7, 0, a, b, c, d);
+				fAVX2 = (b >> 5) & 1;
+			}
+		}
+		if (nMaxLeaf >= 7) {
+			__cpuid_count(7, 0, a, b, c, d);
+			fSHANI = fSSE41 && ((b >> 29) & 1);
+		}
+	}
+
+	if (fSHANI && !(nDisable & SHA256_USE_SHANI)) {
+		Transform    = TransformSHANI;
+		TransformD64 = TransformD64SHANI;
+		strRet       = "shani(1way)";
+	}
+	// four lanes of sse4.1 lose to a single lane with the sha extensions
+	if (fSSE41 && !(nDisable & SHA256_USE_SSE41) && Transform != TransformSHANI) {
+		TransformD64_4Way = TransformD64SSE41;
+		strRet += ",sse41(4way)";
+	}
+	if (fAVX2 && !(nDisable & SHA256_USE_AVX2)) {
+		TransformD64_8Way = TransformD64AVX2;
+		strRet += ",avx2(8way)";
+	}
+#endif
+
+	return strRet;
+}
+
+void SHA256Compress(uint32_t* pstate, const unsigned char* pblocks, size_t nBlocks) {
+	Transform(pstate, pblocks, nBlocks);
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t nBlocks) {
+	if (TransformD64_8Way) {
+		while (nBlocks >= 8) {
+			TransformD64_8Way(out, in);
+			out += 256;
+			in += 512;
+			nBlocks -= 8;
+		}
+	}
+	if (TransformD64_4Way) {
+		while (nBlocks >= 4) {
+			TransformD64_4Way(out, in);
+			out += 128;
+			in += 256;
+			nBlocks -= 4;
+		}
+	}
+	while (nBlocks) {
+		TransformD64(out, in);
+		out += 32;
+		in += 64;
+		nBlocks--;
+	}
+}
+
+CSHA256::CSHA256() : bytes(0) { Reset(); }
+
+CSHA256& CSHA256::Reset() {
+	bytes = 0;
+	memcpy(s, InitState, sizeof(s));
+	return *this;
+}
+
+CSHA256& CSHA256::Write(const unsigned char* data, size_t len) {
+	const unsigned char* end     = data + len;
+	size_t               bufsize = bytes % 64;
+	if (bufsize && bufsize + len >= 64) {
+		// fill the buffer and process it
+		memcpy(buf + bufsize, data, 64 - bufsize);
+		bytes += 64 - bufsize;
+		data += 64 - bufsize;
+		Transform(s, buf, 1);
+		bufsize = 0;
+	}
+	if (end - data >= 64) {
+		size_t nBlocks = (end - data) / 64;
+		Transform(s, data, nBlocks);
+		data += 64 * nBlocks;
+		bytes += 64 * nBlocks;
+	}
+	if (end > data) {
+		// keep the tail for the next call
+		memcpy(buf + bufsize, data, end - data);
+		bytes += end - data;
+	}
+	return *this;
+}
+
+void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE]) {
+	static const unsigned char pad[64] = {0x80};
+	unsigned char              sizedesc[8];
+	WriteBE64(sizedesc, bytes << 3);
+	Write(pad, 1 + ((119 - (bytes % 64)) % 64));
+	Write(sizedesc, 8);
+	for (int i = 0; i < 8; i++)
+		WriteBE32(hash + 4 * i, s[i]);
+}
@@ -0,0 +1,46 @@
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITBAY_CRYPTO_SHA256_H
+#define BITBAY_CRYPTO_SHA256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** Instruction set extensions SHA256AutoDetect may use, as a mask to turn them off */
+enum {
+	SHA256_USE_SSE41 = (1U << 0),
+	SHA256_USE_AVX2  = (1U << 1),
+	SHA256_USE_SHANI = (1U << 2),
+};
+
+/** Select the fastest compression and batch double-hash code supported by this cpu,
+ *  skipping any extension set in nDisable. Returns a description for the log.
+ *  Not thread safe, call at startup before hashing from other threads. */
+std::string SHA256AutoDetect(unsigned int nDisable = 0);
+
+/** Run nBlocks consecutive 64 byte blocks through the compression function */
+void SHA256Compress(uint32_t* pstate, const unsigned char* pblocks, size_t nBlocks);
+
+/** Double SHA-256 of nBlocks independent 64 byte inputs, writing 32 bytes per input to out.
+ *  Every merkle tree node is one of these, several of them are hashed side by side. */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t nBlocks);
+
+/** Streaming SHA-256 on the dispatched compression function */
+class CSHA256 {
+private:
+	uint32_t      s[8];
+	unsigned char buf[64];
+	uint64_t      bytes;
+
+public:
+	static const size_t OUTPUT_SIZE = 32;
+
+	CSHA256();
+	CSHA256& Write(const unsigned char* data, size_t len);
+	void     Finalize(unsigned char hash[OUTPUT_SIZE]);
+	CSHA256& Reset();
+};
+
+#endif  // BITBAY_CRYPTO_SHA256_H
@@ -25,9 +25,10 @@ using namespace boost::assign;
 using namespace json_spirit;
 
 void printpegshift(const CFractions& frPegShift, const CPegLevel& peglevel, Object& result) {
-	int64_t    nValue    = frPegShift.Positive(nullptr).Total();
-	CFractions frLiquid  = frPegShift.HighPart(peglevel, nullptr);
-	CFractions frReserve = frPegShift.LowPart(peglevel, nullptr);
+	int64_t    nValue = frPegShift.Positive(nullptr).Total();
+	CFractions frLiquid;
+	CFractions frReserve;
+	frPegShift.SplitAt(peglevel, frReserve, frLiquid, nullptr, nullptr);
 
 	int64_t nLiquidNegative = 0;
 	int64_t nLiquidPositive = 0;
@@ -73,9 +74,13 @@ void printpegbalance(const CPegData& pegdata, Object& result, string prefix) {
 	int64_t nValue   = pegdata.fractions.Total();
 	int64_t nNChange = pegdata.fractions.NChange(pegdata.peglevel);
 
+	CFractions frLiquid;
+	CFractions frReserve;
+	pegdata.fractions.SplitAt(pegdata.peglevel, frReserve, frLiquid, nullptr, nullptr);
+
 	int16_t nValueHli   = pegdata.fractions.HLI();
-	int16_t nLiquidHli  = pegdata.fractions.HighPart(pegdata.peglevel, nullptr).HLI();
-	int16_t nReserveHli = pegdata.fractions.LowPart(pegdata.peglevel, nullptr).HLI();
+	int16_t nLiquidHli  = frLiquid.HLI();
+	int16_t nReserveHli = frReserve.HLI();
 
 	result.push_back(Pair(prefix + "value", nValue));
 	result.push_back(Pair(prefix + "value_hli", nValueHli));
@@ -529,6 +529,8 @@ Value prepareliquidwithdraw(const Array& params, bool fHelp) {
 	// also consider only coins with are not less than 5% (and fit 20 inputs max)
 	// for liquid calculations we use network peg in next interval
 	multimap<double, CCoinToUse> ratedOutputs;
+	CFractions                   frOutReserve;  // split buffers reused for all coins
+	CFractions                   frOutLiquid;
 	for (const pair<uint320, CCoinToUse>& item : mapAllOutputs) {
 		uint320    fkey = item.first;
 		CFractions frOut(0, CFractions::VALUE);
@@ -537,13 +539,14 @@ Value prepareliquidwithdraw(const Array& params, bool fHelp) {
 		}
 
 		int64_t nAvailableLiquid = 0;
-		frOut                    = frOut.HighPart(peglevel_net.nSupplyNext, &nAvailableLiquid);
+		frOut.SplitAt(peglevel_net.nSupplyNext, frOutReserve, frOutLiquid, nullptr,
+		              &nAvailableLiquid);
 
 		if (nAvailableLiquid < (nAmountWithFee / 20)) {
 			continue;
 		}
 
-		double distortion = frOut.Distortion(frAmount);
+		double distortion = frOutLiquid.Distortion(frAmount);
 		ratedOutputs.insert(pair<double, CCoinToUse>(distortion, item.second));
 		mapAvailableLiquid[fkey] = nAvailableLiquid;
 	}
@@ -1008,6 +1011,8 @@ Value preparereservewithdraw(const Array& params, bool fHelp) {
 	// for reserve calculations we use exchange peglevels
 	map<uint320, int64_t>        mapAvailableReserve;
 	multimap<double, CCoinToUse> ratedOutputs;
+	CFractions                   frOutReserve;  // split buffers reused for all coins
+	CFractions                   frOutLiquid;
 	for (const pair<uint320, CCoinToUse>& item : mapAllOutputs) {
 		uint320    fkey = item.first;
 		CFractions frOut(0, CFractions::VALUE);
@@ -1016,13 +1021,14 @@ Value preparereservewithdraw(const Array& params, bool fHelp) {
 		}
 
 		int64_t nAvailableReserve = 0;
-		frOut = frOut.LowPart(peglevel_exchange.nSupplyNext, &nAvailableReserve);
+		frOut.SplitAt(peglevel_exchange.nSupplyNext, frOutReserve, frOutLiquid,
+		              &nAvailableReserve, nullptr);
 
 		if (nAvailableReserve < (nAmountWithFee / 20)) {
 			continue;
 		}
 
-		double distortion = frOut.Distortion(frAmount);
+		double distortion = frOutReserve.Distortion(frAmount);
 		ratedOutputs.insert(pair<double, CCoinToUse>(distortion, item.second));
 		mapAvailableReserve[fkey] = nAvailableReserve;
 	}
@@ -1560,18 +1566,21 @@ Value accountmaintenance(const Array& params, bool fHelp) {
 	// rate available coin fractions
 	map<uint320, int64_t>        mapAvailableLiquid;
 	multimap<double, CCoinToUse> ratedOutputs;
+	CFractions                   frOutReserve;  // split buffers reused for all coins
+	CFractions                   frOutLiquid;
 	for (const pair<uint320, CCoinToUse>& item : mapAllOutputs) {
-		uint320 fkey = item.first;
-		if (!mapAvailableCoins.count(fkey)) {
+		uint320 fkey  = item.first;
+		auto    itOut = mapAvailableCoins.find(fkey);
+		if (itOut == mapAvailableCoins.end()) {
 			continue;
 		}
 
-		int64_t    nAvailableLiquid = 0;
-		CFractions frOut            = mapAvailableCoins[fkey];
-		frOut                       = frOut.HighPart(peglevel_net.nSupply, &nAvailableLiquid);
+		int64_t nAvailableLiquid = 0;
+		itOut->second.SplitAt(peglevel_net.nSupply, frOutReserve, frOutLiquid, nullptr,
+		                      &nAvailableLiquid);
 
 		/*less distorted are first*/
-		double distortion = frOut.Distortion(frAllLiquid);
+		double distortion = frOutLiquid.Distortion(frAllLiquid);
 		ratedOutputs.insert(pair<double, CCoinToUse>(distortion, item.second));
 		mapAvailableLiquid[fkey] = nAvailableLiquid;
 	}
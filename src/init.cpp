@@ -101,6 +101,13 @@ void Shutdown() {
 #ifdef ENABLE_WALLET
 		if (pwalletMain)
 			pwalletMain->SetBestChain(CBlockLocator(pindexBest));
+#endif
+#ifndef WIN32
+		// read back with mmap, not on windows
+		if (pindexBest && GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT)) {
+			CTxDB txdb;
+			txdb.WriteBlockIndexSnapshot();
+		}
 #endif
 	}
 #ifdef ENABLE_WALLET
@@ -114,6 +121,7 @@ void Shutdown() {
 	pwalletMain = NULL;
 #endif
 	LogPrintf("Shutdown : done\n");
+	FlushDebugLog();
 }
 
 //
@@ -161,6 +169,20 @@ std::string HelpMessage() {
 		"  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n";
 	strUsage += "  -dbcache=<n>           " +
 				_("Set database cache size in megabytes (default: 50)") + "\n";
+	strUsage += "  -leveldbcache=<n>      " +
+				_("Set LevelDB cache and write buffers in megabytes, split between tx and peg "
+				  "databases (default: 2 x dbcache)") +
+				"\n";
+	strUsage += "  -txdbcache=<n>         " +
+				_("Set tx database cache and write buffer in megabytes (default: half of "
+				  "leveldbcache)") +
+				"\n";
+	strUsage += "  -pegdbcache=<n>        " +
+				_("Set peg database cache and write buffer in megabytes (default: half of "
+				  "leveldbcache)") +
+				"\n";
+	strUsage += "  -maxaddrcachesize=<n>  " +
+				_("Keep at most <n> script addresses in memory (default: 100000)") + "\n";
 	strUsage += "  -dblogsize=<n>         " +
 				_("Set database disk log size in megabytes (default: 100)") + "\n";
 	strUsage += "  -timeout=<n>           " +
@@ -239,13 +261,18 @@ std::string HelpMessage() {
 	strUsage +=
 		" addrman, alert, db, lock, rand, rpc, selectcoins, mempool, net,";  // Don't translate
 																			 // these and qt below
-	strUsage += " coinstake, creation, stakemodifier";
+	strUsage += " coinstake, creation, stakemodifier, bench, pegprune";
 	if (fHaveGUI) {
 		strUsage += ", qt.\n";
 	} else {
 		strUsage += ".\n";
 	}
-	strUsage += "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n";
+	strUsage += "  -logtimestamps         " +
+				_("Prepend debug output with timestamp in microseconds and thread name") + "\n";
+	strUsage += "  -lograte=<n>           " +
+				_("Log at most <n> lines per second for each debug category, unrelated "
+				  "categories may share a limit (default: 0 = unlimited)") +
+				"\n";
 	strUsage += "  -shrinkdebugfile       " +
 				_("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n";
 	strUsage += "  -printtoconsole        " +
@@ -299,6 +326,41 @@ std::string HelpMessage() {
 				strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"),
 						  DEFAULT_MAX_ORPHAN_BLOCKS) +
 				"\n";
+	strUsage += "  -blockcheckthreads=<n> " +
+				_("Threads for context-free checks of large and imported blocks and for "
+				  "-checkblocks verification at startup (default: 0 = all cores)") +
+				"\n";
+	strUsage += "  -utxoloadthreads=<n>   " +
+				_("Threads for the peg balances rebuild of the address index (default: 0 = "
+				  "all cores)") +
+				"\n";
+	strUsage += "  -migratethreads=<n>    " +
+				_("Threads for one-shot migrations of the block and tx indexes (default: 0 = "
+				  "all cores)") +
+				"\n";
+	strUsage += "  -blockindexsnapshot    " +
+				_("Write the block index to a snapshot file on shutdown and load it on "
+				  "startup (default: 1)") +
+				"\n";
+	strUsage += "  -blockfilemaps=<n>     " +
+				strprintf(_("Keep up to <n> block files memory mapped for reads, 0 to read "
+				            "with stdio (default: %u)"),
+						  DEFAULT_BLOCKFILE_MAPS) +
+				"\n";
+	strUsage += "  -maxmempool=<n>        " +
+				strprintf(_("Keep the transaction memory pool below <n> megabytes, evicting "
+				            "lowest fee rate transactions (default: %u)"),
+						  DEFAULT_MAX_MEMPOOL_SIZE) +
+				"\n";
+	strUsage += "  -pegprunebatch=<n>     " +
+				_("Prune spent peg fractions of <n> blocks per batch (default: 100)") + "\n";
+	strUsage += "  -pegprunepause=<n>     " +
+				_("Pause in milliseconds between peg prune batches (default: 200)") + "\n";
+	strUsage += "  -pegprunecompact=<n>   " +
+				_("Compact peg database after <n> pruned keys (default: 200000)") + "\n";
+	strUsage += "  -pegreviewthreads=<n>  " +
+				_("Threads to recheck memory pool fractions on peg change (default: 0 = all cores)") +
+				"\n";
 
 	strUsage += "\n" + _("Block creation options:") + "\n";
 	strUsage +=
@@ -309,6 +371,10 @@ std::string HelpMessage() {
 		"  -blockprioritysize=<n> " +
 		_("Set maximum size of high-priority/low-fee transactions in bytes (default: 27000)") +
 		"\n";
+	strUsage += "  -staketemplatelife=<n> " +
+				_("Reuse the staking block template for <n> seconds while the tip does not "
+				  "change (default: 10)") +
+				"\n";
 
 	strUsage += "\n" + _("SSL options: (see the Bitcoin Wiki for SSL setup instructions)") + "\n";
 	strUsage += "  -rpcssl                                  " +
@@ -400,9 +466,10 @@ bool AppInit2(boost::thread_group& threadGroup) {
 
 	// ********************************************************* Step 2: parameter interactions
 
-	nNodeLifespan = GetArg("-addrlifespan", 7);
-	fUseFastIndex = GetBoolArg("-fastindex", true);
-	nMinerSleep   = GetArg("-minersleep", 500);
+	nNodeLifespan  = GetArg("-addrlifespan", 7);
+	fUseFastIndex  = GetBoolArg("-fastindex", true);
+	nMinerSleep    = GetArg("-minersleep", 500);
+	nBlockFileMaps = GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS);
 
 	if (!SelectParamsFromCommandLine()) {
 		return InitError("Invalid combination of -testnet and -regtest.");
@@ -460,6 +527,7 @@ bool AppInit2(boost::thread_group& threadGroup) {
 	if (GetBoolArg("-nodebug", false) ||
 		find(categories.begin(), categories.end(), string("0")) != categories.end())
 		fDebug = false;
+	fCountHashes = LogAcceptCategory("bench");
 
 	// Check for -debugnet (deprecated)
 	if (GetBoolArg("-debugnet", false))
@@ -480,6 +548,7 @@ bool AppInit2(boost::thread_group& threadGroup) {
 		fServer = true;
 	fPrintToConsole = GetBoolArg("-printtoconsole", false);
 	fLogTimestamps  = GetBoolArg("-logtimestamps", false);
+	nLogRateLimit   = GetArg("-lograte", 0);
 #ifdef ENABLE_WALLET
 	bool fDisableWallet = GetBoolArg("-disablewallet", false);
 #endif
@@ -546,6 +615,7 @@ bool AppInit2(boost::thread_group& threadGroup) {
 	LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
 	LogPrintf("BitBay version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
 	LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+	LogPrintf("Using SHA256 implementation: %s\n", SHA256AutoDetect());
 	if (!fLogTimestamps)
 		LogPrintf("Startup time: %s\n", DateTimeStrFormat("%x %H:%M:%S", GetTime()));
 	LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
@@ -939,6 +1009,9 @@ bool AppInit2(boost::thread_group& threadGroup) {
 #endif
 #endif
 
+	// Prune spent peg fractions behind the prune window in the background
+	threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "pegprune", &ThreadPegPrune));
+
 	// ********************************************************* Step 12: finished
 
 	uiInterface.InitMessage(_("Done loading"));
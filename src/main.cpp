@@ -25,6 +25,16 @@
 #include <zconf.h>
 #include <zlib.h>
 
+#include <atomic>
+#include <functional>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -75,6 +85,13 @@ bool         fImporting        = false;
 bool         fReindex          = false;
 bool         fHaveGUI          = false;
 bool         fAboutToSendGUI   = false;
+int64_t      nBlockFileMaps    = DEFAULT_BLOCKFILE_MAPS;
+
+bool                  fCountHashes = false;
+std::atomic<uint64_t> nTxHashCalls(0);
+std::atomic<uint64_t> nTxHashesComputed(0);
+std::atomic<uint64_t> nBlockHashCalls(0);
+std::atomic<uint64_t> nBlockHashesComputed(0);
 
 struct COrphanBlock {
 	uint256                        hashBlock;
@@ -667,6 +684,7 @@ bool AcceptToMemoryPool(CTxMemPool&   pool,
 	MapPrevOut             mapPrevOuts;
 	MapFractions           mapOutputsFractions;
 	CFractions             feesFractions;
+	CTxMemPoolEntry        entry;
 	int                    nBridgePoolNout        = pindexBest->nHeight;
 	bool                   fBridgePoolFromChanges = false;  // read from disk
 	int64_t                nVirtBlockTime         = GetAdjustedTime();
@@ -802,10 +820,17 @@ bool AcceptToMemoryPool(CTxMemPool&   pool,
 			    "MANDATORY but not STANDARD flags %s",
 			    hash.ToString());
 		}
+
+		entry = CTxMemPoolEntry(tx, mapInputs, nFees, nHeight, GetTime());
 	}
 
-	// Store transaction in memory
-	pool.addUnchecked(hash, tx, mapPrevOuts, mapOutputsFractions);
+	// Store transaction in memory, keep the pool within -maxmempool: the
+	// new tx may be the one to go
+	size_t nMaxMempool =
+	    (size_t)std::max((int64_t)0, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE)) * 1000000;
+	if (!pool.addUncheckedAndTrim(hash, tx, entry, mapPrevOuts, mapInputsFractions,
+	                              mapOutputsFractions, nMaxMempool))
+		return error("AcceptToMemoryPool : mempool full, %s fee rate too low", hash.ToString());
 
 	SyncWithWallets(tx, NULL, true, mapOutputsFractions);
 
@@ -1491,13 +1516,13 @@ bool CTransaction::FetchInputs(CTxDB&                                  txdb,
 
 		// get requested fractions from sigscript
 		{
-			CBitcoinAddress addr_dest;
-			vector<int64_t> sections;
-			int             section_peg = 0;
-			int             nonce       = 0;
-			string          from;
-			string          leaf;
-			vector<string>  proofs;
+			CBitcoinAddress       addr_dest;
+			vector<int64_t>       sections;
+			int                   section_peg = 0;
+			int                   nonce       = 0;
+			vector<unsigned char> from;
+			MerkleHash            leaf;
+			vector<MerkleHash>    proofs;
 
 			if (!DecodeAndValidateMintSigScript(vin[1].scriptSig, addr_dest, sections, section_peg,
 			                                    nonce, from, leaf, proofs))
@@ -1516,25 +1541,26 @@ bool CTransaction::FetchInputs(CTxDB&                                  txdb,
 			}
 			// compute the leaf
 			{
-				string out_leaf_hex;
+				MerkleHash out_leaf;
 				if (!ComputeMintMerkleLeaf(addr_dest.ToString(), sections, section_peg, nonce,
-				                           "0x" + from, out_leaf_hex))
+				                           from, out_leaf))
 					return error("FetchInputs() : %s CoinMint ComputeMintMerkleLeaf fail",
 					             GetHash().ToString());
-				if (leaf != out_leaf_hex)
+				if (leaf != out_leaf)
 					return error(
 					    "FetchInputs() : %s CoinMint computed leaf mismatch extracted: %s vs %s",
-					    GetHash().ToString(), out_leaf_hex, leaf);
+					    GetHash().ToString(), HexStr(out_leaf.begin(), out_leaf.end()),
+					    HexStr(leaf.begin(), leaf.end()));
 			}
 
 			// check proofs
 			string merkle_root;
 			{
-				string out_root_hex;
-				if (!ComputeMintMerkleRoot(leaf, proofs, out_root_hex))
+				MerkleHash out_root;
+				if (!ComputeMintMerkleRoot(leaf, proofs, out_root))
 					return error("FetchInputs() : %s CoinMint ComputeMintMerkleRoot fail",
 					             GetHash().ToString());
-				merkle_root = out_root_hex;
+				merkle_root = HexStr(out_root.begin(), out_root.end());
 			}
 
 			// find out bridge details and merkles
@@ -1576,7 +1602,9 @@ bool CTransaction::FetchInputs(CTxDB&                                  txdb,
 			}
 
 			// bridge pool fractions to be in the inputs or to read
-			auto leaf_fkey   = uint320(uint256(leaf), 0);
+			uint256 leaf_hash;  // as from leaf hex, uint256 keeps bytes reversed
+			std::reverse_copy(leaf.begin(), leaf.end(), leaf_hash.begin());
+			auto leaf_fkey   = uint320(leaf_hash, 0);
 			auto bridge_fkey = uint320(uint256(bridge.hash), nBridgePoolNout);
 
 			CFractions frBridgePool;
@@ -1629,13 +1657,13 @@ bool CTransaction::FetchInputs(CTxDB&                                  txdb,
 			finputsRet[bridge_fkey] =
 			    frBridgePoolInput;  // pass via inputs to be deducted in ConnectInputs
 			finputsRet[leaf_fkey] = frLeafBay;
-			inputsRet[uint256(leaf)].first.vSpent.push_back(CDiskTxPos());
-			inputsRet[uint256(leaf)].second.nTime = merkle.ntime;
+			inputsRet[leaf_hash].first.vSpent.push_back(CDiskTxPos());
+			inputsRet[leaf_hash].second.nTime = merkle.ntime;
 			{
-				string  nhash = bridge.hash + "0x" + from;
+				string  nhash = bridge.hash + "0x" + ValueString(from);
 				CScript scriptPubKey;
 				scriptPubKey.PushNotary("**Z**" + nhash);
-				inputsRet[uint256(leaf)].second.vout.push_back(CTxOut(nValueIn, scriptPubKey));
+				inputsRet[leaf_hash].second.vout.push_back(CTxOut(nValueIn, scriptPubKey));
 			}
 		}
 
@@ -1854,6 +1882,7 @@ bool CTransaction::ConnectInputs(MapPrevTx                          inputs,
 	// Calculation of fractions is considered less expensive than
 	// signatures checks. Same time collect all fees fractions.
 	// #NOTE1, #NOTE2
+	int64_t nTimeFractions = GetTimeMicros();
 	if (IsCoinMint()) {
 		if (pindexBlock->nHeight >= nPegStartHeight) {
 			string sPegFailCause;
@@ -1870,6 +1899,10 @@ bool CTransaction::ConnectInputs(MapPrevTx                          inputs,
 		}
 	}
 
+	int64_t nTimeScripts = GetTimeMicros();
+	if (fBlock)
+		AddBlockBenchTime(BENCH_FRACTIONS, nTimeScripts - nTimeFractions);
+
 	// Collect used pubkeys per inputs
 	CPegDB                      pegdb("r");
 	map<uint32_t, set<vchtype>> mInputSignedPubks;
@@ -1946,6 +1979,10 @@ bool CTransaction::ConnectInputs(MapPrevTx                          inputs,
 		}
 	}
 
+	nTimeFractions = GetTimeMicros();
+	if (fBlock)
+		AddBlockBenchTime(BENCH_SCRIPTS, nTimeFractions - nTimeScripts);
+
 	// Calculation of standard fractions is moved to be after signatures checks
 	// Now all used pubkeys are known and can be used to bypass frozen locks
 	if (!IsCoinStake() && !IsCoinMint()) {
@@ -1961,6 +1998,8 @@ bool CTransaction::ConnectInputs(MapPrevTx                          inputs,
 			}
 		}
 	}
+	if (fBlock)
+		AddBlockBenchTime(BENCH_FRACTIONS, GetTimeMicros() - nTimeFractions);
 
 	if (IsCoinStake()) {
 		return true;
@@ -1982,6 +2021,7 @@ bool CTransaction::ConnectInputs(MapPrevTx                          inputs,
 }
 
 static void CreateUtxoHistoryRecord(CTxDB&                        txdb,
+                                    CAddressBlockOverlay&         overlay,
                                     string                        sAddress,
                                     uint64_t                      nTime,
                                     uint64_t                      nHeight,
@@ -1993,7 +2033,7 @@ static void CreateUtxoHistoryRecord(CTxDB&                        txdb,
 		return;  // already present
 	int64_t          nLastIndex = -1;
 	CAddressBalance& balance    = mapAddressesBalances[sAddress];
-	txdb.ReadAddressLastBalance(sAddress, balance, nLastIndex);
+	overlay.ReadAddressLastBalance(txdb, sAddress, balance, nLastIndex);
 	mapAddressesBalancesIdxs[sAddress] = nLastIndex + 1;
 	balance.nTime                      = nTime;
 	balance.nHeight                    = nHeight;
@@ -2003,12 +2043,13 @@ static void CreateUtxoHistoryRecord(CTxDB&                        txdb,
 	balance.nDebit                     = 0;
 }
 
-bool CTransaction::ConnectUtxo(CTxDB&             txdb,
-                               const CBlockIndex* pindex,
-                               int16_t            nTxIdx,
-                               MapPrevTx&         mapInputs,
-                               MapFractions&      mapInputsFractions,
-                               MapFractions&      mapOutputsFractions) const {
+bool CTransaction::ConnectUtxo(CTxDB&                txdb,
+                               CAddressBlockOverlay& overlay,
+                               const CBlockIndex*    pindex,
+                               int16_t               nTxIdx,
+                               MapPrevTx&            mapInputs,
+                               MapFractions&         mapInputsFractions,
+                               MapFractions&         mapOutputsFractions) const {
 	auto                         txhash = GetHash();
 	map<string, int64_t>         mapAddressesBalancesIdxs;
 	map<string, CAddressBalance> mapAddressesBalances;
@@ -2057,7 +2098,8 @@ bool CTransaction::ConnectUtxo(CTxDB&             txdb,
 		// remove spent or frozen
 		CAddressUnspent unspent;
 		if (txdb.ReadUnspent(sAddress, txoutid, unspent)) {
-			if (!txdb.DeductSpent(sAddress, fractions, unspent.nHeight >= nPegStartHeight))
+			if (!overlay.DeductSpent(txdb, sAddress, fractions,
+			                         unspent.nHeight >= nPegStartHeight))
 				return error("ConnectUtxo() : DeductSpent");
 			if (!txdb.EraseUnspent(sAddress, txoutid))
 				return error("ConnectUtxo() : EraseUnspent");
@@ -2066,8 +2108,8 @@ bool CTransaction::ConnectUtxo(CTxDB&             txdb,
 				return error("ConnectUtxo() : EraseFrozen");
 		}
 		// make a record if not ready
-		CreateUtxoHistoryRecord(txdb, sAddress, pindex->nTime, pindex->nHeight, nTxIdx, txhash,
-		                        mapAddressesBalances, mapAddressesBalancesIdxs);
+		CreateUtxoHistoryRecord(txdb, overlay, sAddress, pindex->nTime, pindex->nHeight, nTxIdx,
+		                        txhash, mapAddressesBalances, mapAddressesBalancesIdxs);
 		// credit record
 		CAddressBalance& balance = mapAddressesBalances[sAddress];
 		balance.nCredit += txout.nValue;
@@ -2115,12 +2157,13 @@ bool CTransaction::ConnectUtxo(CTxDB&             txdb,
 		} else {
 			if (!txdb.AddUnspent(sAddress, txoutid, unspent))
 				return error("ConnectUtxo() : AddUnspent");
-			if (!txdb.AppendUnspent(sAddress, fractions, unspent.nHeight >= nPegStartHeight))
+			if (!overlay.AppendUnspent(txdb, sAddress, fractions,
+			                           unspent.nHeight >= nPegStartHeight))
 				return error("ConnectUtxo() : AppendSpent");
 		}
 		// make a record if not ready
-		CreateUtxoHistoryRecord(txdb, sAddress, pindex->nTime, pindex->nHeight, nTxIdx, txhash,
-		                        mapAddressesBalances, mapAddressesBalancesIdxs);
+		CreateUtxoHistoryRecord(txdb, overlay, sAddress, pindex->nTime, pindex->nHeight, nTxIdx,
+		                        txhash, mapAddressesBalances, mapAddressesBalancesIdxs);
 		// debit record
 		CAddressBalance& balance = mapAddressesBalances[sAddress];
 		balance.nDebit += txout.nValue;
@@ -2145,7 +2188,7 @@ bool CTransaction::ConnectUtxo(CTxDB&             txdb,
 			balance.nCredit = 0;
 		}
 		balance.nBalance = balance.nBalance + nDiff;
-		if (!txdb.AddBalance(sAddress, nIdx, balance))
+		if (!overlay.AddBalance(txdb, sAddress, nIdx, balance))
 			return error("ConnectUtxo() : AddBalance");
 	}
 
@@ -2154,11 +2197,12 @@ bool CTransaction::ConnectUtxo(CTxDB&             txdb,
 
 // remove records from frozen queue and add artificial
 // balance records indicating the unfreezing amount
-bool CBlock::ProcessFrozenQueue(CTxDB&             txdb,
-                                CPegDB&            pegdb,
-                                MapFractions&      mapFractions,
-                                const CBlockIndex* pindex,
-                                bool               fLoading) {
+bool CBlock::ProcessFrozenQueue(CTxDB&                txdb,
+                                CPegDB&               pegdb,
+                                CAddressBlockOverlay& overlay,
+                                MapFractions&         mapFractions,
+                                const CBlockIndex*    pindex,
+                                bool                  fLoading) {
 	std::vector<CFrozenQueued> records;
 	txdb.ReadFrozenQueue(nTime, records);
 	for (auto record : records) {
@@ -2168,7 +2212,7 @@ bool CBlock::ProcessFrozenQueue(CTxDB&             txdb,
 		// 2. unfreezing balance record
 		int64_t         nLastIndex = -1;
 		CAddressBalance balance;
-		if (!txdb.ReadAddressLastBalance(record.sAddress, balance, nLastIndex))
+		if (!overlay.ReadAddressLastBalance(txdb, record.sAddress, balance, nLastIndex))
 			return error("ProcessFrozenQueue() : ReadAddressLastBalance");
 		nLastIndex        = nLastIndex + 1;
 		balance.nTime     = nTime;                    /*blocktime*/
@@ -2179,7 +2223,7 @@ bool CBlock::ProcessFrozenQueue(CTxDB&             txdb,
 		balance.nDebit    = record.nAmount;
 		balance.nLockTime = record.nLockTime;
 		balance.nFrozen -= record.nAmount;
-		if (!txdb.AddBalance(record.sAddress, nLastIndex, balance))
+		if (!overlay.AddBalance(txdb, record.sAddress, nLastIndex, balance))
 			return error("ConnectUtxo() : AddBalance");
 		// 3. move from ftxo to utxo
 		CAddressUnspent frozen;
@@ -2195,7 +2239,7 @@ bool CBlock::ProcessFrozenQueue(CTxDB&             txdb,
 				fractions = mapFractions[record.txoutid];
 			else if (!pegdb.ReadFractions(record.txoutid, fractions, !fLoading /*must_have*/))
 				return error("ProcessFrozenQueue() : ReadFractions: %s", record.txoutid.GetHex());
-			if (!txdb.AppendUnspent(record.sAddress, fractions, true /*peg_on*/))
+			if (!overlay.AppendUnspent(txdb, record.sAddress, fractions, true /*peg_on*/))
 				return error("ProcessFrozenQueue() : AppendSpent");
 		}
 	}
@@ -2434,10 +2478,114 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex) {
 		pegdb.RemovePegTxId(wid);
 	}
 
+	// Cycle states stored under this block are rewritten if it is connected again
+	pegdb.ForgetCycleStates(pindex->GetBlockHash());
+
 	return true;
 }
 
+// Profile of block connection: the per-block buffer is filled under cs_main by
+// ConnectBlock/ConnectInputs and folded into the totals once the block is connected
+static int64_t          nBlockBenchMicros[BENCH_PHASE_COUNT] = {};
+static CCriticalSection cs_blockbench;
+static CBlockBenchStats blockBenchStats;
+
+static const char* const pszBlockBenchPhases[BENCH_PHASE_COUNT] = {
+    "pegindex",      "consensusstates", "bridgepools", "txindex", "fetchinputs",
+    "connectinputs", "scripts",         "fractions",   "stake",   "votes",
+    "connectutxo",   "frozenqueue",     "writeindex",  "commit"};
+
+const char* GetBlockBenchPhaseName(int nPhase) {
+	if (nPhase < 0 || nPhase >= BENCH_PHASE_COUNT)
+		return "unknown";
+	return pszBlockBenchPhases[nPhase];
+}
+
+CBlockBenchStats GetBlockBenchStats() {
+	LOCK(cs_blockbench);
+	return blockBenchStats;
+}
+
+void AddBlockBenchTime(int nPhase, int64_t nMicros) {
+	if (nPhase < 0 || nPhase >= BENCH_PHASE_COUNT)
+		return;
+	if (nPhase == BENCH_COMMIT) {
+		// the db commit follows ConnectBlock, the block is already accounted
+		LOCK(cs_blockbench);
+		blockBenchStats.nLastMicros[nPhase] = nMicros;
+		blockBenchStats.nTotalMicros[nPhase] += nMicros;
+		return;
+	}
+	nBlockBenchMicros[nPhase] += nMicros;
+}
+
+CBlockBenchTimer::CBlockBenchTimer(int nPhaseIn) : nPhase(nPhaseIn), nMark(GetTimeMicros()) {}
+
+void CBlockBenchTimer::Switch(int nPhaseIn) {
+	int64_t nNow = GetTimeMicros();
+	if (nPhase >= 0)
+		AddBlockBenchTime(nPhase, nNow - nMark);
+	nPhase = nPhaseIn;
+	nMark  = nNow;
+}
+
+void CBlockBenchTimer::Stop() { Switch(-1); }
+
+static void GetHashCounters(uint64_t nCounters[BENCH_HASH_COUNTERS]) {
+	nCounters[0] = nTxHashCalls;
+	nCounters[1] = nTxHashesComputed;
+	nCounters[2] = nBlockHashCalls;
+	nCounters[3] = nBlockHashesComputed;
+}
+
+static void FinishBlockBench(const CBlockIndex* pindex,
+                             int64_t            nBlockMicros,
+                             const uint64_t     nHashesStart[BENCH_HASH_COUNTERS]) {
+	uint64_t nHashes[BENCH_HASH_COUNTERS];
+	GetHashCounters(nHashes);
+	for (int i = 0; i < BENCH_HASH_COUNTERS; i++)
+		nHashes[i] -= nHashesStart[i];
+	{
+		LOCK(cs_blockbench);
+		blockBenchStats.nBlocks++;
+		blockBenchStats.nLastHeight      = pindex->nHeight;
+		blockBenchStats.nLastBlockMicros = nBlockMicros;
+		blockBenchStats.nTotalBlockMicros += nBlockMicros;
+		for (int i = 0; i < BENCH_HASH_COUNTERS; i++) {
+			blockBenchStats.nLastHashes[i] = nHashes[i];
+			blockBenchStats.nTotalHashes[i] += nHashes[i];
+		}
+		for (int i = 0; i < BENCH_PHASE_COUNT; i++) {
+			if (i == BENCH_COMMIT)
+				continue;
+			blockBenchStats.nLastMicros[i] = nBlockBenchMicros[i];
+			blockBenchStats.nTotalMicros[i] += nBlockBenchMicros[i];
+		}
+	}
+
+	if (!LogAcceptCategory("bench"))
+		return;
+	string sPhases;
+	for (int i = 0; i < BENCH_PHASE_COUNT; i++) {
+		if (i == BENCH_COMMIT)
+			continue;
+		sPhases += strprintf(" %s %.2fms", pszBlockBenchPhases[i], nBlockBenchMicros[i] * 0.001);
+	}
+	LogPrint("bench", "ConnectBlock() : height %d total %.2fms,%s\n", pindex->nHeight,
+	         nBlockMicros * 0.001, sPhases);
+	LogPrint("bench",
+	         "ConnectBlock() : height %d tx GetHash %d calls %d hashed, "
+	         "block GetHash %d calls %d hashed\n",
+	         pindex->nHeight, nHashes[0], nHashes[1], nHashes[2], nHashes[3]);
+}
+
 bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool fJustCheck) {
+	int64_t  nTimeStart = GetTimeMicros();
+	uint64_t nHashesStart[BENCH_HASH_COUNTERS];
+	GetHashCounters(nHashesStart);
+	for (int64_t& nMicros : nBlockBenchMicros)
+		nMicros = 0;
+
 	// Check it again in case a previous version let a bad block in, but skip BlockSig checking
 	if (!CheckBlock(!fJustCheck, !fJustCheck, false))
 		return false;
@@ -2460,11 +2608,19 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) -
 		         (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
 
+	// per-block profile of the address derivation work (-debug=bench)
+	uint64_t nAddrHitsStart   = 0;
+	uint64_t nAddrMissesStart = 0;
+	GetScriptAddressCacheStats(nAddrHitsStart, nAddrMissesStart);
+
 	// bitbay: prepare peg supply index information
+	CBlockBenchTimer bench(BENCH_PEG_INDEX);
 	if (!CalculateBlockPegIndex(pegdb, pindex))
 		return error("ConnectBlock() : fail to calculate block peg index");
+	bench.Switch(BENCH_CONSENSUS_STATES);
 	if (!ConnectConsensusStates(pegdb, pindex))
 		return error("ConnectBlock() : fail to connect consensus states");
+	bench.Switch(BENCH_BRIDGE_POOLS);
 	map<string, CBridgeInfo> bridges;
 	if (!pindex->ReadBridges(pegdb, bridges))
 		return error("ConnectBlock() : bridges read error");
@@ -2517,6 +2673,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		// 0:00 UTC. Now that the whole chain is irreversibly beyond that time it is applied to all
 		// blocks except the two in the chain that violate it. This prevents exploiting the issue
 		// against nodes in their initial block download.
+		bench.Switch(BENCH_TX_INDEX);
 		CTxIndex txindexOld;
 		if (txdb.ReadTxIndex(tx_hash, txindexOld)) {
 			for (CDiskTxPos& pos : txindexOld.vSpent) {
@@ -2537,6 +2694,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 			nValueOut += tx.GetValueOut();
 		else {
 			bool fInvalid;
+			bench.Switch(BENCH_FETCH_INPUTS);
 			if (!tx.FetchInputs(txdb, pegdb, nBridgePoolNout, fBridgePoolFromChanges, bridges,
 			                    fnMerkleIn, mapQueuedChanges, mapQueuedFractionsChanges,
 			                    true /*is block*/, false /*is miner*/, nTime, false /*skip pruned*/,
@@ -2564,6 +2722,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 			if (tx.IsCoinMint())
 				nValueMint = nTxValueOut;  // TODO: log/use
 
+			bench.Switch(BENCH_CONNECT_INPUTS);
 			if (!tx.ConnectInputs(mapInputs[i], mapInputsFractions[i], mapQueuedChanges,
 			                      mapQueuedFractionsChanges, nBridgePoolNout, bridges, fnMerkleIn,
 			                      timelockpasses, feesFractions, posThisTx, pindex,
@@ -2574,6 +2733,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		mapQueuedChanges[tx_hash] = CTxIndex(posThisTx, tx.vout.size(), pindex->nHeight, i);
 	}
 
+	bench.Switch(BENCH_STAKE);
 	if (IsProofOfWork()) {
 		int64_t nReward = GetProofOfWorkReward(nFees);
 		// Check coinbase reward
@@ -2639,6 +2799,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 	string staker_addr;
 
 	// peg voting information
+	bench.Switch(BENCH_BLOCK_VOTES);
 	if (!CalculateBlockPegVotes(*this, pindex, txdb, pegdb, staker_addr))
 		throw std::runtime_error(
 		    "CBlock::ConnectBlock() : CalculateBlockPegVotes failed due to pegdb fail");
@@ -2648,6 +2809,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		throw std::runtime_error(
 		    "CBlock::ConnectBlock() : CalculateBlockBridgeVotes failed due to pegdb fail");
 
+	bench.Switch(BENCH_WRITE_INDEX);
 	if (!txdb.WriteBlockIndex(CDiskBlockIndex(pindex)))
 		return error("Connect() : WriteBlockIndex for pindex failed");
 
@@ -2655,23 +2817,31 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		return true;
 
 	// fractions in and out are ready
+	bench.Switch(BENCH_CONNECT_UTXO);
 	{
+		// balances and peg balances of addresses are aggregated over the
+		// block and peg balances are written once per address
+		CAddressBlockOverlay overlay;
 		for (size_t i = 0; i < vtx.size(); i++) {
 			CTransaction& tx = vtx[i];
-			if (!tx.ConnectUtxo(txdb, pindex, i, mapInputs[i], mapInputsFractions[i],
+			if (!tx.ConnectUtxo(txdb, overlay, pindex, i, mapInputs[i], mapInputsFractions[i],
 			                    mapQueuedFractionsChanges)) {
 				// report, but it is not cause to stop/reject for now
 				error("ConnectBlock() : ConnectUtxo failed");
 			}
 		}
+		bench.Switch(BENCH_FROZEN_QUEUE);
 		if (pindex->nHeight >= nPegStartHeight) {
-			if (!ProcessFrozenQueue(txdb, pegdb, mapQueuedFractionsChanges, pindex,
+			if (!ProcessFrozenQueue(txdb, pegdb, overlay, mapQueuedFractionsChanges, pindex,
 			                        false /*fLoading*/)) {
 				// report, but it is not cause to stop/reject for now
 				error("ConnectBlock() : ConnectFrozenQueue failed");
 			}
 		}
+		if (!overlay.Flush(txdb))
+			error("ConnectBlock() : address balances flush failed");
 	}
+	bench.Switch(BENCH_WRITE_INDEX);
 
 	// Write queued txindex changes
 	for (map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin();
@@ -2687,26 +2857,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 			return error("ConnectBlock() : pegdb Write failed");
 	}
 
-	bool fPegPruneEnabled = true;
-	if (!pegdb.ReadPegPruneEnabled(fPegPruneEnabled)) {
-		fPegPruneEnabled = true;
-	}
-	if (fPegPruneEnabled) {
-		// Prune old spent fractions, back to index
-		int nHeightPrune = pindex->nHeight - PEG_PRUNE_INTERVAL;
-		if (nHeightPrune > 0 && nHeightPrune >= nPegStartHeight) {
-			auto pindexprune = pindex;
-			while (pindexprune && pindexprune->nHeight > nHeightPrune)
-				pindexprune = pindexprune->Prev();
-			if (pindexprune) {
-				CBlock blockprune;
-				if (blockprune.ReadFromDisk(pindexprune->nFile, pindexprune->nBlockPos,
-				                            true /*vtx*/)) {
-					PrunePegForBlock(blockprune, pegdb);
-				}
-			}
-		}
-	}
+	// spent fractions behind PEG_PRUNE_INTERVAL are pruned by ThreadPegPrune
+
+	uint64_t nAddrHits   = 0;
+	uint64_t nAddrMisses = 0;
+	GetScriptAddressCacheStats(nAddrHits, nAddrMisses);
+	LogPrint("bench", "ConnectBlock() : height %d script addresses %d cached %d encoded\n",
+	         pindex->nHeight, nAddrHits - nAddrHitsStart, nAddrMisses - nAddrMissesStart);
 
 	// Update block index on disk without changing it in memory.
 	// The memory index structure will be changed after the db commits.
@@ -2716,6 +2873,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 		if (!txdb.WriteBlockIndex(blockindexPrev))
 			return error("ConnectBlock() : WriteBlockIndex failed");
 	}
+	bench.Stop();
 
 	// Watch for transactions paying to me
 	for (const CTransaction& tx : vtx) {
@@ -2768,6 +2926,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindex, bool
 			return error("ConnectBlock() : peg txid write failed");
 	}
 
+	FinishBlockBench(pindex, GetTimeMicros() - nTimeStart, nHashesStart);
 	return true;
 }
 
@@ -2847,8 +3006,10 @@ bool static Reorganize(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindexNew) {
 		return error("Reorganize() : WriteHashBestChain failed");
 
 	// Make sure it's successfully written to disk before changing memory structure
+	int64_t nTimeCommit = GetTimeMicros();
 	if (!txdb.TxnCommit())
 		return error("Reorganize() : TxnCommit failed");
+	AddBlockBenchTime(BENCH_COMMIT, GetTimeMicros() - nTimeCommit);
 
 	// Disconnect shorter branch
 	for (const CBlockIndex* pindex : vDisconnect) {
@@ -2890,8 +3051,10 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindexNe
 		InvalidChainFound(pindexNew);
 		return false;
 	}
+	int64_t nTimeCommit = GetTimeMicros();
 	if (!txdb.TxnCommit())
 		return error("SetBestChain() : TxnCommit failed");
+	AddBlockBenchTime(BENCH_COMMIT, GetTimeMicros() - nTimeCommit);
 
 	// Add to current best branch
 	pindexNew->Prev()->SetNext(pindexNew);
@@ -3158,10 +3321,108 @@ bool CBlock::AddToBlockIndex(uint32_t nFile, uint32_t nBlockPos, const uint256&
 	return true;
 }
 
-bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) const {
+// Context-free checks of one block transaction, results kept per tx so
+// CheckBlock reports the first failure in block order.
+struct CBlockTxCheck {
+	bool     fValid     = false;
+	bool     fTimeValid = false;
+	uint32_t nSigOps    = 0;
+	uint256  hash;
+};
+
+static void CheckBlockTxs(const CBlock& block, vector<CBlockTxCheck>& vChecks,
+                          std::atomic<size_t>& nNext) {
+	for (size_t i = nNext++; i < block.vtx.size(); i = nNext++) {
+		const CTransaction& tx    = block.vtx[i];
+		CBlockTxCheck&      check = vChecks[i];
+		check.fValid              = tx.CheckTransaction();
+		check.fTimeValid          = block.GetBlockTime() >= (int64_t)tx.nTime;
+		check.nSigOps             = GetLegacySigOpCount(tx);
+		check.hash                = tx.GetHash();
+	}
+}
+
+// Worker threads for the transaction checks of large blocks, started on
+// first use and kept for the next blocks. The calling thread takes part in
+// each batch, batches of concurrent callers run one after another.
+class CBlockCheckPool {
+private:
+	boost::mutex              cs;
+	boost::condition_variable condWork;
+	boost::condition_variable condDone;
+	boost::mutex              cs_batch;
+	boost::thread_group       workers;
+	std::function<void()>     fnWork;  // empty outside of a batch
+	uint64_t                  nBatch   = 0;
+	int                       nRunning = 0;  // workers inside fnWork
+	int                       nThreads = 0;
+	bool                      fStop    = false;
+
+	void Worker() {
+		RenameThread("bitbay-blkcheck");
+		uint64_t                         nSeen = 0;
+		boost::unique_lock<boost::mutex> lock(cs);
+		while (true) {
+			while (!fStop && nSeen == nBatch)
+				condWork.wait(lock);
+			if (fStop)
+				return;
+			nSeen = nBatch;
+			if (!fnWork)
+				continue;  // woke up after the batch was done
+			std::function<void()> fn = fnWork;
+			nRunning++;
+			lock.unlock();
+			fn();
+			lock.lock();
+			if (--nRunning == 0)
+				condDone.notify_all();
+		}
+	}
+
+public:
+	~CBlockCheckPool() {
+		{
+			boost::unique_lock<boost::mutex> lock(cs);
+			fStop = true;
+			condWork.notify_all();
+		}
+		workers.join_all();
+	}
+
+	// run fn on nThreadsIn threads including the caller; fn has to take its
+	// work items from shared state until there are none left
+	void Run(int nThreadsIn, const std::function<void()>& fn) {
+		boost::unique_lock<boost::mutex> lockBatch(cs_batch);
+		{
+			boost::unique_lock<boost::mutex> lock(cs);
+			for (; nThreads < nThreadsIn - 1; nThreads++)
+				workers.create_thread(boost::bind(&CBlockCheckPool::Worker, this));
+			fnWork = fn;
+			nBatch++;
+			condWork.notify_all();
+		}
+		fn();
+		boost::unique_lock<boost::mutex> lock(cs);
+		fnWork = nullptr;
+		while (nRunning > 0)
+			condDone.wait(lock);
+	}
+};
+
+static CBlockCheckPool blockCheckPool;
+
+bool CBlock::CheckBlock(bool fCheckPOW,
+                        bool fCheckMerkleRoot,
+                        bool fCheckSig,
+                        bool fParallel) const {
 	// These are checks that are independent of context
 	// that can be verified before saving an orphan block.
 
+	// Checked in full already, e.g. before taking cs_main
+	if (fChecked && fCheckPOW && fCheckMerkleRoot && fCheckSig)
+		return true;
+
 	// Size limits
 	if (vtx.empty() || vtx.size() > MAX_BLOCK_SIZE ||
 	    ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
@@ -3200,39 +3461,63 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
 	if (fCheckSig && !CheckBlockSignature())
 		return DoS(100, error("CheckBlock() : bad proof-of-stake block signature"));
 
-	// Check transactions
-	for (const CTransaction& tx : vtx) {
-		if (!tx.CheckTransaction())
-			return DoS(tx.nDoS, error("CheckBlock() : CheckTransaction failed"));
+	// Check transactions, collecting their hashes and sigops; large blocks
+	// spread these context-free checks over worker threads
+	int64_t               nTimeStart = GetTimeMicros();
+	vector<CBlockTxCheck> vChecks(vtx.size());
+	std::atomic<size_t>   nNext(0);
+	int                   nThreads = 1;
+	if (fParallel && vtx.size() >= MIN_PARALLEL_BLOCK_CHECK_TXS) {
+		nThreads = GetArg("-blockcheckthreads", 0);
+		if (nThreads <= 0)
+			nThreads = boost::thread::hardware_concurrency();
+		nThreads = std::max(1, std::min(nThreads, 16));
+	}
+	if (nThreads > 1) {
+		blockCheckPool.Run(nThreads, [&]() { CheckBlockTxs(*this, vChecks, nNext); });
+	} else {
+		CheckBlockTxs(*this, vChecks, nNext);
+	}
+	int64_t nTimeTxs = GetTimeMicros();
+
+	// report the first failure in block order
+	vector<uint256> vTxHashes;
+	uint32_t        nSigOps = 0;
+	vTxHashes.reserve(vtx.size());
+	for (uint32_t i = 0; i < vtx.size(); i++) {
+		const CBlockTxCheck& check = vChecks[i];
+		if (!check.fValid)
+			return DoS(vtx[i].nDoS, error("CheckBlock() : CheckTransaction failed"));
 
 		// ppcoin: check transaction timestamp
-		if (GetBlockTime() < (int64_t)tx.nTime)
+		if (!check.fTimeValid)
 			return DoS(
 			    50,
 			    error("CheckBlock() : block timestamp (%d) earlier than transaction timestamp (%d)",
-			          GetBlockTime(), (int64_t)tx.nTime));
+			          GetBlockTime(), (int64_t)vtx[i].nTime));
+		nSigOps += check.nSigOps;
+		vTxHashes.push_back(check.hash);
 	}
 
 	// Check for duplicate txids. This is caught by ConnectInputs(),
 	// but catching it earlier avoids a potential DoS attack:
-	set<uint256> uniqueTx;
-	for (const CTransaction& tx : vtx) {
-		uniqueTx.insert(tx.GetHash());
-	}
+	set<uint256> uniqueTx(vTxHashes.begin(), vTxHashes.end());
 	if (uniqueTx.size() != vtx.size())
 		return DoS(100, error("CheckBlock() : duplicate transaction"));
 
-	uint32_t nSigOps = 0;
-	for (const CTransaction& tx : vtx) {
-		nSigOps += GetLegacySigOpCount(tx);
-	}
 	if (nSigOps > MAX_BLOCK_SIGOPS)
 		return DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"));
 
 	// Check merkle root
-	if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree())
+	if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree(vTxHashes))
 		return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
 
+	int64_t nTimeEnd = GetTimeMicros();
+	LogPrint("bench", "CheckBlock() : %u txs, %d threads, txs %.2fms, merkle %.2fms\n",
+	         vtx.size(), nThreads, (nTimeTxs - nTimeStart) * 0.001, (nTimeEnd - nTimeTxs) * 0.001);
+
+	if (fCheckPOW && fCheckMerkleRoot && fCheckSig)
+		fChecked = true;
 	return true;
 }
 
@@ -3675,6 +3960,61 @@ FILE* OpenBlockFile(uint32_t nFile, uint32_t nBlockPos, const char* pszMode) {
 	return file;
 }
 
+// Block files mapped for reading, most recently used first. Files are only
+// appended to, so a mapping stays valid and is renewed when a read passes its end.
+static CCriticalSection        cs_blockfileviews;
+static list<CBlockFileViewRef> lBlockFileViews;
+
+CBlockFileView::~CBlockFileView() {
+#ifndef WIN32
+	munmap(const_cast<char*>(pbegin), nSize);
+#endif
+}
+
+CBlockFileViewRef GetBlockFileView(uint32_t nFile, uint64_t nPos, bool fRefresh) {
+#ifdef WIN32
+	return CBlockFileViewRef();
+#else
+	if (nBlockFileMaps <= 0 || (nFile < 1) || (nFile == (uint32_t)-1))
+		return CBlockFileViewRef();
+
+	LOCK(cs_blockfileviews);
+	for (list<CBlockFileViewRef>::iterator it = lBlockFileViews.begin();
+	     it != lBlockFileViews.end(); ++it) {
+		if ((*it)->nFile != nFile)
+			continue;
+		CBlockFileViewRef view = *it;
+		lBlockFileViews.erase(it);
+		if (!fRefresh && nPos < view->nSize) {
+			lBlockFileViews.push_front(view);
+			return view;
+		}
+		break;  // too short, map the file again
+	}
+
+	int fd = open(BlockFilePath(nFile).string().c_str(), O_RDONLY);
+	if (fd < 0)
+		return CBlockFileViewRef();
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0 || nPos >= (uint64_t)st.st_size) {
+		close(fd);
+		return CBlockFileViewRef();
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		LogPrint("db", "GetBlockFileView() : mmap of blk%04u.dat failed, using stdio\n", nFile);
+		return CBlockFileViewRef();
+	}
+
+	CBlockFileViewRef view = std::make_shared<CBlockFileView>(nFile, (const char*)p, st.st_size);
+	lBlockFileViews.push_front(view);
+	while (lBlockFileViews.size() > (size_t)nBlockFileMaps)
+		lBlockFileViews.pop_back();
+	return view;
+#endif
+}
+
 static uint32_t nCurrentBlockFile = 1;
 
 FILE* AppendBlockFile(uint32_t& nFileRet) {
@@ -3820,56 +4160,188 @@ void PrintBlockTree() {
 	}
 }
 
-bool LoadExternalBlockFile(FILE* fileIn) {
-	int64_t nStart = GetTimeMillis();
+// Blocks read ahead from an external file: the reader thread deserializes them
+// into the queue, checker threads run the context-free checks and the import
+// thread connects them in file order.
+static const size_t MAX_IMPORT_QUEUE_BLOCKS = 256;
 
-	int nLoaded = 0;
-	{
-		try {
-			CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
-			uint32_t  nPos = 0;
-			while (nPos != (uint32_t)-1 && blkdat.good()) {
-				boost::this_thread::interruption_point();
-				unsigned char pchData[65536];
-				do {
-					fseek(blkdat, nPos, SEEK_SET);
-					int nRead = fread(pchData, 1, sizeof(pchData), blkdat);
-					if (nRead <= 8) {
-						nPos = (uint32_t)-1;
+struct CImportBlock {
+	CBlock block;
+	bool   fReady = false;  // context-free checks done
+};
+
+struct CBlockImportQueue {
+	boost::mutex                              cs;
+	boost::condition_variable                 cond;
+	std::deque<std::shared_ptr<CImportBlock>> queue;
+	uint64_t                                  nPushed  = 0;
+	uint64_t                                  nPopped  = 0;
+	uint64_t                                  nChecked = 0;  // sequence of the next block to check
+	uint64_t                                  nBytes   = 0;  // bytes of the file scanned
+	bool                                      fEof     = false;
+	bool                                      fStop    = false;
+};
+
+static void ImportReadBlocks(FILE* fileIn, CBlockImportQueue& importq) {
+	RenameThread("bitbay-loadblk-read");
+	try {
+		CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
+		uint32_t  nPos = 0;
+		while (nPos != (uint32_t)-1 && blkdat.good()) {
+			unsigned char pchData[65536];
+			do {
+				fseek(blkdat, nPos, SEEK_SET);
+				int nRead = fread(pchData, 1, sizeof(pchData), blkdat);
+				if (nRead <= 8) {
+					nPos = (uint32_t)-1;
+					break;
+				}
+				void* nFind =
+				    memchr(pchData, Params().MessageStart()[0], nRead + 1 - MESSAGE_START_SIZE);
+				if (nFind) {
+					if (memcmp(nFind, Params().MessageStart(), MESSAGE_START_SIZE) == 0) {
+						nPos += ((unsigned char*)nFind - pchData) + MESSAGE_START_SIZE;
 						break;
 					}
-					void* nFind =
-					    memchr(pchData, Params().MessageStart()[0], nRead + 1 - MESSAGE_START_SIZE);
-					if (nFind) {
-						if (memcmp(nFind, Params().MessageStart(), MESSAGE_START_SIZE) == 0) {
-							nPos += ((unsigned char*)nFind - pchData) + MESSAGE_START_SIZE;
-							break;
-						}
-						nPos += ((unsigned char*)nFind - pchData) + 1;
-					} else
-						nPos += sizeof(pchData) - MESSAGE_START_SIZE + 1;
-					boost::this_thread::interruption_point();
-				} while (true);
-				if (nPos == (uint32_t)-1)
+					nPos += ((unsigned char*)nFind - pchData) + 1;
+				} else
+					nPos += sizeof(pchData) - MESSAGE_START_SIZE + 1;
+			} while (true);
+			if (nPos == (uint32_t)-1)
+				break;
+			fseek(blkdat, nPos, SEEK_SET);
+			uint32_t nSize;
+			blkdat >> nSize;
+			if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+				continue;
+			std::shared_ptr<CImportBlock> pimport(new CImportBlock);
+			blkdat >> pimport->block;
+			nPos += 4 + nSize;
+
+			boost::unique_lock<boost::mutex> lock(importq.cs);
+			while (!importq.fStop && importq.queue.size() >= MAX_IMPORT_QUEUE_BLOCKS)
+				importq.cond.wait(lock);
+			if (importq.fStop)
+				break;
+			importq.queue.push_back(pimport);
+			importq.nPushed++;
+			importq.nBytes = nPos;
+			importq.cond.notify_all();
+		}
+	} catch (std::exception& e) {
+		LogPrintf("%s() : Deserialize or I/O error caught during load\n", __PRETTY_FUNCTION__);
+	}
+
+	boost::unique_lock<boost::mutex> lock(importq.cs);
+	importq.fEof = true;
+	importq.cond.notify_all();
+}
+
+static void ImportCheckBlocks(CBlockImportQueue& importq) {
+	RenameThread("bitbay-loadblk-check");
+	while (true) {
+		std::shared_ptr<CImportBlock> pimport;
+		{
+			boost::unique_lock<boost::mutex> lock(importq.cs);
+			while (!importq.fStop && importq.nChecked == importq.nPushed && !importq.fEof)
+				importq.cond.wait(lock);
+			if (importq.fStop || importq.nChecked == importq.nPushed)
+				return;
+			pimport = importq.queue[importq.nChecked - importq.nPopped];
+			importq.nChecked++;
+		}
+
+		// a block with a signature to be reserialized is left to ProcessBlock,
+		// failures are reported by ProcessBlock as well
+		if (IsCanonicalBlockSignature(&pimport->block))
+			pimport->block.CheckBlock(true, true, true, false /*parallel*/);
+
+		boost::unique_lock<boost::mutex> lock(importq.cs);
+		pimport->fReady = true;
+		importq.cond.notify_all();
+	}
+}
+
+bool LoadExternalBlockFile(FILE* fileIn) {
+	int64_t nStart = GetTimeMillis();
+
+	int64_t nFileSize = 0;
+	if (fseek(fileIn, 0, SEEK_END) == 0)
+		nFileSize = std::max(0L, ftell(fileIn));
+	fseek(fileIn, 0, SEEK_SET);
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fileno(fileIn), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	int nThreads = GetArg("-blockcheckthreads", 0);
+	if (nThreads <= 0)
+		nThreads = boost::thread::hardware_concurrency();
+	nThreads = std::max(1, std::min(nThreads, 16));
+
+	CBlockImportQueue   importq;
+	boost::thread_group workers;
+	workers.create_thread(boost::bind(&ImportReadBlocks, fileIn, boost::ref(importq)));
+	for (int i = 0; i < nThreads; i++)
+		workers.create_thread(boost::bind(&ImportCheckBlocks, boost::ref(importq)));
+
+	auto fnStopWorkers = [&]() {
+		{
+			boost::unique_lock<boost::mutex> lock(importq.cs);
+			importq.fStop = true;
+			importq.cond.notify_all();
+		}
+		workers.join_all();
+	};
+
+	int     nLoaded  = 0;
+	int64_t nLastLog = nStart;
+	int64_t nBytes   = 0;
+	size_t  nQueued  = 0;
+	try {
+		while (true) {
+			std::shared_ptr<CImportBlock> pimport;
+			{
+				boost::unique_lock<boost::mutex> lock(importq.cs);
+				while (!(importq.fEof && importq.queue.empty()) &&
+				       !(!importq.queue.empty() && importq.queue.front()->fReady))
+					importq.cond.wait(lock);
+				if (importq.queue.empty())
 					break;
-				fseek(blkdat, nPos, SEEK_SET);
-				uint32_t nSize;
-				blkdat >> nSize;
-				if (nSize > 0 && nSize <= MAX_BLOCK_SIZE) {
-					CBlock block;
-					blkdat >> block;
-					LOCK(cs_main);
-					if (ProcessBlock(NULL, &block)) {
-						nLoaded++;
-						nPos += 4 + nSize;
-					}
-				}
+				pimport = importq.queue.front();
+				importq.queue.pop_front();
+				importq.nPopped++;
+				nBytes  = importq.nBytes;
+				nQueued = importq.queue.size();
+				importq.cond.notify_all();
+			}
+
+			{
+				LOCK(cs_main);
+				if (ProcessBlock(NULL, &pimport->block))
+					nLoaded++;
+			}
+
+			int64_t nNow = GetTimeMillis();
+			if (nNow - nLastLog >= 10000) {
+				nLastLog         = nNow;
+				double dSeconds  = std::max((int64_t)1, nNow - nStart) * 0.001;
+				LogPrintf("Importing blocks: %d loaded, %.1f%% of %.1fMB, %.1f blocks/s, "
+				          "%.2fMB/s, %u queued\n",
+				          nLoaded, nFileSize > 0 ? nBytes * 100.0 / nFileSize : 0.0,
+				          nFileSize / 1e6, nLoaded / dSeconds, nBytes / 1e6 / dSeconds, nQueued);
 			}
-		} catch (std::exception& e) {
-			LogPrintf("%s() : Deserialize or I/O error caught during load\n", __PRETTY_FUNCTION__);
 		}
+	} catch (boost::thread_interrupted&) {
+		fnStopWorkers();
+		throw;
+	} catch (std::exception& e) {
+		LogPrintf("%s() : error caught during load: %s\n", __PRETTY_FUNCTION__, e.what());
 	}
-	LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+	fnStopWorkers();
+
+	int64_t nElapsed = std::max((int64_t)1, GetTimeMillis() - nStart);
+	LogPrintf("Loaded %i blocks from external file in %dms (%.1f blocks/s, %.2fMB/s)\n", nLoaded,
+	          nElapsed, nLoaded * 1000.0 / nElapsed, nBytes / 1e3 / nElapsed);
 	return nLoaded > 0;
 }
 
@@ -4458,10 +4930,20 @@ bool static ProcessMessage(CNode*       pfrom,
 		CInv inv(MSG_BLOCK, hashBlock);
 		pfrom->AddInventoryKnown(inv);
 
-		LOCK(cs_main);
+		// Context-free checks first, without holding cs_main; a block with
+		// a signature to be reserialized is left to ProcessBlock
+		int64_t nTimeCheck = GetTimeMicros();
+		if (IsCanonicalBlockSignature(&block) && !block.CheckBlock()) {
+			error("ProcessMessage() : CheckBlock FAILED for block %s", hashBlock.ToString());
+		} else {
+			LogPrint("bench", "ProcessMessage() : block %s checked in %.2fms before cs_main\n",
+			         hashBlock.ToString(), (GetTimeMicros() - nTimeCheck) * 0.001);
 
-		if (ProcessBlock(pfrom, &block))
-			mapAlreadyAskedFor.erase(inv);
+			LOCK(cs_main);
+
+			if (ProcessBlock(pfrom, &block))
+				mapAlreadyAskedFor.erase(inv);
+		}
 		if (block.nDoS)
 			pfrom->Misbehaving(block.nDoS);
 	}
@@ -9,15 +9,18 @@
 #include "bignum.h"
 #include "blockindexmap.h"
 #include "core.h"
+#include "crypto/sha256.h"
 #include "net.h"
 #include "peg.h"
 #include "script.h"
 #include "sync.h"
 #include "txmempool.h"
 
+#include <atomic>
 #include <boost/algorithm/string/predicate.hpp>
 #include <functional>
 #include <list>
+#include <memory>
 
 class CBlock;
 class CBlockIndex;
@@ -45,6 +48,14 @@ static const uint32_t MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS / 5;
 static const uint32_t MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE / 100;
 /** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
 static const uint32_t DEFAULT_MAX_ORPHAN_BLOCKS = 3000;
+/** Blocks with at least this many transactions are checked on worker threads */
+static const uint32_t MIN_PARALLEL_BLOCK_CHECK_TXS = 64;
+/** Default for -blockfilemaps, block files kept memory mapped for reads */
+static const uint32_t DEFAULT_BLOCKFILE_MAPS = 16;
+/** Default for -blockindexsnapshot, load the block index from a flat snapshot */
+static const bool DEFAULT_BLOCKINDEX_SNAPSHOT = true;
+/** Default for -maxmempool, maximum megabytes of memory pool usage */
+static const uint32_t DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** The maximum number of entries in an 'inv' protocol message */
 static const uint32_t MAX_INV_SZ = 50000;
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation) */
@@ -125,13 +136,23 @@ extern bool                             fHaveGUI;
 extern bool                             fAboutToSendGUI;
 
 // Settings
-extern bool fUseFastIndex;
+extern bool    fUseFastIndex;
+extern int64_t nBlockFileMaps;  // -blockfilemaps
+
+// GetHash() calls on transactions/blocks and how many of them had to hash,
+// counted only under -debug=bench to keep the shared counters off hot paths
+extern bool                  fCountHashes;
+extern std::atomic<uint64_t> nTxHashCalls;
+extern std::atomic<uint64_t> nTxHashesComputed;
+extern std::atomic<uint64_t> nBlockHashCalls;
+extern std::atomic<uint64_t> nBlockHashesComputed;
 
 // Minimum disk space required - used in CheckDiskSpace()
 static const uint64_t nMinDiskSpace = 52428800;
 
 class CReserveKey;
 class CTxDB;
+class CAddressBlockOverlay;
 class CTxIndex;
 class CWalletInterface;
 class CPegDB;
@@ -196,6 +217,120 @@ void               ThreadBrigeAuto2(CWallet* pwallet);
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction& tx, bool fLimitFree, bool* pfMissingInputs);
 
+/** Phases of ConnectBlock profiled for -debug=bench and getbenchstats */
+enum BlockBenchPhase {
+	BENCH_PEG_INDEX = 0,
+	BENCH_CONSENSUS_STATES,
+	BENCH_BRIDGE_POOLS,
+	BENCH_TX_INDEX,
+	BENCH_FETCH_INPUTS,
+	BENCH_CONNECT_INPUTS,
+	BENCH_SCRIPTS,    // part of BENCH_CONNECT_INPUTS
+	BENCH_FRACTIONS,  // part of BENCH_CONNECT_INPUTS
+	BENCH_STAKE,
+	BENCH_BLOCK_VOTES,
+	BENCH_CONNECT_UTXO,
+	BENCH_FROZEN_QUEUE,
+	BENCH_WRITE_INDEX,
+	BENCH_COMMIT,
+	BENCH_PHASE_COUNT
+};
+
+// tx GetHash calls, tx hashes computed, block GetHash calls, block hashes computed
+static const int BENCH_HASH_COUNTERS = 4;
+
+struct CBlockBenchStats {
+	int64_t  nBlocks                           = 0;
+	int      nLastHeight                       = 0;
+	int64_t  nLastBlockMicros                  = 0;
+	int64_t  nTotalBlockMicros                 = 0;
+	int64_t  nLastMicros[BENCH_PHASE_COUNT]    = {};
+	int64_t  nTotalMicros[BENCH_PHASE_COUNT]   = {};
+	uint64_t nLastHashes[BENCH_HASH_COUNTERS]  = {};
+	uint64_t nTotalHashes[BENCH_HASH_COUNTERS] = {};
+};
+
+const char*      GetBlockBenchPhaseName(int nPhase);
+CBlockBenchStats GetBlockBenchStats();
+/** Charge nMicros to a phase of the block being connected (requires cs_main) */
+void AddBlockBenchTime(int nPhase, int64_t nMicros);
+
+/** Charges elapsed time to the current phase; Switch() moves on to the next one */
+class CBlockBenchTimer {
+	int     nPhase;
+	int64_t nMark;
+
+public:
+	explicit CBlockBenchTimer(int nPhaseIn);
+	~CBlockBenchTimer() { Stop(); }
+	void Switch(int nPhaseIn);
+	void Stop();
+};
+
+/** Read-only memory map of a block file, kept alive by its readers after eviction */
+struct CBlockFileView {
+	uint32_t    nFile;
+	const char* pbegin;
+	size_t      nSize;
+
+	CBlockFileView(uint32_t nFileIn, const char* pbeginIn, size_t nSizeIn)
+	    : nFile(nFileIn), pbegin(pbeginIn), nSize(nSizeIn) {}
+	~CBlockFileView();
+	CBlockFileView(const CBlockFileView&) = delete;
+	CBlockFileView& operator=(const CBlockFileView&) = delete;
+};
+typedef std::shared_ptr<const CBlockFileView> CBlockFileViewRef;
+
+/** Mapping of block file nFile reaching past nPos from a bounded cache of
+ * -blockfilemaps files, remapped when fRefresh is set. NULL if not mappable. */
+CBlockFileViewRef GetBlockFileView(uint32_t nFile, uint64_t nPos, bool fRefresh = false);
+
+/** Deserializes objects straight from a mapped block file */
+class CBlockFileReader {
+	CBlockFileViewRef view;
+	size_t            nReadPos;
+
+public:
+	int nType;
+	int nVersion;
+
+	CBlockFileReader(const CBlockFileViewRef& viewIn, size_t nPosIn, int nTypeIn, int nVersionIn)
+	    : view(viewIn), nReadPos(nPosIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+	CBlockFileReader& read(char* pch, size_t nSize) {
+		if (nReadPos > view->nSize || nSize > view->nSize - nReadPos)
+			throw std::ios_base::failure("CBlockFileReader::read : end of file");
+		memcpy(pch, view->pbegin + nReadPos, nSize);
+		nReadPos += nSize;
+		return (*this);
+	}
+
+	template <typename T>
+	CBlockFileReader& operator>>(T& obj) {
+		::Unserialize(*this, obj, nType, nVersion);
+		return (*this);
+	}
+};
+
+/** Reads obj at nPos of block file nFile through its mapping; false when the
+ * file can not be mapped and stdio has to be used, errors are thrown */
+template <typename T>
+bool ReadFromBlockFileView(uint32_t nFile, uint32_t nPos, int nType, T& obj) {
+	CBlockFileViewRef view = GetBlockFileView(nFile, nPos);
+	if (!view)
+		return false;
+	try {
+		CBlockFileReader(view, nPos, nType, CLIENT_VERSION) >> obj;
+	} catch (std::ios_base::failure& e) {
+		// the file may have grown since it was mapped
+		view = GetBlockFileView(nFile, nPos, true /*fRefresh*/);
+		if (!view)
+			return false;
+		CBlockFileReader(view, nPos, nType, CLIENT_VERSION) >> obj;
+	}
+	return true;
+}
+
 /** Position on disk for a particular transaction. */
 class CDiskTxPos {
 public:
@@ -265,6 +400,11 @@ public:
 	std::vector<CTxOut> vout;
 	uint32_t            nLockTime;
 
+	// memory only: hash of a transaction read from disk or network,
+	// ClearHashCache() has to be called before modifying such a transaction
+	uint256 hashCache;
+	bool    fHashCached;
+
 	// Denial-of-service detection:
 	mutable int nDoS;
 	bool        DoS(int nDoSIn, bool fIn) const {
@@ -285,12 +425,14 @@ public:
 	      vin(vin),
 	      vout(vout),
 	      nLockTime(nLockTime),
+	      fHashCached(false),
 	      nDoS(0) {}
 
 	IMPLEMENT_SERIALIZE(READWRITE(this->nVersion); nVersion = this->nVersion; READWRITE(nTime);
 	                    READWRITE(vin);
 	                    READWRITE(vout);
-	                    READWRITE(nLockTime);)
+	                    READWRITE(nLockTime);
+	                    if (fRead) const_cast<CTransaction*>(this)->CacheHash();)
 
 	void SetNull() {
 		nVersion     = CTransaction::CURRENT_VERSION;
@@ -298,13 +440,31 @@ public:
 		nTimeFetched = 0;
 		vin.clear();
 		vout.clear();
-		nLockTime = 0;
-		nDoS      = 0;  // Denial-of-service prevention
+		nLockTime   = 0;
+		fHashCached = false;
+		nDoS        = 0;  // Denial-of-service prevention
 	}
 
 	bool IsNull() const { return (vin.empty() && vout.empty()); }
 
-	uint256 GetHash() const { return SerializeHash(*this); }
+	uint256 GetHash() const {
+		if (fCountHashes)
+			nTxHashCalls.fetch_add(1, std::memory_order_relaxed);
+		if (fHashCached)
+			return hashCache;
+		if (fCountHashes)
+			nTxHashesComputed.fetch_add(1, std::memory_order_relaxed);
+		return SerializeHash(*this);
+	}
+
+	// hashed once when deserialized, so the cache is never written by const
+	// methods and the transaction can be shared between threads
+	void CacheHash() {
+		fHashCached = false;
+		hashCache   = GetHash();
+		fHashCached = true;
+	}
+	void ClearHashCache() { fHashCached = false; }
 
 	bool IsCoinBase() const {
 		return (vin.size() == 1 && vin[0].prevout.IsNull() && vout.size() >= 1);
@@ -393,6 +553,15 @@ public:
 	int64_t GetValueIn(const MapPrevTx& mapInputs) const;
 
 	bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet = NULL) {
+		if (!pfileRet) {
+			try {
+				if (ReadFromBlockFileView(pos.nFile, pos.nTxPos, SER_DISK, *this))
+					return true;
+			} catch (std::exception& e) {
+				return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+			}
+		}
+
 		CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK,
 		                             CLIENT_VERSION);
 		if (!filein)
@@ -500,12 +669,13 @@ public:
 
 	bool IsExchangeTx(int& nOut, uint256& id) const;
 
-	bool ConnectUtxo(CTxDB&             txdb,
-	                 const CBlockIndex* pindex,
-	                 int16_t            nTxIdx,
-	                 MapPrevTx&         mapInputs,
-	                 MapFractions&      mapInputsFractions,
-	                 MapFractions&      mapOutputsFractions) const;
+	bool ConnectUtxo(CTxDB&                txdb,
+	                 CAddressBlockOverlay& overlay,
+	                 const CBlockIndex*    pindex,
+	                 int16_t               nTxIdx,
+	                 MapPrevTx&            mapInputs,
+	                 MapFractions&         mapInputsFractions,
+	                 MapFractions&         mapOutputsFractions) const;
 	bool DisconnectUtxo(CTxDB&        txdb,
 	                    CPegDB&       pegdb,
 	                    MapPrevTx&    mapInputs,
@@ -782,6 +952,12 @@ public:
 
 	// memory only
 	mutable std::vector<uint256> vMerkleTree;
+	mutable bool                 fChecked;  // passed full CheckBlock
+	// hash of a header read from disk or network, computed on first use (blocks
+	// are not shared between threads); ClearHashCache() before modifying it
+	mutable uint256 hashCache;
+	mutable bool    fHashCached;
+	bool            fHashCacheable;
 
 	// Denial-of-service detection:
 	mutable int nDoS;
@@ -806,6 +982,11 @@ public:
 	    } else if (fRead) {
 		    const_cast<CBlock*>(this)->vtx.clear();
 		    const_cast<CBlock*>(this)->vchBlockSig.clear();
+	    }
+	    if (fRead) {
+		    const_cast<CBlock*>(this)->fChecked       = false;
+		    const_cast<CBlock*>(this)->fHashCached    = false;
+		    const_cast<CBlock*>(this)->fHashCacheable = true;
 	    })
 
 	void SetNull() {
@@ -818,24 +999,46 @@ public:
 		vtx.clear();
 		vchBlockSig.clear();
 		vMerkleTree.clear();
-		nDoS = 0;
+		fChecked       = false;
+		fHashCached    = false;
+		fHashCacheable = false;
+		nDoS           = 0;
 	}
 
 	bool IsNull() const { return (nBits == 0); }
 
 	uint256 GetHash() const {
+		if (fCountHashes)
+			nBlockHashCalls.fetch_add(1, std::memory_order_relaxed);
+		if (fHashCached)
+			return hashCache;
+		if (fCountHashes)
+			nBlockHashesComputed.fetch_add(1, std::memory_order_relaxed);
+		uint256 hash;
 		if (nVersion > 6)
-			return Hash(BEGIN(nVersion), END(nNonce));
+			hash = Hash(BEGIN(nVersion), END(nNonce));
 		else
-			return GetPoWHash();
+			scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(hash));
+		if (fHashCacheable) {
+			hashCache   = hash;
+			fHashCached = true;
+		}
+		return hash;
 	}
 
 	uint256 GetPoWHash() const {
+		if (nVersion <= 6)
+			return GetHash();  // the same scrypt hash, maybe cached
 		uint256 thash;
 		scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
 		return thash;
 	}
 
+	void ClearHashCache() {
+		fHashCached    = false;
+		fHashCacheable = false;
+	}
+
 	int64_t GetBlockTime() const { return (int64_t)nTime; }
 
 	void UpdateTime(const CBlockIndex* pindexPrev);
@@ -871,16 +1074,30 @@ public:
 	}
 
 	uint256 BuildMerkleTree() const {
-		vMerkleTree.clear();
+		std::vector<uint256> vTxHashes;
+		vTxHashes.reserve(vtx.size());
 		for (const CTransaction& tx : vtx) {
-			vMerkleTree.push_back(tx.GetHash());
+			vTxHashes.push_back(tx.GetHash());
 		}
-		int j = 0;
-		for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2) {
-			for (int i = 0; i < nSize; i += 2) {
-				int i2 = std::min(i + 1, nSize - 1);
-				vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j + i]), END(vMerkleTree[j + i]),
-				                           BEGIN(vMerkleTree[j + i2]), END(vMerkleTree[j + i2])));
+		return BuildMerkleTree(vTxHashes);
+	}
+
+	// same with the transaction hashes already computed
+	uint256 BuildMerkleTree(const std::vector<uint256>& vTxHashes) const {
+		vMerkleTree = vTxHashes;
+		int j       = 0;
+		for (int nSize = vTxHashes.size(); nSize > 1; nSize = (nSize + 1) / 2) {
+			// sibling pairs of a level are adjacent, so the whole level is one batch
+			// of 64 byte inputs, with the odd last hash paired with itself
+			int nPairs = nSize / 2;
+			int nLevel = (nSize + 1) / 2;
+			vMerkleTree.resize(j + nSize + nLevel);
+			SHA256D64(vMerkleTree[j + nSize].begin(), vMerkleTree[j].begin(), nPairs);
+			if (nSize & 1) {
+				unsigned char pair[64];
+				memcpy(pair, vMerkleTree[j + nSize - 1].begin(), 32);
+				memcpy(pair + 32, vMerkleTree[j + nSize - 1].begin(), 32);
+				SHA256D64(vMerkleTree[j + nSize + nPairs].begin(), pair, 1);
 			}
 			j += nSize;
 		}
@@ -944,17 +1161,19 @@ public:
 	bool ReadFromDisk(uint32_t nFile, uint32_t nBlockPos, bool fReadTransactions = true) {
 		SetNull();
 
-		// Open history file to read
-		CAutoFile filein =
-		    CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-		if (!filein)
-			return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+		int nType = SER_DISK;
 		if (!fReadTransactions)
-			filein.nType |= SER_BLOCKHEADERONLY;
+			nType |= SER_BLOCKHEADERONLY;
 
-		// Read block
+		// Read block, from the mapped file when possible
 		try {
-			filein >> *this;
+			if (!ReadFromBlockFileView(nFile, nBlockPos, nType, *this)) {
+				CAutoFile filein =
+				    CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), nType, CLIENT_VERSION);
+				if (!filein)
+					return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+				filein >> *this;
+			}
 		} catch (std::exception& e) {
 			return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
 		}
@@ -988,17 +1207,21 @@ public:
 	bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions = true);
 	bool SetBestChain(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindexNew);
 	bool AddToBlockIndex(uint32_t nFile, uint32_t nBlockPos, const uint256& hashProof);
+	// fParallel: large blocks may use the block check workers, off for
+	// callers already checking several blocks side by side
 	bool CheckBlock(bool fCheckPOW        = true,
 	                bool fCheckMerkleRoot = true,
-	                bool fCheckSig        = true) const;
+	                bool fCheckSig        = true,
+	                bool fParallel        = true) const;
 	bool AcceptBlock();
 	bool SignBlock(CWallet& keystore, int64_t nFees);
 	bool CheckBlockSignature() const;
-	bool ProcessFrozenQueue(CTxDB&             txdb,
-	                        CPegDB&            pegdb,
-	                        MapFractions&      mapFractions,
-	                        const CBlockIndex* pindex,
-	                        bool               fLoading);
+	bool ProcessFrozenQueue(CTxDB&                txdb,
+	                        CPegDB&               pegdb,
+	                        CAddressBlockOverlay& overlay,
+	                        MapFractions&         mapFractions,
+	                        const CBlockIndex*    pindex,
+	                        bool                  fLoading);
 
 private:
 	bool SetBestChainInner(CTxDB& txdb, CPegDB& pegdb, CBlockIndex* pindexNew);
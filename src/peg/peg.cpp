@@ -11,6 +11,7 @@
 #include <fstream>
 #include <map>
 #include <set>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
@@ -50,53 +51,38 @@ bool fPegIsActivatedViaTx = false;
 
 static string sBurnAddress = "bJnV8J5v74MGctMyVSVPfGu1mGQ9nMTiB3";
 
-extern leveldb::DB* txdb;  // global pointer for LevelDB object instance
-
 bool SetBlocksIndexesReadyForPeg(CTxDB& ctxdb, LoadMsg load_msg) {
-	leveldb::Iterator* iterator = txdb->NewIterator(leveldb::ReadOptions());
-	// Seek to start key.
-	CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-	ssStartKey << make_pair(string("blockindex"), uint256(0));
-	iterator->Seek(ssStartKey.str());
-	// Now read each entry.
-	int indexCount = 0;
-	while (iterator->Valid()) {
-		boost::this_thread::interruption_point();
-		// Unpack keys and values.
-		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-		ssKey.write(iterator->key().data(), iterator->key().size());
-		CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-		ssValue.write(iterator->value().data(), iterator->value().size());
-		string strType;
-		ssKey >> strType;
-		// Did we reach the end of the data to read?
-		if (strType != "blockindex")
-			break;
+	// disk records are rewritten in resumable chunks, hash is from the key
+	IndexMigrationFn fn = [](CTxDB& txdb, const uint256& blockHash, CDataStream& ssValue) {
 		CDiskBlockIndex diskindex;
 		ssValue >> diskindex;
 
-		uint256                              blockHash = diskindex.GetBlockHash();
-        unordered_map<uint256, CBlockIndex*>::iterator mi        = mapBlockIndex.find(blockHash);
+		unordered_map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(blockHash);
 		if (mi == mapBlockIndex.end()) {
 			return error("SetBlocksIndexesReadyForPeg() : mapBlockIndex failed");
 		}
-		CBlockIndex* pindexNew = (*mi).second;
-
-		pindexNew->SetPeg(pindexNew->nHeight >= nPegStartHeight);
-		diskindex.SetPeg(pindexNew->nHeight >= nPegStartHeight);
-		ctxdb.WriteBlockIndex(diskindex);
-
-		iterator->Next();
-
-		indexCount++;
-		if (indexCount % 10000 == 0) {
-			load_msg(std::string(" update block indexes for peg: ") + std::to_string(indexCount));
-		}
+		CBlockIndex* pindex = (*mi).second;
+
+		diskindex.SetPeg(pindex->nHeight >= nPegStartHeight);
+		return txdb.WriteBlockIndex(blockHash, diskindex);
+	};
+	if (!ctxdb.MigrateIndex("blockindex", "blockindexpeg", " update block indexes for peg: ",
+	                        fn, load_msg))
+		return error("SetBlocksIndexesReadyForPeg() : MigrateIndex failed");
+
+	// in memory index, also for records migrated before a restart
+	for (const auto& item : mapBlockIndex) {
+		CBlockIndex* pindex = item.second;
+		pindex->SetPeg(pindex->nHeight >= nPegStartHeight);
 	}
-	delete iterator;
 
+	if (!ctxdb.TxnBegin())
+		return error("SetBlocksIndexesReadyForPeg() : TxnBegin failed");
 	if (!ctxdb.WriteBlockIndexIsPegReady(true))
 		return error("SetBlocksIndexesReadyForPeg() : flag write failed");
+	ctxdb.EraseIndexMigration("blockindexpeg");
+	if (!ctxdb.TxnCommit())
+		return error("SetBlocksIndexesReadyForPeg() : TxnCommit failed");
 
 	return true;
 }
@@ -255,11 +241,8 @@ int CBlockIndex::ComputeNextPegSupplyIndex(int                nPegBase,
 int CalculatePegVotes(const CFractions& fractions, int nPegSupplyIndex) {
 	int nVotes = 1;
 
-	int64_t nReserveWeight = 0;
-	int64_t nLiquidWeight  = 0;
-
-	fractions.LowPart(nPegSupplyIndex, &nReserveWeight);
-	fractions.HighPart(nPegSupplyIndex, &nLiquidWeight);
+	int64_t nReserveWeight = fractions.Low(nPegSupplyIndex);
+	int64_t nLiquidWeight  = fractions.High(nPegSupplyIndex);
 
 	if (nLiquidWeight > INT_LEAST64_MAX / (nPegSupplyIndex + 2)) {
 		// check for rare extreme case when user stake more than about 100M coins
@@ -285,6 +268,42 @@ int CalculatePegVotes(const CFractions& fractions, int nPegSupplyIndex) {
 	return nVotes;
 }
 
+// The vote addresses are decoded once per network and block outputs are
+// matched by destination (hash160), not by base58 encoding every output.
+struct CPegVoteDestinations {
+	CTxDestination inflate;
+	CTxDestination deflate;
+	CTxDestination nochange;
+};
+
+static CPegVoteDestinations GetPegVoteDestinations() {
+	static CCriticalSection     cs_pegvotes;
+	static const CChainParams*  pParams = nullptr;
+	static CPegVoteDestinations dests;
+
+	LOCK(cs_pegvotes);
+	if (pParams != &Params()) {
+		pParams        = &Params();
+		dests.inflate  = CBitcoinAddress(Params().PegInflateAddr()).Get();
+		dests.deflate  = CBitcoinAddress(Params().PegDeflateAddr()).Get();
+		dests.nochange = CBitcoinAddress(Params().PegNochangeAddr()).Get();
+	}
+	return dests;
+}
+
+static PegVoteType GetPegVoteType(const CTxDestination&       addr,
+                                  const CPegVoteDestinations& dests) {
+	if (boost::get<CNoDestination>(&addr))
+		return PEG_VOTE_NONE;
+	if (addr == dests.inflate)
+		return PEG_VOTE_INFLATE;
+	if (addr == dests.deflate)
+		return PEG_VOTE_DEFLATE;
+	if (addr == dests.nochange)
+		return PEG_VOTE_NOCHANGE;
+	return PEG_VOTE_NONE;
+}
+
 bool CalculateBlockPegVotes(const CBlock& cblock,
                             CBlockIndex*  pindex,
                             CTxDB&        txdb,
@@ -348,6 +367,7 @@ bool CalculateBlockPegVotes(const CBlock& cblock,
 		break;
 	}
 
+	const CPegVoteDestinations dests = GetPegVoteDestinations();
 	for (const CTxOut& out : tx.vout) {
 		const CScript& scriptPubKey = out.scriptPubKey;
 
@@ -361,16 +381,16 @@ bool CalculateBlockPegVotes(const CBlock& cblock,
 
 		bool voted = false;
 		for (const CTxDestination& addr : addresses) {
-			std::string str_addr = CBitcoinAddress(addr).ToString();
-			if (str_addr == Params().PegInflateAddr()) {
+			PegVoteType vote = GetPegVoteType(addr, dests);
+			if (vote == PEG_VOTE_INFLATE) {
 				pindex->nPegVotesInflate += nVotes;
 				voted = true;
 				break;
-			} else if (str_addr == Params().PegDeflateAddr()) {
+			} else if (vote == PEG_VOTE_DEFLATE) {
 				pindex->nPegVotesDeflate += nVotes;
 				voted = true;
 				break;
-			} else if (str_addr == Params().PegNochangeAddr()) {
+			} else if (vote == PEG_VOTE_NOCHANGE) {
 				pindex->nPegVotesNochange += nVotes;
 				voted = true;
 				break;
@@ -384,15 +404,15 @@ bool CalculateBlockPegVotes(const CBlock& cblock,
 	return true;
 }
 
-bool CalculateStandardFractions(const CTransaction& tx,
-                                int                 nSupply,
-                                uint32_t            nBlockTime,
-                                MapPrevTx&          mapTxInputs,
-                                MapFractions&       mapInputsFractions,
-                                set<uint32_t>       setTimeLockPass,
-                                MapFractions&       mapTestFractionsPool,
-                                CFractions&         feesFractions,
-                                std::string&        sFailCause) {
+bool CalculateStandardFractions(const CTransaction&  tx,
+                                int                  nSupply,
+                                uint32_t             nBlockTime,
+                                MapPrevTx&           mapTxInputs,
+                                MapFractions&        mapInputsFractions,
+                                const set<uint32_t>& setTimeLockPass,
+                                MapFractions&        mapTestFractionsPool,
+                                CFractions&          feesFractions,
+                                std::string&         sFailCause) {
 	MapPrevOut mapInputs;
 	size_t     n_vin = tx.vin.size();
 
@@ -472,13 +492,13 @@ bool CalculateCoinMintFractions(const CTransaction&                tx,
 		if (i == 1) {
 			frInpLeaf = frInp;  // requested, skip
 
-			CBitcoinAddress addr_dest;
-			vector<int64_t> sections;
-			int             section_peg = 0;
-			int             nonce       = 0;
-			string          from;
-			string          leaf;
-			vector<string>  proofs;
+			CBitcoinAddress       addr_dest;
+			vector<int64_t>       sections;
+			int                   section_peg = 0;
+			int                   nonce       = 0;
+			vector<unsigned char> from;
+			MerkleHash            leaf;
+			vector<MerkleHash>    proofs;
 
 			if (!DecodeAndValidateMintSigScript(tx.vin[1].scriptSig, addr_dest, sections,
 			                                    section_peg, nonce, from, leaf, proofs)) {
@@ -491,15 +511,15 @@ bool CalculateCoinMintFractions(const CTransaction&                tx,
 
 			string merkle_root;
 			{
-				string out_root_hex;
-				if (!ComputeMintMerkleRoot(leaf, proofs, out_root_hex)) {
+				MerkleHash out_root;
+				if (!ComputeMintMerkleRoot(leaf, proofs, out_root)) {
 					std::stringstream ss;
 					ss << "P-MI-6: CoinMint ComputeMintMerkleRoot err "
 					   << tx.vin[1].scriptSig.ToString();
 					sFailCause = ss.str();
 					return false;
 				}
-				merkle_root = out_root_hex;
+				merkle_root = HexStr(out_root.begin(), out_root.end());
 			}
 
 			const CMerkleInfo merkle = fnMerkleIn(merkle_root);
@@ -885,13 +905,13 @@ bool CalculateStakingFractions_v2(const CTransaction&          tx,
 	return true;
 }
 
-void PrunePegForBlock(const CBlock& blockprune, CPegDB& pegdb) {
+void CollectPegPruneKeys(const CBlock& blockprune, std::vector<uint320>& vKeys) {
+	const CPegVoteDestinations dests = GetPegVoteDestinations();
 	for (size_t i = 0; i < blockprune.vtx.size(); i++) {
 		const CTransaction& tx = blockprune.vtx[i];
 		for (size_t j = 0; j < tx.vin.size(); j++) {
 			COutPoint prevout = tx.vin[j].prevout;
-			auto      fkey    = uint320(prevout.hash, prevout.n);
-			pegdb.Erase(fkey);
+			vKeys.push_back(uint320(prevout.hash, prevout.n));
 		}
 		if (!tx.IsCoinStake())
 			continue;
@@ -900,10 +920,10 @@ void PrunePegForBlock(const CBlock& blockprune, CPegDB& pegdb) {
 		for (size_t j = 0; j < tx.vout.size(); j++) {
 			auto fkey = uint320(txhash, j);
 
-			CTxOut out = tx.vout[j];
+			const CTxOut& out = tx.vout[j];
 
 			if (out.nValue == 0) {
-				pegdb.Erase(fkey);
+				vKeys.push_back(fkey);
 				continue;
 			}
 
@@ -915,7 +935,7 @@ void PrunePegForBlock(const CBlock& blockprune, CPegDB& pegdb) {
 			if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
 				string notary;
 				if (scriptPubKey.ToNotary(notary)) {
-					pegdb.Erase(fkey);
+					vKeys.push_back(fkey);
 					continue;
 				}
 				continue;
@@ -923,18 +943,166 @@ void PrunePegForBlock(const CBlock& blockprune, CPegDB& pegdb) {
 
 			bool voted = false;
 			for (const CTxDestination& addr : addresses) {
-				std::string str_addr = CBitcoinAddress(addr).ToString();
-				if (str_addr == Params().PegInflateAddr()) {
-					voted = true;
-				} else if (str_addr == Params().PegDeflateAddr()) {
-					voted = true;
-				} else if (str_addr == Params().PegNochangeAddr()) {
+				if (GetPegVoteType(addr, dests) != PEG_VOTE_NONE) {
 					voted = true;
 				}
 			}
 			if (voted) {
-				pegdb.Erase(fkey);
+				vKeys.push_back(fkey);
+			}
+		}
+	}
+}
+
+void PrunePegForBlock(const CBlock& blockprune, CPegDB& pegdb) {
+	vector<uint320> vKeys;
+	CollectPegPruneKeys(blockprune, vKeys);
+	for (const uint320& fkey : vKeys) {
+		pegdb.Erase(fkey);
+	}
+}
+
+static CCriticalSection cs_pegprune;
+static CPegPruneInfo    pegPruneInfo;
+
+CPegPruneInfo GetPegPruneInfo() {
+	LOCK(cs_pegprune);
+	return pegPruneInfo;
+}
+
+// Key range erased since the last compaction, keys are serialized the same
+// way as CPegDB does (leveldb orders them bytewise).
+struct CPegPruneRange {
+	std::string sFirst;
+	std::string sLast;
+	int64_t     nKeys = 0;
+
+	void Add(const uint320& fkey) {
+		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+		ssKey << fkey;
+		std::string sKey = ssKey.str();
+		if (nKeys == 0 || sKey < sFirst)
+			sFirst = sKey;
+		if (nKeys == 0 || sKey > sLast)
+			sLast = sKey;
+		nKeys++;
+	}
+};
+
+// Prunes up to nMaxBlocks blocks behind the prune window in one pegdb batch.
+// Returns the number of pruned blocks, 0 when nothing to do or the chain is
+// busy (cs_main is not waited for), -1 on failure.
+static int PrunePegBatch(int nMaxBlocks, CPegPruneRange& range) {
+	CPegDB pegdb("r+");
+
+	bool fEnabled = true;
+	if (!pegdb.ReadPegPruneEnabled(fEnabled)) {
+		fEnabled = true;
+	}
+	int  nPrunedHeight = -1;
+	bool fHasPruned    = pegdb.ReadPegPrunedHeight(nPrunedHeight);
+
+	int                                         nTargetHeight = -1;
+	vector<std::tuple<int, uint32_t, uint32_t>> vBlocks;  // height, file, pos
+	{
+		TRY_LOCK(cs_main, lockMain);
+		if (!lockMain)
+			return 0;
+		nTargetHeight = nBestHeight - PEG_PRUNE_INTERVAL;
+		if (!fHasPruned) {
+			// blocks behind the window were pruned while connecting
+			nPrunedHeight = nTargetHeight;
+		}
+		int nHeight = std::max(nPrunedHeight + 1, std::max(nPegStartHeight, 1));
+		if (fEnabled && fHasPruned && nHeight <= nTargetHeight) {
+			CBlockIndex* pindex = FindBlockByHeight(nHeight);
+			while (pindex && pindex->nHeight <= nTargetHeight &&
+			       int(vBlocks.size()) < nMaxBlocks) {
+				vBlocks.push_back(
+				    std::make_tuple(pindex->nHeight, pindex->nFile, pindex->nBlockPos));
+				pindex = pindex->Next();
 			}
 		}
 	}
+
+	{
+		LOCK(cs_pegprune);
+		pegPruneInfo.fEnabled      = fEnabled;
+		pegPruneInfo.nPrunedHeight = nPrunedHeight;
+		pegPruneInfo.nTargetHeight = nTargetHeight;
+	}
+
+	if (!fEnabled)
+		return 0;
+	if (!fHasPruned) {
+		if (!pegdb.WritePegPrunedHeight(nPrunedHeight))
+			return -1;
+		return 0;
+	}
+	if (vBlocks.empty())
+		return 0;
+
+	if (!pegdb.TxnBegin())
+		return -1;
+	int64_t nErased = 0;
+	for (const auto& item : vBlocks) {
+		CBlock block;
+		if (!block.ReadFromDisk(std::get<1>(item), std::get<2>(item), true /*vtx*/)) {
+			pegdb.TxnAbort();
+			error("PrunePegBatch() : ReadFromDisk failed for block %d", std::get<0>(item));
+			return -1;
+		}
+		vector<uint320> vKeys;
+		CollectPegPruneKeys(block, vKeys);
+		for (const uint320& fkey : vKeys) {
+			pegdb.Erase(fkey);
+			range.Add(fkey);
+		}
+		nErased += vKeys.size();
+		nPrunedHeight = std::get<0>(item);
+	}
+	if (!pegdb.WritePegPrunedHeight(nPrunedHeight) || !pegdb.TxnCommit()) {
+		pegdb.TxnAbort();
+		return -1;
+	}
+
+	{
+		LOCK(cs_pegprune);
+		pegPruneInfo.nPrunedHeight = nPrunedHeight;
+		pegPruneInfo.nErasedKeys += nErased;
+	}
+	LogPrint("pegprune", "PrunePegBatch() : pruned %d blocks through %d, %d keys\n",
+	         vBlocks.size(), nPrunedHeight, nErased);
+	return vBlocks.size();
+}
+
+void ThreadPegPrune() {
+	SetThreadPriority(THREAD_PRIORITY_LOWEST);
+	RenameThread("bitbay-pegprune");
+
+	int            nBatchBlocks  = std::max(1, int(GetArg("-pegprunebatch", 100)));
+	int64_t        nBatchPause   = std::max(int64_t(0), GetArg("-pegprunepause", 200));
+	int64_t        nCompactAfter = std::max(int64_t(1), GetArg("-pegprunecompact", 200000));
+	CPegPruneRange range;
+
+	while (true) {
+		int nPruned = PrunePegBatch(nBatchBlocks, range);
+
+		if (range.nKeys >= nCompactAfter) {
+			int64_t nStart = GetTimeMillis();
+			CPegDB  pegdb("r");
+			pegdb.CompactRange(range.sFirst, range.sLast);
+			LogPrint("pegprune", "ThreadPegPrune() : compacted %d erased keys in %dms\n",
+			         range.nKeys, GetTimeMillis() - nStart);
+			range = CPegPruneRange();
+
+			LOCK(cs_pegprune);
+			pegPruneInfo.nCompactions++;
+			pegPruneInfo.nLastCompactTime = GetTime();
+		}
+
+		// full batch means more is pending: continue after a short pause,
+		// otherwise wait for new blocks
+		MilliSleep(nPruned >= nBatchBlocks ? nBatchPause : 10000);
+	}
 }
@@ -5,6 +5,7 @@
 #ifndef BITBAY_PEG_H
 #define BITBAY_PEG_H
 
+#include <array>
 #include <functional>
 #include <list>
 #include <set>
@@ -26,6 +27,7 @@ class CFractions;
 class CBitcoinAddress;
 typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 typedef std::map<uint320, CTxOut>                             MapPrevOut;
+typedef std::array<uint8_t, 32>                               MerkleHash;
 
 extern int  nPegStartHeight;
 extern int  nPegMaxSupplyIndex;
@@ -43,15 +45,15 @@ bool CalculateBlockPegVotes(const CBlock& cblock,
                             std::string&  staker_addr);
 int  CalculatePegVotes(const CFractions& fractions, int nPegSupplyIndex);
 
-bool CalculateStandardFractions(const CTransaction& tx,
-                                int                 nSupply,
-                                uint32_t            nBlockTime,
-                                MapPrevTx&          inputs,
-                                MapFractions&       finputs,
-                                std::set<uint32_t>  setTimeLockPass,
-                                MapFractions&       mapTestFractionsPool,
-                                CFractions&         feesFractions,
-                                std::string&        sPegFailCause);
+bool CalculateStandardFractions(const CTransaction&       tx,
+                                int                       nSupply,
+                                uint32_t                  nBlockTime,
+                                MapPrevTx&                inputs,
+                                MapFractions&             finputs,
+                                const std::set<uint32_t>& setTimeLockPass,
+                                MapFractions&             mapTestFractionsPool,
+                                CFractions&               feesFractions,
+                                std::string&              sPegFailCause);
 
 bool CalculateCoinMintFractions(const CTransaction&                      tx,
                                 int                                      nSupply,
@@ -75,8 +77,22 @@ bool CalculateStakingFractions(const CTransaction&          tx,
                                int64_t                      nCalculatedStakeRewardWithoutFees,
                                std::string&                 sPegFailCause);
 
+void CollectPegPruneKeys(const CBlock&, std::vector<uint320>& vKeys);
 void PrunePegForBlock(const CBlock&, CPegDB&);
 
+// Spent fractions older than PEG_PRUNE_INTERVAL are pruned by a background
+// thread in batches, tracking the pruned-through height in pegdb.
+struct CPegPruneInfo {
+	bool    fEnabled         = true;
+	int     nPrunedHeight    = -1;
+	int     nTargetHeight    = -1;
+	int64_t nErasedKeys      = 0;
+	int64_t nCompactions     = 0;
+	int64_t nLastCompactTime = 0;
+};
+CPegPruneInfo GetPegPruneInfo();
+void          ThreadPegPrune();
+
 // bridge
 
 bool ConnectConsensusStates(CPegDB& pegdb, CBlockIndex* pindex);
@@ -103,13 +119,45 @@ bool ComputeMintMerkleLeaf(const std::string&   dest_addr_str,
 bool ComputeMintMerkleRoot(const std::string&       inp_leaf_hex,
                            std::vector<std::string> proofs,
                            std::string&             out_root_hex);
-bool DecodeAndValidateMintSigScript(const CScript&            sigScript,
-                                    CBitcoinAddress&          addr_dest,
-                                    std::vector<int64_t>&     sections,
-                                    int&                      section_peg,
-                                    int&                      nonce,
-                                    std::string&              from,
-                                    std::string&              leaf,
-                                    std::vector<std::string>& proofs);
+
+// binary variants, no hex round trips: used by consensus paths
+bool ComputeMintMerkleLeaf(const std::string&                dest_addr_str,
+                           const std::vector<int64_t>&       sections,
+                           int                               section_peg,
+                           int                               nonce,
+                           const std::vector<unsigned char>& from,
+                           MerkleHash&                       out_leaf);
+bool ComputeMintMerkleRoot(const MerkleHash&              leaf,
+                           const std::vector<MerkleHash>& proofs,
+                           MerkleHash&                    out_root);
+bool ComputeBurnMerkleLeaf(const std::string&          dest_addr_str,
+                           const CCompressedFractions& fractions,
+                           const std::string&          txoutid,
+                           MerkleHash&                 out_leaf);
+// Bridge cycle merkle tree, hashed level by level into reused level
+// buffers. Same shape and hashes as merkle::TreeT<32, sha256_keccak>:
+// sorted pairs are keccak256 hashed, an odd last node is promoted as is.
+class CMerkleBatchTree {
+public:
+	void              Build(const std::vector<MerkleHash>& leaves);
+	const MerkleHash& Root() const;
+	// siblings from the leaf up to the root, as merklecpp path elements
+	void   Path(size_t index, std::vector<MerkleHash>& proofs) const;
+	size_t Size() const { return nLeaves; }
+
+private:
+	std::vector<std::vector<MerkleHash>> vLevels;
+	size_t                               nLeaves = 0;
+	size_t                               nHeight = 0;
+};
+
+bool DecodeAndValidateMintSigScript(const CScript&              sigScript,
+                                    CBitcoinAddress&            addr_dest,
+                                    std::vector<int64_t>&       sections,
+                                    int&                        section_peg,
+                                    int&                        nonce,
+                                    std::vector<unsigned char>& from,
+                                    MerkleHash&                 leaf,
+                                    std::vector<MerkleHash>&    proofs);
 
 #endif
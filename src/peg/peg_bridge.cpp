@@ -46,37 +46,24 @@
 #include <ethc/hex.h>
 #include <ethc/keccak256.h>
 
-// #define MERKLECPP_TRACE_ENABLED 1
-#include "merklecpp/merklecpp.h"
+extern "C" {
+#include <KeccakP-1600-SnP.h>
+}
 
 using namespace std;
 using namespace boost;
 
-static inline bool sha256_keccak_cmp_lt(const uint8_t a[32], const uint8_t b[32]) {
-	for (int i = 0; i < 32; i++) {
-		if (a[i] < b[i])
-			return true;
-		if (a[i] > b[i])
-			return false;
-	}
-	return false;
-}
-
-static inline void sha256_keccak(const merkle::HashT<32>& l,
-                                 const merkle::HashT<32>& r,
-                                 merkle::HashT<32>&       out,
-                                 bool&                    swap) {
-	swap = false;
-	uint8_t block[32 * 2];
-	if (sha256_keccak_cmp_lt(l.bytes, r.bytes)) {
-		memcpy(&block[0], l.bytes, 32);
-		memcpy(&block[32], r.bytes, 32);
-	} else {
-		memcpy(&block[0], r.bytes, 32);
-		memcpy(&block[32], l.bytes, 32);
-		swap = true;
-	}
-	eth_keccak256(out.bytes, block, 32 * 2);
+// keccak256 of two hashes, the 64 bytes fit one rate block so the sponge
+// is skipped: absorb, pad, single permutation
+static inline void keccak256_pair(const uint8_t a[32], const uint8_t b[32], uint8_t out[32]) {
+	uint64_t state[25];
+	KeccakP1600_Initialize(state);
+	KeccakP1600_AddBytes(state, a, 0, 32);
+	KeccakP1600_AddBytes(state, b, 32, 32);
+	KeccakP1600_AddByte(state, 0x01, 64);
+	KeccakP1600_AddByte(state, 0x80, 136 - 1);
+	KeccakP1600_Permute_24rounds(state);
+	KeccakP1600_ExtractBytes(state, out, 0, 32);
 }
 
 int CBlockIndex::BridgeCycle() const {
@@ -762,8 +749,8 @@ bool ConnectBridgeCycleBurns(CPegDB&       pegdb,
 	set<string>                 bridge_hashes;
 
 	// get fractions of pools
-	map<string, CFractions>  bridges_burn_fractions;
-	map<string, set<string>> bridge_cycle_burn_txouts;
+	map<string, CFractions>              bridges_burn_fractions;
+	map<string, map<string, MerkleHash>> bridge_cycle_burn_txouts;
 
 	// get list of Z burns over bridge interval
 	CBlockIndex* pindex_in_bridge_cycle = bridge_cycle_block;
@@ -840,47 +827,11 @@ bool ConnectBridgeCycleBurns(CPegDB&       pegdb,
 				// can calculate the leaf
 				CCompressedFractions fc1(fractions, section, pegsteps, microsteps);
 
-				char* addr_cstr = new char[dstaddr_str.length() + 1];
-				strcpy(addr_cstr, dstaddr_str.c_str());
-				char* txid_cstr = new char[txoutid_str.length() + 1];
-				strcpy(txid_cstr, txoutid_str.c_str());
-				size_t txid_len     = txoutid_str.length();
-				char*  abi_hex_cstr = NULL;
-				size_t abi_hexlen;
-
-				// abi start
-				struct eth_abi abi;
-				eth_abi_init(&abi, ETH_ABI_ENCODE);
-				eth_abi_address(&abi, &addr_cstr);
-				for (int i = 0; i < fc1.nPegSteps; i++) {
-					uint64_t psv = fc1.fps[i];
-					eth_abi_uint64(&abi, &psv);
-				}
-				for (int i = 0; i < fc1.nMicroSteps; i++) {
-					uint64_t msv = fc1.fms[i];
-					eth_abi_uint64(&abi, &msv);
-				}
-				eth_abi_bytes(&abi, (uint8_t**)(&txid_cstr), &txid_len);
-				eth_abi_to_hex(&abi, &abi_hex_cstr, &abi_hexlen);
-				eth_abi_free(&abi);
-				// abi end
-
-				uint8_t* abi_bin_data;
-				int      len_abi_bin = eth_hex_to_bytes(&abi_bin_data, abi_hex_cstr, abi_hexlen);
-				if (len_abi_bin <= 0) {
+				MerkleHash leaf;
+				if (!ComputeBurnMerkleLeaf(dstaddr_str, fc1, txoutid_str, leaf)) {
 					return false;
 				}
-				uint8_t keccak[32];
-				int     keccak_ok = eth_keccak256(keccak, (uint8_t*)abi_bin_data, len_abi_bin);
-				if (keccak_ok <= 0) {
-					return false;
-				}
-				char* leaf_hex_cstr;
-				int   leaf_hex_len = eth_hex_from_bytes(&leaf_hex_cstr, keccak, 32);
-				if (leaf_hex_len < 0) {
-					return false;
-				}
-				string leaf_hex        = string(leaf_hex_cstr);
+				string leaf_hex        = HexStr(leaf.begin(), leaf.end());
 				string txout_addr_leaf = txout_to_addr + ":" + leaf_hex + ":" +
 				                         std::to_string(fc1.nPegSteps + fc1.nMicroSteps);
 				for (int i = 0; i < fc1.nPegSteps; i++) {
@@ -893,14 +844,7 @@ bool ConnectBridgeCycleBurns(CPegDB&       pegdb,
 				}
 
 				// collect in cycle burns with leaves
-				set<string>& bridge_cycle_burn_txouts_per_bridge = bridge_cycle_burn_txouts[brhash];
-				bridge_cycle_burn_txouts_per_bridge.insert(txout_addr_leaf);
-
-				delete[] addr_cstr;
-				delete[] txid_cstr;
-				free(abi_hex_cstr);
-				free(abi_bin_data);
-				free(leaf_hex_cstr);
+				bridge_cycle_burn_txouts[brhash][txout_addr_leaf] = leaf;
 			}
 		}
 
@@ -914,46 +858,37 @@ bool ConnectBridgeCycleBurns(CPegDB&       pegdb,
 
 	// write bridge cycle burns txouts
 	for (const auto& it : bridge_cycle_burn_txouts) {
-		string             br_hash                             = it.first;
-		const set<string>& bridge_cycle_burn_txouts_per_bridge = it.second;
-		set<string>        bridge_cycle_burn_txouts_per_bridge_with_receipt;
+		string                         br_hash                             = it.first;
+		const map<string, MerkleHash>& bridge_cycle_burn_txouts_per_bridge = it.second;
+		set<string>                    bridge_cycle_burn_txouts_per_bridge_with_receipt;
 		// build merkle tree
-		merkle::TreeT<32, sha256_keccak> tree;
-		set<string>                      leaves_sorted;
-		for (const string& txout_addr_leaf : bridge_cycle_burn_txouts_per_bridge) {
-			vector<string> args;
-			boost::split(args, txout_addr_leaf, boost::is_any_of(":"));
-			if (args.size() < 5)
-				return false;
-			string leaf = args[3];
-			leaves_sorted.insert(leaf);
+		set<MerkleHash> leaves_sorted;
+		for (const auto& txout_leaf : bridge_cycle_burn_txouts_per_bridge) {
+			leaves_sorted.insert(txout_leaf.second);
 		}
-		int              idx = 0;
-		map<string, int> leaf_to_merkle_idx;
-		for (const string& leaf : leaves_sorted) {
-			tree.insert(leaf);
-			leaf_to_merkle_idx[leaf] = idx;
-			idx++;
+		vector<MerkleHash>   leaves(leaves_sorted.begin(), leaves_sorted.end());
+		map<MerkleHash, int> leaf_to_merkle_idx;
+		for (size_t idx = 0; idx < leaves.size(); idx++) {
+			leaf_to_merkle_idx[leaves[idx]] = idx;
 		}
-		auto   merkle_root = tree.root();
-		string merkle_str  = merkle_root.to_string();
-		int    section     = bridges_sections[br_hash];
+		CMerkleBatchTree tree;
+		tree.Build(leaves);
+		const MerkleHash& merkle_root = tree.Root();
+		string            merkle_str  = HexStr(merkle_root.begin(), merkle_root.end());
+		int               section     = bridges_sections[br_hash];
 		// write ready merkle tree
 		if (!pegdb.WriteBridgeCycleMerkle(bhash_bridge_cycle, br_hash,
 		                                  merkle_str + ":" + std::to_string(section)))
 			return false;
 		// get receipts ready
-		for (string txout_addr_leaf : bridge_cycle_burn_txouts_per_bridge) {
-			vector<string> args;
-			boost::split(args, txout_addr_leaf, boost::is_any_of(":"));
-			string         leaf = args[3];
-			int            idx  = leaf_to_merkle_idx[leaf];
+		vector<MerkleHash> leaf_path;
+		for (const auto& txout_leaf : bridge_cycle_burn_txouts_per_bridge) {
+			string         txout_addr_leaf = txout_leaf.first;
+			int            idx             = leaf_to_merkle_idx[txout_leaf.second];
 			vector<string> leaf_path_elms;
-			auto           leaf_path = tree.path(idx);
-			for (size_t i = 0; i < leaf_path->size(); i++) {
-				const auto& leaf_path_elm     = (*leaf_path)[i];
-				string      leaf_path_elm_txt = leaf_path_elm.to_string();
-				leaf_path_elms.push_back(leaf_path_elm_txt);
+			tree.Path(idx, leaf_path);
+			for (const MerkleHash& leaf_path_elm : leaf_path) {
+				leaf_path_elms.push_back(HexStr(leaf_path_elm.begin(), leaf_path_elm.end()));
 			}
 			// +proofs
 			txout_addr_leaf += ":" + std::to_string(leaf_path_elms.size());
@@ -988,58 +923,177 @@ bool ConnectBridgeCycleBurns(CPegDB&       pegdb,
 	return true;
 }
 
+// Minimal ABI encoder for merkle leaves: static words followed by a single
+// dynamic bytes value. It produces the same layout as libethc eth_abi_* calls
+// followed by eth_abi_to_hex, but straight into one binary buffer sized for
+// the leaf up front, so leaves are hashed without hex round trips.
+class CMerkleLeafAbi {
+public:
+	enum { WORD = 32 };
+
+	CMerkleLeafAbi(size_t nHeadWords, size_t nDynamicLen) {
+		size_t nPadded = (nDynamicLen + WORD - 1) / WORD * WORD;
+		nHead          = WORD * nHeadWords;
+		buf.assign(nHead + WORD + nPadded, 0);
+	}
+
+	void Uint64(uint64_t v) {
+		if (!Fits(WORD))
+			return;
+		PutUint64(&buf[nPos], v);
+		nPos += WORD;
+	}
+	void Address(const uint8_t* addr) {
+		if (!Fits(WORD))
+			return;
+		memcpy(&buf[nPos + 12], addr, 20);
+		nPos += WORD;
+	}
+	void Bytes(const void* data, size_t len) {
+		if (!Fits(WORD) || nHead + WORD + len > buf.size()) {
+			fInvalid = true;
+			return;
+		}
+		// offset of the tail (right after heads), then length and data in the tail
+		PutUint64(&buf[nPos], nHead);
+		nPos += WORD;
+		PutUint64(&buf[nHead], len);
+		if (len)
+			memcpy(&buf[nHead + WORD], data, len);
+	}
+	bool Keccak(MerkleHash& out) const {
+		if (fInvalid || nPos != nHead)
+			return false;
+		return eth_keccak256(out.data(), buf.data(), buf.size()) > 0;
+	}
+
+private:
+	vector<uint8_t> buf;
+	size_t          nHead    = 0;
+	size_t          nPos     = 0;
+	bool            fInvalid = false;
+
+	// more head words than announced in the constructor
+	bool Fits(size_t n) {
+		if (nPos + n > nHead)
+			fInvalid = true;
+		return !fInvalid;
+	}
+	static void PutUint64(uint8_t* word, uint64_t v) {
+		for (int i = 0; i < 8; i++) {
+			word[WORD - 1 - i] = uint8_t(v >> (8 * i));
+		}
+	}
+};
+
+static inline int HexDigitValue(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Same acceptance as eth_abi_address: 42 hex chars, or "0x" and 40 hex chars
+// (longer strings use the leading chars). Invalid addresses are skipped by
+// libethc without writing a word, callers keep that behavior.
+static bool ParseAbiAddress(const string& addr, uint8_t out[20]) {
+	if (addr.size() < 42)
+		return false;
+	size_t pos = 0;
+	if (addr[0] == '0' && (addr[1] == 'x' || addr[1] == 'X'))
+		pos = 2;
+	for (size_t i = pos; i < 42; i++) {
+		if (HexDigitValue(addr[i]) < 0)
+			return false;
+	}
+	// without prefix 42 digits give 21 bytes, the first 20 of them are used
+	for (size_t i = 0; i < 20; i++) {
+		int h  = HexDigitValue(addr[pos + 2 * i]);
+		int l  = HexDigitValue(addr[pos + 2 * i + 1]);
+		out[i] = uint8_t((h << 4) | l);
+	}
+	return true;
+}
+
+static bool ParseMerkleHash(const string& hex, MerkleHash& out) {
+	if (hex.size() != 64)
+		return false;
+	for (size_t i = 0; i < 32; i++) {
+		int h = HexDigitValue(hex[2 * i]);
+		int l = HexDigitValue(hex[2 * i + 1]);
+		if (h < 0 || l < 0)
+			return false;
+		out[i] = uint8_t((h << 4) | l);
+	}
+	return true;
+}
+
+static bool MintMerkleLeaf(const string&          dest_addr_str,
+                           const vector<int64_t>& sections,
+                           int                    section_peg,
+                           int                    nonce,
+                           const uint8_t*         from_addr,
+                           MerkleHash&            out_leaf) {
+	size_t nHeadWords = 1 + sections.size() + 2 + (from_addr ? 1 : 0);
+
+	CMerkleLeafAbi abi(nHeadWords, dest_addr_str.size());
+	abi.Bytes(dest_addr_str.data(), dest_addr_str.size());
+	for (size_t i = 0; i < sections.size(); i++) {
+		abi.Uint64(uint64_t(sections[i]));
+	}
+	abi.Uint64(uint64_t(section_peg));
+	abi.Uint64(uint64_t(nonce));
+	if (from_addr)
+		abi.Address(from_addr);
+	return abi.Keccak(out_leaf);
+}
+
+bool ComputeMintMerkleLeaf(const string&                dest_addr_str,
+                           const vector<int64_t>&       sections,
+                           int                          section_peg,
+                           int                          nonce,
+                           const vector<unsigned char>& from,
+                           MerkleHash&                  out_leaf) {
+	// sender is the evm address, the first 20 bytes of the pushed data
+	const uint8_t* from_addr = from.size() >= 20 ? from.data() : nullptr;
+	return MintMerkleLeaf(dest_addr_str, sections, section_peg, nonce, from_addr, out_leaf);
+}
+
 bool ComputeMintMerkleLeaf(const string&   dest_addr_str,
                            vector<int64_t> sections,
                            int             section_peg,
                            int             nonce,
                            const string&   from,
                            string&         out_leaf_hex) {
-	char* dest_addr_cstr = new char[dest_addr_str.length() + 1];
-	strcpy(dest_addr_cstr, dest_addr_str.c_str());
-	size_t dest_addr_len  = dest_addr_str.length();
-	char*  from_addr_cstr = new char[from.length() + 1];
-	strcpy(from_addr_cstr, from.c_str());
-	char*  abi_hex_cstr = NULL;
-	size_t abi_hexlen;
-
-	// abi start
-	struct eth_abi abi;
-	eth_abi_init(&abi, ETH_ABI_ENCODE);
-	eth_abi_bytes(&abi, (uint8_t**)(&dest_addr_cstr), &dest_addr_len);
-	for (size_t i = 0; i < sections.size(); i++) {
-		uint64_t sv = uint64_t(sections[i]);
-		eth_abi_uint64(&abi, &sv);
-	}
-	uint64_t section_peg_u = uint64_t(section_peg);
-	eth_abi_uint64(&abi, &section_peg_u);
-	uint64_t nonce_u = uint64_t(nonce);
-	eth_abi_uint64(&abi, &nonce_u);
-	eth_abi_address(&abi, &from_addr_cstr);
-	eth_abi_to_hex(&abi, &abi_hex_cstr, &abi_hexlen);
-	eth_abi_free(&abi);
-	// abi end
-
-	uint8_t* abi_bin_data;
-	int      len_abi_bin = eth_hex_to_bytes(&abi_bin_data, abi_hex_cstr, abi_hexlen);
-	if (len_abi_bin <= 0) {
-		return false;
-	}
-	uint8_t keccak[32];
-	int     keccak_ok = eth_keccak256(keccak, (uint8_t*)abi_bin_data, len_abi_bin);
-	if (keccak_ok <= 0) {
-		return false;
-	}
-	char* leaf_hex_cstr;
-	int   leaf_hex_len = eth_hex_from_bytes(&leaf_hex_cstr, keccak, 32);
-	if (leaf_hex_len < 0) {
+	uint8_t    from_addr[20];
+	bool       fFromAddr = ParseAbiAddress(from, from_addr);
+	MerkleHash leaf;
+	if (!MintMerkleLeaf(dest_addr_str, sections, section_peg, nonce,
+	                    fFromAddr ? from_addr : nullptr, leaf))
 		return false;
+	out_leaf_hex = HexStr(leaf.begin(), leaf.end());
+	return true;
+}
+
+bool ComputeMintMerkleRoot(const MerkleHash&         leaf,
+                           const vector<MerkleHash>& proofs,
+                           MerkleHash&               out_root) {
+	MerkleHash branch = leaf;
+	for (const MerkleHash& proof : proofs) {
+		// lower hash goes first, same order as lowercase hex compare
+		int cmp = memcmp(proof.data(), branch.data(), 32);
+		if (cmp > 0) {
+			keccak256_pair(branch.data(), proof.data(), branch.data());
+		} else if (cmp < 0) {
+			keccak256_pair(proof.data(), branch.data(), branch.data());
+		} else {
+			return false;  // can not match
+		}
 	}
-	out_leaf_hex = string(leaf_hex_cstr);
-	delete[] dest_addr_cstr;
-	delete[] from_addr_cstr;
-	free(abi_hex_cstr);
-	free(abi_bin_data);
-	free(leaf_hex_cstr);
+	out_root = branch;
 	return true;
 }
 
@@ -1050,85 +1104,90 @@ bool ComputeMintMerkleRoot(const string&  inp_leaf_hex,
 		out_root_hex = inp_leaf_hex;
 		return true;
 	}
-	string inp_branch = inp_leaf_hex;
-	string out_branch = inp_leaf_hex;
-	for (const string& proof : proofs) {
-		string branch1;
-		string branch2;
-		int    cmp = proof.compare(inp_branch);
-		if (cmp > 0) {
-			branch1 = inp_branch;
-			branch2 = proof;
-		} else if (cmp < 0) {
-			branch1 = proof;
-			branch2 = inp_branch;
-		} else {
-			return false;  // can not match
-		}
-
-		char* branch1_cstr = new char[branch1.length() + 1];
-		strcpy(branch1_cstr, branch1.c_str());
-		uint8_t* branch1_bin_data;
-		int len_branch1_bin = eth_hex_to_bytes(&branch1_bin_data, branch1_cstr, branch1.length());
-		if (len_branch1_bin != 32) {
-			delete[] branch1_cstr;
-			if (len_branch1_bin > 0)
-				free(branch1_bin_data);
-			return false;
-		}
-		char* branch2_cstr = new char[branch2.length() + 1];
-		strcpy(branch2_cstr, branch2.c_str());
-		uint8_t* branch2_bin_data;
-		int len_branch2_bin = eth_hex_to_bytes(&branch2_bin_data, branch2_cstr, branch2.length());
-		if (len_branch2_bin != 32) {
-			delete[] branch1_cstr;
-			delete[] branch2_cstr;
-			if (len_branch1_bin > 0)
-				free(branch1_bin_data);
-			if (len_branch2_bin > 0)
-				free(branch2_bin_data);
+	MerkleHash         leaf;
+	vector<MerkleHash> proofs_bin(proofs.size());
+	if (!ParseMerkleHash(inp_leaf_hex, leaf))
+		return false;
+	for (size_t i = 0; i < proofs.size(); i++) {
+		if (!ParseMerkleHash(proofs[i], proofs_bin[i]))
 			return false;
-		}
+	}
+	MerkleHash root;
+	if (!ComputeMintMerkleRoot(leaf, proofs_bin, root))
+		return false;
+	out_root_hex = HexStr(root.begin(), root.end());
+	return true;
+}
 
-		char*  abi_hex_cstr = NULL;
-		size_t abi_hexlen;
-
-		// abi start
-		struct eth_abi abi;
-		eth_abi_init(&abi, ETH_ABI_ENCODE);
-		eth_abi_bytes32(&abi, branch1_bin_data);
-		eth_abi_bytes32(&abi, branch2_bin_data);
-		eth_abi_to_hex(&abi, &abi_hex_cstr, &abi_hexlen);
-		eth_abi_free(&abi);
-		// abi end
-
-		uint8_t* abi_bin_data;
-		int      len_abi_bin = eth_hex_to_bytes(&abi_bin_data, abi_hex_cstr, abi_hexlen);
-		if (len_abi_bin <= 0) {
-			return false;
+void CMerkleBatchTree::Build(const vector<MerkleHash>& leaves) {
+	nLeaves = leaves.size();
+	nHeight = 0;
+	if (nLeaves == 0)
+		return;
+	if (vLevels.empty())
+		vLevels.resize(1);
+	vLevels[0].assign(leaves.begin(), leaves.end());
+	size_t n = nLeaves;
+	while (n > 1) {
+		size_t n_next = (n + 1) / 2;
+		nHeight++;
+		if (vLevels.size() <= nHeight)
+			vLevels.resize(nHeight + 1);
+		const vector<MerkleHash>& level      = vLevels[nHeight - 1];
+		vector<MerkleHash>&       level_next = vLevels[nHeight];
+		level_next.resize(n_next);
+		for (size_t i = 0; i + 1 < n; i += 2) {
+			const MerkleHash& l = level[i];
+			const MerkleHash& r = level[i + 1];
+			if (memcmp(l.data(), r.data(), 32) < 0)
+				keccak256_pair(l.data(), r.data(), level_next[i / 2].data());
+			else
+				keccak256_pair(r.data(), l.data(), level_next[i / 2].data());
 		}
-		uint8_t keccak[32];
-		int     keccak_ok = eth_keccak256(keccak, (uint8_t*)abi_bin_data, len_abi_bin);
-		if (keccak_ok <= 0) {
-			return false;
-		}
-		char* out_branch_hex_cstr;
-		int   leaf_hex_len = eth_hex_from_bytes(&out_branch_hex_cstr, keccak, 32);
-		if (leaf_hex_len < 0) {
-			return false;
-		}
-		out_branch = string(out_branch_hex_cstr);
-		delete[] branch1_cstr;
-		delete[] branch2_cstr;
-		free(branch1_bin_data);
-		free(branch2_bin_data);
-		free(abi_hex_cstr);
-		free(abi_bin_data);
-		free(out_branch_hex_cstr);
-		inp_branch = out_branch;
+		if (n % 2)
+			level_next[n_next - 1] = level[n - 1];
+		n = n_next;
 	}
-	out_root_hex = out_branch;
-	return true;
+}
+
+const MerkleHash& CMerkleBatchTree::Root() const {
+	static const MerkleHash empty = {};
+	if (nLeaves == 0)
+		return empty;
+	return vLevels[nHeight].front();
+}
+
+void CMerkleBatchTree::Path(size_t index, vector<MerkleHash>& proofs) const {
+	proofs.clear();
+	if (index >= nLeaves)
+		return;
+	for (size_t h = 0; h < nHeight; h++) {
+		size_t sibling = index ^ 1;
+		if (sibling < vLevels[h].size())
+			proofs.push_back(vLevels[h][sibling]);
+		index >>= 1;
+	}
+}
+
+bool ComputeBurnMerkleLeaf(const string&               dest_addr_str,
+                           const CCompressedFractions& fractions,
+                           const string&               txoutid,
+                           MerkleHash&                 out_leaf) {
+	uint8_t dest_addr[20];
+	bool    fDestAddr  = ParseAbiAddress(dest_addr_str, dest_addr);
+	size_t  nHeadWords = (fDestAddr ? 1 : 0) + fractions.nPegSteps + fractions.nMicroSteps + 1;
+
+	CMerkleLeafAbi abi(nHeadWords, txoutid.size());
+	if (fDestAddr)
+		abi.Address(dest_addr);
+	for (int i = 0; i < fractions.nPegSteps; i++) {
+		abi.Uint64(uint64_t(fractions.fps[i]));
+	}
+	for (int i = 0; i < fractions.nMicroSteps; i++) {
+		abi.Uint64(uint64_t(fractions.fms[i]));
+	}
+	abi.Bytes(txoutid.data(), txoutid.size());
+	return abi.Keccak(out_leaf);
 }
 
 static int64_t getNumberFromScript(opcodetype opcode, const vector<unsigned char>& vch) {
@@ -1149,16 +1208,25 @@ static int64_t getNumberFromScript(opcodetype opcode, const vector<unsigned char
 	return v;
 }
 
-bool DecodeAndValidateMintSigScript(const CScript&   scriptSig,
-                                    CBitcoinAddress& addr_dest,
-                                    vector<int64_t>& sections,
-                                    int&             section_peg,
-                                    int&             nonce,
-                                    string&          from,
-                                    string&          leaf,
-                                    vector<string>&  proofs) {
-	int sections_size = 0;
-	int proofs_size   = 0;
+// Pushes up to 8 bytes were historically taken as script numbers and then
+// parsed back as hex, keep that so recoded scripts compare the same way.
+static vector<unsigned char> MintPushData(const vector<unsigned char>& vch) {
+	if (vch.size() > 8)
+		return vch;
+	return ParseHex(ValueString(vch));
+}
+
+bool DecodeAndValidateMintSigScript(const CScript&         scriptSig,
+                                    CBitcoinAddress&       addr_dest,
+                                    vector<int64_t>&       sections,
+                                    int&                   section_peg,
+                                    int&                   nonce,
+                                    vector<unsigned char>& from,
+                                    MerkleHash&            leaf,
+                                    vector<MerkleHash>&    proofs) {
+	int                   sections_size = 0;
+	int                   proofs_size   = 0;
+	vector<unsigned char> vchLeaf;
 
 	int                     idx = 0;
 	opcodetype              opcode;
@@ -1194,13 +1262,21 @@ bool DecodeAndValidateMintSigScript(const CScript&   scriptSig,
 			} else if (idx == 3 + sections_size) {
 				nonce = getNumberFromScript(opcode, vch);
 			} else if (idx == 4 + sections_size) {
-				from = ValueString(vch);
+				from = vch;
 			} else if (idx == 5 + sections_size) {
-				leaf = ValueString(vch);
+				vchLeaf = MintPushData(vch);
 			} else if (idx == 6 + sections_size) {
 				proofs_size = getNumberFromScript(opcode, vch);
 			} else if (idx >= 7 + sections_size && idx < (7 + sections_size + proofs_size)) {
-				string proof = ValueString(vch);
+				vector<unsigned char> vchProof = MintPushData(vch);
+				if (vchProof.size() != 32) {
+					return error(
+					    "DecodeAndValidateMintSigScript() : CoinMint sigScript proof %d size %d: "
+					    "%s",
+					    proofs.size(), vchProof.size(), scriptSig.ToString());
+				}
+				MerkleHash proof;
+				memcpy(proof.data(), vchProof.data(), 32);
 				proofs.push_back(proof);
 			} else {
 				std::string str = ValueString(vch);
@@ -1213,6 +1289,11 @@ bool DecodeAndValidateMintSigScript(const CScript&   scriptSig,
 		}
 		idx++;
 	}
+	if (vchLeaf.size() != 32) {
+		return error("DecodeAndValidateMintSigScript() : CoinMint sigScript leaf size %d: %s",
+		             vchLeaf.size(), scriptSig.ToString());
+	}
+	memcpy(leaf.data(), vchLeaf.data(), 32);
 	// rebuild sigScript and compare vs input one
 	{
 		CScript proofSig;
@@ -1224,14 +1305,11 @@ bool DecodeAndValidateMintSigScript(const CScript&   scriptSig,
 			}
 			proofSig << int64_t(section_peg);
 			proofSig << int64_t(nonce);
-			std::vector<unsigned char> vchSender = ParseHex(from);
-			proofSig << vchSender;
-			std::vector<unsigned char> vchLeaf = ParseHex(leaf);
+			proofSig << MintPushData(from);
 			proofSig << vchLeaf;
 			proofSig << int64_t(proofs.size());
-			for (const string& proof : proofs) {
-				std::vector<unsigned char> vchProof = ParseHex(proof);
-				proofSig << vchProof;
+			for (const MerkleHash& proof : proofs) {
+				proofSig << vector<unsigned char>(proof.begin(), proof.end());
 			}
 		}
 		if (proofSig != scriptSig) {
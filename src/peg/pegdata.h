@@ -116,6 +116,22 @@ public:
 	CFractions MidPart(const CPegLevel&, const CPegLevel&) const;
 	CFractions RatioPart(int64_t part) const;
 
+	// LowPart and HighPart in one pass, low/high are overwritten (SplitAt),
+	// added to (AddSplitTo) or deducted from (SubSplitFrom); totals of the
+	// parts are added to nLow/nHigh. low/high must not refer to this.
+	void SplitAt(int supply, CFractions& low, CFractions& high, int64_t* nLow,
+	             int64_t* nHigh) const;
+	void SplitAt(const CPegLevel&, CFractions& low, CFractions& high, int64_t* nLow,
+	             int64_t* nHigh) const;
+	void AddSplitTo(int supply, CFractions& low, CFractions& high, int64_t* nLow,
+	                int64_t* nHigh) const;
+	void AddSplitTo(const CPegLevel&, CFractions& low, CFractions& high, int64_t* nLow,
+	                int64_t* nHigh) const;
+	void SubSplitFrom(int supply, CFractions& low, CFractions& high, int64_t* nLow,
+	                  int64_t* nHigh) const;
+	void SubSplitFrom(const CPegLevel&, CFractions& low, CFractions& high, int64_t* nLow,
+	                  int64_t* nHigh) const;
+
 	CFractions&       operator+=(const CFractions& b);
 	CFractions&       operator-=(const CFractions& b);
 	friend CFractions operator+(CFractions a, const CFractions& b) {
@@ -34,12 +34,42 @@ namespace fs = boost::filesystem;
 
 leveldb::DB* pegdb;  // global pointer for LevelDB object instance
 
-static leveldb::Options GetOptions() {
-	leveldb::Options options;
-	int              nCacheSizeMB = GetArg("-dbcache", 50);
-	options.block_cache           = leveldb::NewLRUCache(nCacheSizeMB * 1048576);
-	options.filter_policy         = leveldb::NewBloomFilterPolicy(10);
-	return options;
+// Cycle states cache shared by all CPegDB instances. The state datas are
+// content addressed (intervalStateData_<shash>) so decoded entries never go
+// stale, only the references cycle block -> shash are invalidated: on write
+// (new cycle or votes applied), on batch commit and on DisconnectBlock.
+// Every invalidation bumps the generation, a reader caches what it read from
+// disk only when no invalidation happened since before its read, else it may
+// put back a value a concurrent commit just replaced.
+static CCriticalSection                                       cs_cyclestates;
+static uint64_t                                               nCycleStatesGeneration = 0;
+static std::map<std::pair<uint256, int>, uint256>             mapCycleStateHashes;
+static std::map<uint256, std::set<std::string>>               mapCycleStateData1;
+static std::map<uint256, std::map<int, CChainParams::ConsensusVotes>> mapCycleStateData2;
+static std::map<uint256, std::map<std::string, std::vector<std::string>>> mapCycleStateData3;
+static const size_t nCycleStatesCacheMax = 4096;
+
+template <typename M>
+static void CycleStatesCacheTrim(M& m) {
+	// entries are cheap to reload, just start over when cache is full
+	if (m.size() >= nCycleStatesCacheMax)
+		m.clear();
+}
+
+static void CycleStatesCacheClear() {
+	LOCK(cs_cyclestates);
+	nCycleStatesGeneration++;
+	mapCycleStateHashes.clear();
+	mapCycleStateData1.clear();
+	mapCycleStateData2.clear();
+	mapCycleStateData3.clear();
+}
+
+static leveldb::Options    pegdb_options;  // options of the global instance
+static CLevelDBCommitTimes pegdb_commit_times;
+
+bool CPegDB::GetStats(CLevelDBStats& stats) {
+	return GetLevelDBStats(pegdb, pegdb_options, pegdb_commit_times, stats);
 }
 
 static void init_blockindex(leveldb::Options& options,
@@ -54,6 +84,7 @@ static void init_blockindex(leveldb::Options& options,
 		throw runtime_error(strprintf("init_blockindex(): error opening database environment %s",
 		                              status.ToString()));
 	}
+	pegdb_options = options;
 }
 
 // CDB subclasses are created and destroyed VERY OFTEN. That's why
@@ -70,9 +101,8 @@ CPegDB::CPegDB(const char* pszMode) {
 
 	bool fCreate = strchr(pszMode, 'c');
 
-	options                   = GetOptions();
+	options                   = GetLevelDBOptions(true);
 	options.create_if_missing = fCreate;
-	options.filter_policy     = leveldb::NewBloomFilterPolicy(10);
 
 	init_blockindex(options);  // Init directory
 	pdb = pegdb;
@@ -110,13 +140,16 @@ CPegDB::CPegDB(const char* pszMode) {
 
 void CPegDB::Close() {
 	delete pegdb;
-	pegdb = pdb = NULL;
+	pegdb = pdb   = NULL;
+	pegdb_options = leveldb::Options();
 	delete options.filter_policy;
 	options.filter_policy = NULL;
 	delete options.block_cache;
 	options.block_cache = NULL;
 	delete activeBatch;
 	activeBatch = NULL;
+	setPendingCycleStates.clear();
+	CycleStatesCacheClear();
 }
 
 bool CPegDB::TxnBegin() {
@@ -127,9 +160,19 @@ bool CPegDB::TxnBegin() {
 
 bool CPegDB::TxnCommit() {
 	assert(activeBatch);
+	int64_t         nStart = GetTimeMicros();
 	leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+	pegdb_commit_times.Add(GetTimeMicros() - nStart);
 	delete activeBatch;
 	activeBatch = NULL;
+	if (!setPendingCycleStates.empty()) {
+		LOCK(cs_cyclestates);
+		nCycleStatesGeneration++;
+		for (const auto& key : setPendingCycleStates) {
+			mapCycleStateHashes.erase(key);
+		}
+		setPendingCycleStates.clear();
+	}
 	if (!status.ok()) {
 		LogPrintf("LevelDB batch commit failure: %s\n", status.ToString());
 		return false;
@@ -218,6 +261,24 @@ bool CPegDB::WritePegPruneEnabled(bool fEnabled) {
 	return Write(string("pegPruneEnabled"), fEnabled);
 }
 
+bool CPegDB::ReadPegPrunedHeight(int& nHeight) {
+	return Read(string("pegPrunedHeight"), nHeight);
+}
+
+bool CPegDB::WritePegPrunedHeight(int nHeight) {
+	return Write(string("pegPrunedHeight"), nHeight);
+}
+
+bool CPegDB::RemovePegPrunedHeight() {
+	return Erase(string("pegPrunedHeight"));
+}
+
+void CPegDB::CompactRange(const std::string& sBegin, const std::string& sEnd) {
+	leveldb::Slice begin(sBegin);
+	leveldb::Slice end(sEnd);
+	pdb->CompactRange(&begin, &end);
+}
+
 bool CPegDB::ReadPegTxActivated(bool& fActivated) {
 	return Read(string("pegTxActivated"), fActivated);
 }
@@ -443,6 +504,8 @@ bool CPegDB::LoadPegData(CTxDB& txdb, LoadMsg load_msg) {
 				return error("WriteBlockIndexIsPegReady() : TxnBegin failed");
 			if (!txdb.WriteBlockIndexIsPegReady(false))
 				return error("WriteBlockIndexIsPegReady() : flag write failed");
+			// progress of a migration for the previous start height is void
+			txdb.EraseIndexMigration("blockindexpeg");
 			if (!txdb.WritePegCheck(PEG_DB_CHECK1, false))
 				return error("WritePegCheck() : flag1 write failed");
 			if (!txdb.WritePegCheck(PEG_DB_CHECK2, false))
@@ -776,6 +839,11 @@ bool CPegDB::LoadPegData(CTxDB& txdb, LoadMsg load_msg) {
 			if (!pegdb.WritePegPruneEnabled(fPegPruneEnabled))
 				return error("WritePegPruneEnabled() : peg prune flag write failed");
 
+			// blocks were pruned inline above, the background pruning
+			// restarts from the prune window of the reprocessed chain
+			if (!pegdb.RemovePegPrunedHeight())
+				return error("RemovePegPrunedHeight() : peg pruned height erase failed");
+
 			if (pBlockindexPegFail) {
 				auto pindexFork = pBlockindexPegFail->Prev();
 				if (pindexFork) {
@@ -814,27 +882,78 @@ bool CPegDB::LoadPegData(CTxDB& txdb, LoadMsg load_msg) {
 bool CPegDB::ReadCycleStateHash(uint256                           bhash_cycle,
                                 CChainParams::AcceptedStatesTypes typ,
                                 uint256&                          hash) {
+	auto key = std::make_pair(bhash_cycle, int(typ));
+	// not written in pending batch so the disk value is the actual one
+	bool     fCacheable  = setPendingCycleStates.count(key) == 0;
+	uint64_t nGeneration = 0;
+	if (fCacheable) {
+		LOCK(cs_cyclestates);
+		nGeneration = nCycleStatesGeneration;
+		auto it     = mapCycleStateHashes.find(key);
+		if (it != mapCycleStateHashes.end()) {
+			hash = it->second;
+			return true;
+		}
+	}
 	bool ok = Read("intervalStateHash_" + bhash_cycle.ToString() + strprintf("%016x", typ), hash);
-	if (!ok)
+	if (!ok) {
 		hash = uint256(0);
-	return ok;
+		return false;
+	}
+	if (fCacheable) {
+		LOCK(cs_cyclestates);
+		if (nGeneration == nCycleStatesGeneration) {
+			CycleStatesCacheTrim(mapCycleStateHashes);
+			mapCycleStateHashes[key] = hash;
+		}
+	}
+	return true;
 }
 
 bool CPegDB::WriteCycleStateHash(uint256                           bhash_cycle,
                                  CChainParams::AcceptedStatesTypes typ,
                                  const uint256&                    hash) {
-	return Write("intervalStateHash_" + bhash_cycle.ToString() + strprintf("%016x", typ), hash);
+	auto key = std::make_pair(bhash_cycle, int(typ));
+	if (activeBatch)
+		setPendingCycleStates.insert(key);
+	bool ok = Write("intervalStateHash_" + bhash_cycle.ToString() + strprintf("%016x", typ), hash);
+	// after the write, a read racing with it is then either erased here or not cached
+	{
+		LOCK(cs_cyclestates);
+		nCycleStatesGeneration++;
+		mapCycleStateHashes.erase(key);
+	}
+	return ok;
+}
+
+void CPegDB::ForgetCycleStates(const uint256& bhash_cycle) {
+	LOCK(cs_cyclestates);
+	nCycleStatesGeneration++;
+	auto it = mapCycleStateHashes.lower_bound(std::make_pair(bhash_cycle, 0));
+	while (it != mapCycleStateHashes.end() && it->first.first == bhash_cycle) {
+		it = mapCycleStateHashes.erase(it);
+	}
 }
 
 bool CPegDB::ReadCycleStateData1(const uint256& hash, std::set<std::string>& results) {
+	{
+		LOCK(cs_cyclestates);
+		auto it = mapCycleStateData1.find(hash);
+		if (it != mapCycleStateData1.end()) {
+			results.insert(it->second.begin(), it->second.end());
+			return true;
+		}
+	}
 	string data_txt;
 	if (Read("intervalStateData_" + hash.GetHex(), data_txt)) {
 		std::set<std::string> datas;
 		boost::split(datas, data_txt, boost::is_any_of(","));
-		for (const string& data : datas) {
-			if (data.empty())
-				continue;
-			results.insert(data);
+		datas.erase(std::string());
+		results.insert(datas.begin(), datas.end());
+		if (!activeBatch) {
+			LOCK(cs_cyclestates);
+			CycleStatesCacheTrim(mapCycleStateData1);
+			mapCycleStateData1[hash].swap(datas);
 		}
 		return true;
 	}
@@ -886,9 +1005,20 @@ bool CPegDB::WriteCycleStateData2(const std::map<int, CChainParams::ConsensusVot
 
 bool CPegDB::ReadCycleStateData2(uint256&                                     hash,
                                  std::map<int, CChainParams::ConsensusVotes>& result) {
+	{
+		LOCK(cs_cyclestates);
+		auto it = mapCycleStateData2.find(hash);
+		if (it != mapCycleStateData2.end()) {
+			for (const auto& item : it->second) {
+				result[item.first] = item.second;
+			}
+			return true;
+		}
+	}
 	string data_txt;
 	if (Read("intervalStateData_" + hash.GetHex(), data_txt)) {
-		set<string> vdatas;
+		std::map<int, CChainParams::ConsensusVotes> datas;
+		set<string>                                 vdatas;
 		boost::split(vdatas, data_txt, boost::is_any_of(","));
 		for (const string& consensus_txt : vdatas) {
 			if (consensus_txt.empty())
@@ -899,7 +1029,15 @@ bool CPegDB::ReadCycleStateData2(uint256&                                     ha
 				return false;
 			}
 			CChainParams::ConsensusVotes consensus = {atoi(args[1]), atoi(args[2]), atoi(args[3])};
-			result[atoi(args[0])]                  = consensus;
+			datas[atoi(args[0])]                   = consensus;
+		}
+		for (const auto& item : datas) {
+			result[item.first] = item.second;
+		}
+		if (!activeBatch) {
+			LOCK(cs_cyclestates);
+			CycleStatesCacheTrim(mapCycleStateData2);
+			mapCycleStateData2[hash].swap(datas);
 		}
 		return true;
 	}
@@ -932,9 +1070,20 @@ bool CPegDB::WriteCycleStateData3(const std::map<std::string, std::vector<std::s
 
 bool CPegDB::ReadCycleStateData3(uint256&                                         hash,
                                  std::map<std::string, std::vector<std::string>>& result) {
+	{
+		LOCK(cs_cyclestates);
+		auto it = mapCycleStateData3.find(hash);
+		if (it != mapCycleStateData3.end()) {
+			for (const auto& item : it->second) {
+				result[item.first] = item.second;
+			}
+			return true;
+		}
+	}
 	string datas_txt;
 	if (Read("intervalStateData_" + hash.GetHex(), datas_txt)) {
-		set<string> datas;
+		std::map<std::string, std::vector<std::string>> vdatas_map;
+		set<string>                                     datas;
 		boost::split(datas, datas_txt, boost::is_any_of(","));
 		for (const string& vdatas_txt : datas) {
 			if (vdatas_txt.empty())
@@ -950,7 +1099,15 @@ bool CPegDB::ReadCycleStateData3(uint256&
 					continue;
 				vdata_val.push_back(vdata[i]);
 			}
-			result[vdata_key] = vdata_val;
+			vdatas_map[vdata_key] = vdata_val;
+		}
+		for (const auto& item : vdatas_map) {
+			result[item.first] = item.second;
+		}
+		if (!activeBatch) {
+			LOCK(cs_cyclestates);
+			CycleStatesCacheTrim(mapCycleStateData3);
+			mapCycleStateData3[hash].swap(vdatas_map);
 		}
 		return true;
 	}
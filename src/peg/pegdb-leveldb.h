@@ -8,8 +8,10 @@
 
 #include "main.h"
 #include "peg.h"
+#include "txdb-leveldb.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -28,6 +30,8 @@ public:
 	// Destroys the underlying shared global state accessed by this TxDB.
 	void Close();
 
+	static bool GetStats(CLevelDBStats& stats);
+
 	bool ReadFractions(uint320 txout, CFractions&, bool must_have = false);
 	bool WriteFractions(uint320 txout, const CFractions&);
 
@@ -41,6 +45,10 @@ private:
 	bool                 fReadOnly;
 	int                  nVersion;
 
+	// Cycle state references written into activeBatch, they are dropped
+	// from the shared cycle states cache when the batch is committed.
+	std::set<std::pair<uint256, int>> setPendingCycleStates;
+
 protected:
 	// Returns true and sets (value,false) if activeBatch contains the given key
 	// or leaves value alone and sets deleted = true if activeBatch contains a
@@ -180,6 +188,7 @@ public:
 	bool TxnAbort() {
 		delete activeBatch;
 		activeBatch = NULL;
+		setPendingCycleStates.clear();
 		return true;
 	}
 
@@ -196,6 +205,14 @@ public:
 	bool ReadPegPruneEnabled(bool& fEnabled);
 	bool WritePegPruneEnabled(bool fEnabled);
 
+	// height through which spent fractions are pruned (background pruning)
+	bool ReadPegPrunedHeight(int& nHeight);
+	bool WritePegPrunedHeight(int nHeight);
+	bool RemovePegPrunedHeight();
+
+	// compacts serialized key range [sBegin, sEnd] after large deletes
+	void CompactRange(const std::string& sBegin, const std::string& sEnd);
+
 	bool ReadPegTxActivated(bool& fActivated);
 	bool WritePegTxActivated(bool fActivated);
 
@@ -224,6 +241,8 @@ public:
 	bool WriteCycleStateHash(uint256                           bhash_cycle,
 							 CChainParams::AcceptedStatesTypes typ,
 							 const uint256&                    hash);
+	// drops cached cycle state references of the block (disconnect)
+	void ForgetCycleStates(const uint256& bhash_cycle);
 
 	bool ReadCycleStateData1(const uint256& hash, std::set<string>& results);
 	bool WriteCycleStateData1(const std::set<string>& datas, uint256& written_hash);
@@ -421,6 +421,130 @@ CFractions CFractions::HighPart(int supply, int64_t* total) const {
 	return frHighPart;
 }
 
+// Single pass over the slots: [0,idx) goes to low, (idx,PEG_SIZE) to high
+// and the slot at idx is divided by nPart/nTotal with the same rounding as
+// LowPart/HighPart(CPegLevel), or goes to high when there is no partial.
+// nSign is +1 to accumulate and -1 to deduct; nLow/nHigh get the totals.
+static void SplitAccumulate(const int64_t* f,
+                            int            idx,
+                            int64_t        nPart,
+                            int64_t        nTotal,
+                            int64_t        nSign,
+                            int64_t*       low,
+                            int64_t*       high,
+                            int64_t*       nLow,
+                            int64_t*       nHigh) {
+	int     split      = std::max(0, std::min(idx, int(PEG_SIZE)));
+	int64_t nTotalLow  = 0;
+	int64_t nTotalHigh = 0;
+	for (int i = 0; i < split; i++) {
+		nTotalLow += f[i];
+		low[i] += nSign * f[i];
+	}
+	if (idx >= 0 && idx < PEG_SIZE && nPart > 0 && nTotal > 0) {
+		int64_t v     = f[idx];
+		int64_t vpart = ::RatioPart(v, nPart, nTotal);
+		if (vpart < v)
+			vpart++;
+		nTotalLow += vpart;
+		nTotalHigh += (v - vpart);
+		low[idx] += nSign * vpart;
+		high[idx] += nSign * (v - vpart);
+		split++;
+	}
+	for (int i = split; i < PEG_SIZE; i++) {
+		nTotalHigh += f[i];
+		high[i] += nSign * f[i];
+	}
+	if (nLow)
+		*nLow += nTotalLow;
+	if (nHigh)
+		*nHigh += nTotalHigh;
+}
+
+static void ResetToStd(CFractions& fr) {
+	fr.nFlags    = CFractions::STD;
+	fr.nLockTime = 0;
+	fr.sReturnAddr.clear();
+	std::fill(fr.f.get(), fr.f.get() + PEG_SIZE, 0);
+}
+
+void CFractions::SplitAt(int supply, CFractions& low, CFractions& high, int64_t* nLow,
+                         int64_t* nHigh) const {
+	ResetToStd(low);
+	ResetToStd(high);
+	AddSplitTo(supply, low, high, nLow, nHigh);
+}
+void CFractions::SplitAt(const CPegLevel& peglevel,
+                         CFractions&      low,
+                         CFractions&      high,
+                         int64_t*         nLow,
+                         int64_t*         nHigh) const {
+	ResetToStd(low);
+	ResetToStd(high);
+	AddSplitTo(peglevel, low, high, nLow, nHigh);
+}
+
+void CFractions::AddSplitTo(int         supply,
+                            CFractions& low,
+                            CFractions& high,
+                            int64_t*    nLow,
+                            int64_t*    nHigh) const {
+	if ((nFlags & STD) == 0) {
+		return Std().AddSplitTo(supply, low, high, nLow, nHigh);
+	}
+	if ((low.nFlags & STD) == 0)
+		low.ToStd();
+	if ((high.nFlags & STD) == 0)
+		high.ToStd();
+	SplitAccumulate(f.get(), supply, 0, 0, 1, low.f.get(), high.f.get(), nLow, nHigh);
+}
+void CFractions::SubSplitFrom(int         supply,
+                              CFractions& low,
+                              CFractions& high,
+                              int64_t*    nLow,
+                              int64_t*    nHigh) const {
+	if ((nFlags & STD) == 0) {
+		return Std().SubSplitFrom(supply, low, high, nLow, nHigh);
+	}
+	if ((low.nFlags & STD) == 0)
+		low.ToStd();
+	if ((high.nFlags & STD) == 0)
+		high.ToStd();
+	SplitAccumulate(f.get(), supply, 0, 0, -1, low.f.get(), high.f.get(), nLow, nHigh);
+}
+
+void CFractions::AddSplitTo(const CPegLevel& peglevel,
+                            CFractions&      low,
+                            CFractions&      high,
+                            int64_t*         nLow,
+                            int64_t*         nHigh) const {
+	if ((nFlags & STD) == 0) {
+		return Std().AddSplitTo(peglevel, low, high, nLow, nHigh);
+	}
+	if ((low.nFlags & STD) == 0)
+		low.ToStd();
+	if ((high.nFlags & STD) == 0)
+		high.ToStd();
+	SplitAccumulate(f.get(), peglevel.nSupply + peglevel.nShift, peglevel.nShiftLastPart,
+	                peglevel.nShiftLastTotal, 1, low.f.get(), high.f.get(), nLow, nHigh);
+}
+void CFractions::SubSplitFrom(const CPegLevel& peglevel,
+                              CFractions&      low,
+                              CFractions&      high,
+                              int64_t*         nLow,
+                              int64_t*         nHigh) const {
+	if ((nFlags & STD) == 0) {
+		return Std().SubSplitFrom(peglevel, low, high, nLow, nHigh);
+	}
+	if ((low.nFlags & STD) == 0)
+		low.ToStd();
+	if ((high.nFlags & STD) == 0)
+		high.ToStd();
+	SplitAccumulate(f.get(), peglevel.nSupply + peglevel.nShift, peglevel.nShiftLastPart,
+	                peglevel.nShiftLastTotal, -1, low.f.get(), high.f.get(), nLow, nHigh);
+}
+
 CFractions CFractions::LowPart(const CPegLevel& peglevel, int64_t* total) const {
 	if ((nFlags & STD) == 0) {
 		return Std().LowPart(peglevel, total);
@@ -160,9 +160,12 @@ bool getpegdatainfo(
     out_value       = pd.fractions.Total();
     out_liquid      = pd.nLiquid;
     out_reserve     = pd.nReserve;
+    CFractions frLiquid;
+    CFractions frReserve;
+    pd.fractions.SplitAt(pd.peglevel, frReserve, frLiquid, nullptr, nullptr);
     out_value_hli   = pd.fractions.HLI();
-    out_liquid_hli  = pd.fractions.HighPart(pd.peglevel, nullptr).HLI();
-    out_reserve_hli = pd.fractions.LowPart(pd.peglevel, nullptr).HLI();
+    out_liquid_hli  = frLiquid.HLI();
+    out_reserve_hli = frReserve.HLI();
     out_id          = pd.nId;
 
     out_level_version   = pd.peglevel.nVersion;
@@ -23,15 +23,15 @@ using namespace boost;
 
 static string sBurnAddress = "bJnV8J5v74MGctMyVSVPfGu1mGQ9nMTiB3";
 
-bool CalculateStandardFractions(const CTransaction& tx,
-                                int                 nSupply,
-                                uint32_t            nBlockTime,
-                                MapPrevOut&         mapInputs,
-                                MapFractions&       mapInputsFractions,
-                                set<uint32_t>       setTimeLockPass,
-                                MapFractions&       mapTestFractionsPool,
-                                CFractions&         feesFractions,
-                                std::string&        sFailCause) {
+bool CalculateStandardFractions(const CTransaction&  tx,
+                                int                  nSupply,
+                                uint32_t             nBlockTime,
+                                MapPrevOut&          mapInputs,
+                                MapFractions&        mapInputsFractions,
+                                const set<uint32_t>& setTimeLockPass,
+                                MapFractions&        mapTestFractionsPool,
+                                CFractions&          feesFractions,
+                                std::string&         sFailCause) {
 	size_t n_vin  = tx.vin.size();
 	size_t n_vout = tx.vout.size();
 
@@ -51,23 +51,25 @@ bool CalculateStandardFractions(const CTransaction& tx,
 	for (uint32_t i = 0; i < n_vin; i++) {
 		const COutPoint& prevout = tx.vin[i].prevout;
 		auto             fkey    = uint320(prevout.hash, prevout.n);
-		if (!mapInputs.count(fkey)) {
+		auto             itInput = mapInputs.find(fkey);
+		if (itInput == mapInputs.end()) {
 			sFailCause = "P-I-1: Refered output is not found";
 			return false;
 		}
-		const CTxOut& prevtxout = mapInputs[fkey];
+		const CTxOut& prevtxout = itInput->second;
 
 		int64_t nValue = prevtxout.nValue;
 		nValueIn += nValue;
 		auto sAddress = prevtxout.scriptPubKey.ToAddress();
 		setInputAddresses.insert(sAddress);
 
-		if (mapInputsFractions.find(fkey) == mapInputsFractions.end()) {
+		auto itInputFractions = mapInputsFractions.find(fkey);
+		if (itInputFractions == mapInputsFractions.end()) {
 			sFailCause = "P-I-2: No input fractions found";
 			return false;
 		}
 
-		auto frInp = mapInputsFractions[fkey].Std();
+		auto frInp = itInputFractions->second.Std();
 		if (frInp.Total() != prevtxout.nValue) {
 			std::stringstream ss;
 			ss << "P-I-3: Input fraction " << prevout.hash.GetHex() << ":" << prevout.n << " total "
@@ -92,13 +94,12 @@ bool CalculateStandardFractions(const CTransaction& tx,
 			}
 		}
 
-		int64_t nReserveIn = 0;
-		auto&   frReserve  = poolReserves[sAddress];
-		frReserve += frInp.LowPart(nSupply, &nReserveIn);
-
+		// split input into reserve and liquidity pools in one pass
+		int64_t nReserveIn   = 0;
 		int64_t nLiquidityIn = 0;
+		auto&   frReserve    = poolReserves[sAddress];
 		auto&   frLiquidity  = poolLiquidity[sAddress];
-		frLiquidity += frInp.HighPart(nSupply, &nLiquidityIn);
+		frInp.AddSplitTo(nSupply, frReserve, frLiquidity, &nReserveIn, &nLiquidityIn);
 
 		// check if intend to transfer frozen
 		// if so need to do appropriate deductions from pools
@@ -146,11 +147,12 @@ bool CalculateStandardFractions(const CTransaction& tx,
 				// the diff can go only to fee fractions
 				int64_t nReserveDeduct   = 0;
 				int64_t nLiquidityDeduct = 0;
-				frReserve -= frInp.LowPart(nSupply, &nReserveDeduct);
-				frLiquidity -= frInp.HighPart(nSupply, &nLiquidityDeduct);
+				frInp.SubSplitFrom(nSupply, frReserve, frLiquidity, &nReserveDeduct,
+				                   &nLiquidityDeduct);
 				nReserveIn -= nReserveDeduct;
 				nLiquidityIn -= nLiquidityDeduct;
-				frColdFees += (frInp - frOut);
+				frColdFees += frInp;
+				frColdFees -= frOut;
 			}
 
 			bool fNotaryF = boost::starts_with(sNotary, "**F**");
@@ -311,8 +313,8 @@ bool CalculateStandardFractions(const CTransaction& tx,
 							// the diff can go to other outputs
 							int64_t nReserveDeduct   = 0;
 							int64_t nLiquidityDeduct = 0;
-							frReserve -= frozenOut.LowPart(nSupply, &nReserveDeduct);
-							frLiquidity -= frozenOut.HighPart(nSupply, &nLiquidityDeduct);
+							frozenOut.SubSplitFrom(nSupply, frReserve, frLiquidity,
+							                       &nReserveDeduct, &nLiquidityDeduct);
 							nReserveIn -= nReserveDeduct;
 							nLiquidityIn -= nLiquidityDeduct;
 						}
@@ -396,8 +398,9 @@ bool CalculateStandardFractions(const CTransaction& tx,
 							// first output - to leave fair amount of reserve for second.
 							int64_t nValue1 = poolFrozen[nIndex1].nValue;
 							int64_t nValue2 = poolFrozen[nIndex2].nValue;
-							if (poolReserves.count(sFrozenAddress) > 0) {
-								auto&   frReserve = poolReserves[sFrozenAddress];
+							auto itReserve = poolReserves.find(sFrozenAddress);
+							if (itReserve != poolReserves.end()) {
+								auto&   frReserve = itReserve->second;
 								int64_t nReserve  = frReserve.Total();
 								if (nReserve <= (nValue1 + nValue2) && (nValue1 + nValue2) > 0) {
 									int64_t nScaledValue1 =
@@ -412,9 +415,10 @@ bool CalculateStandardFractions(const CTransaction& tx,
 					}
 
 					for (const string& sAddress : vAddresses) {
-						if (poolReserves.count(sAddress) == 0)
+						auto itReserve = poolReserves.find(sAddress);
+						if (itReserve == poolReserves.end())
 							continue;
-						auto&   frReserve = poolReserves[sAddress];
+						auto&   frReserve = itReserve->second;
 						int64_t nReserve  = frReserve.Total();
 						if (nReserve == 0)
 							continue;
@@ -444,11 +448,12 @@ bool CalculateStandardFractions(const CTransaction& tx,
 			}
 		} else {
 			if (!poolFrozen.count(i)) {              // not frozen
-				if (poolReserves.count(sAddress)) {  // back to reserve
+				auto itReserve = poolReserves.find(sAddress);
+				if (itReserve != poolReserves.end()) {  // back to reserve
 					int64_t nValueLeft   = nValue;
 					int64_t nValueToTake = nValueLeft;
 
-					auto&   frReserve = poolReserves[sAddress];
+					auto&   frReserve = itReserve->second;
 					int64_t nReserve  = frReserve.Total();
 					if (nReserve > 0) {
 						if (nValueToTake > nReserve)
@@ -469,14 +474,9 @@ bool CalculateStandardFractions(const CTransaction& tx,
 					}
 				} else {  // move liquidity out
 					if (sAddress == sBurnAddress || (fNotary && !fNotaryZ)) {
-						vector<string> vAddresses;
-						for (auto it = poolReserves.begin(); it != poolReserves.end(); it++) {
-							vAddresses.push_back(it->first);
-						}
-
 						int64_t nValueLeft = nValue;
-						for (const string& sAddress : vAddresses) {
-							auto&   frReserve = poolReserves[sAddress];
+						for (auto& item : poolReserves) {
+							auto&   frReserve = item.second;
 							int64_t nReserve  = frReserve.Total();
 							if (nReserve == 0)
 								continue;
@@ -522,7 +522,7 @@ bool CalculateStandardFractions(const CTransaction& tx,
 		// lets do some extra checks for totals
 		for (uint32_t i = 0; i < n_vout; i++) {
 			auto    fkey   = uint320(tx.GetHash(), i);
-			auto    f      = mapTestFractionsPool[fkey];
+			const auto& f  = mapTestFractionsPool[fkey];
 			int64_t nValue = tx.vout[i].nValue;
 			if (nValue != f.Total() || !f.IsPositive()) {
 				sFailCause    = "P-G-2: Total mismatch on output " + std::to_string(i);
@@ -553,10 +553,7 @@ bool CalculateStandardFractions(const CTransaction& tx,
 	if (fFailedPegOut) {
 		// remove failed fractions from pool
 		auto fkey = uint320(tx.GetHash(), nLatestPegOut);
-		if (mapTestFractionsPool.count(fkey)) {
-			auto it = mapTestFractionsPool.find(fkey);
-			mapTestFractionsPool.erase(it);
-		}
+		mapTestFractionsPool.erase(fkey);
 		return false;
 	}
 
@@ -61,14 +61,14 @@ struct FrozenTxOut {
 	CFractions  fractions;
 };
 
-bool CalculateStandardFractions(const CTransaction& tx,
-                                int                 nSupply,
-                                uint32_t            nBlockTime,
-                                MapPrevOut&         inputs,
-                                MapFractions&       finputs,
-                                std::set<uint32_t>  setTimeLockPass,
-                                MapFractions&       mapTestFractionsPool,
-                                CFractions&         feesFractions,
-                                std::string&        sPegFailCause);
+bool CalculateStandardFractions(const CTransaction&       tx,
+                                int                       nSupply,
+                                uint32_t                  nBlockTime,
+                                MapPrevOut&               inputs,
+                                MapFractions&             finputs,
+                                const std::set<uint32_t>& setTimeLockPass,
+                                MapFractions&             mapTestFractionsPool,
+                                CFractions&               feesFractions,
+                                std::string&              sPegFailCause);
 
 #endif
@@ -217,6 +217,172 @@ Value getrawmempool(const Array& params, bool fHelp) {
 	return a;
 }
 
+Value getmempoolinfo(const Array& params, bool fHelp) {
+	if (fHelp || params.size() != 0)
+		throw runtime_error(
+		    "getmempoolinfo\n"
+		    "Returns memory pool state:\n"
+		    "  size: transactions, bytes: their serialized size,\n"
+		    "  usage: estimated memory of txs, prevouts and indexes,\n"
+		    "  fractions/fractionsusage: packed output fractions and their memory,\n"
+		    "  maxmempool: -maxmempool in bytes, evicted: txs evicted since startup");
+
+	Object obj;
+	{
+		LOCK(mempool.cs);
+		obj.push_back(Pair("size", (uint64_t)mempool.mapTx.size()));
+		obj.push_back(Pair("bytes", mempool.nBytes));
+		obj.push_back(Pair("usage", (uint64_t)mempool.nUsage));
+		obj.push_back(Pair("fractions", (uint64_t)mempool.mapPackedFractions.size()));
+		obj.push_back(Pair("fractionsusage", (uint64_t)mempool.nFractionsUsage));
+		obj.push_back(Pair("evicted", mempool.nEvicted));
+	}
+	obj.push_back(Pair("maxmempool",
+	                   std::max((int64_t)0, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE)) *
+	                       1000000));
+	return obj;
+}
+
+Value getbenchstats(const Array& params, bool fHelp) {
+	if (fHelp || params.size() != 0)
+		throw runtime_error(
+		    "getbenchstats\n"
+		    "Returns time spent in the phases of connecting blocks since startup:\n"
+		    "  blocks: blocks connected, height: last connected block,\n"
+		    "  last/total: milliseconds for the last block and cumulative,\n"
+		    "  phases: the same per phase (scripts and fractions are part of connectinputs,\n"
+		    "  commit is the database commit after the block is connected),\n"
+		    "  hashes: GetHash() calls on transactions and blocks during the last block\n"
+		    "  and in total, and how many of them were not served from the hash cache\n"
+		    "  (counted with -debug=bench only)");
+
+	CBlockBenchStats stats = GetBlockBenchStats();
+
+	Object phases;
+	for (int i = 0; i < BENCH_PHASE_COUNT; i++) {
+		Object phase;
+		phase.push_back(Pair("last", stats.nLastMicros[i] * 0.001));
+		phase.push_back(Pair("total", stats.nTotalMicros[i] * 0.001));
+		if (stats.nBlocks > 0)
+			phase.push_back(Pair("average", stats.nTotalMicros[i] * 0.001 / stats.nBlocks));
+		phases.push_back(Pair(GetBlockBenchPhaseName(i), phase));
+	}
+
+	Object obj;
+	obj.push_back(Pair("blocks", stats.nBlocks));
+	obj.push_back(Pair("height", stats.nLastHeight));
+	obj.push_back(Pair("last", stats.nLastBlockMicros * 0.001));
+	obj.push_back(Pair("total", stats.nTotalBlockMicros * 0.001));
+	obj.push_back(Pair("phases", phases));
+
+	static const char* const pszHashCounters[BENCH_HASH_COUNTERS] = {
+	    "txcalls", "txcomputed", "blockcalls", "blockcomputed"};
+	Object hashes;
+	for (int i = 0; i < BENCH_HASH_COUNTERS; i++) {
+		Object counter;
+		counter.push_back(Pair("last", stats.nLastHashes[i]));
+		counter.push_back(Pair("total", stats.nTotalHashes[i]));
+		hashes.push_back(Pair(pszHashCounters[i], counter));
+	}
+	obj.push_back(Pair("hashes", hashes));
+	return obj;
+}
+
+Value benchtxreads(const Array& params, bool fHelp) {
+	if (fHelp || params.size() > 1)
+		throw runtime_error(
+		    "benchtxreads [count=1000]\n"
+		    "Reads <count> transactions at random positions of the best chain with stdio\n"
+		    "and from the mapped block files, twice each in alternating order, and returns\n"
+		    "reads per second.");
+
+	int nCount = params.size() > 0 ? params[0].get_int() : 1000;
+	if (nCount < 1 || nCount > 1000000)
+		throw runtime_error("Count out of range.");
+
+	// only the index walk needs cs_main, block files are append only
+	vector<pair<uint32_t, uint32_t>> vBlockPos;
+	{
+		LOCK(cs_main);
+		if (nBestHeight <= 0)
+			throw runtime_error("No blocks to read.");
+		for (int i = 0; i < nCount; i++) {
+			CBlockIndex* pindex = FindBlockByHeight(GetRandInt(nBestHeight + 1));
+			if (pindex)
+				vBlockPos.push_back(make_pair(pindex->nFile, pindex->nBlockPos));
+		}
+	}
+
+	vector<CDiskTxPos> vPos;
+	for (const auto& item : vBlockPos) {
+		CBlock block;
+		if (!block.ReadFromDisk(item.first, item.second))
+			continue;
+		// same layout as in ConnectBlock
+		uint32_t nTxPos = item.second + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) -
+		                  (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+		int nTx = GetRandInt(block.vtx.size());
+		for (int j = 0; j < nTx; j++)
+			nTxPos += ::GetSerializeSize(block.vtx[j], SER_DISK, CLIENT_VERSION);
+		vPos.push_back(CDiskTxPos(item.first, item.second, nTxPos));
+	}
+
+	auto fnStdioPass = [&]() {
+		int nReads = 0;
+		for (const CDiskTxPos& pos : vPos) {
+			CTransaction tx;
+			CAutoFile filein(OpenBlockFile(pos.nFile, pos.nTxPos, "rb"), SER_DISK, CLIENT_VERSION);
+			if (!filein)
+				continue;
+			try {
+				filein >> tx;
+				nReads++;
+			} catch (std::exception& e) {
+			}
+		}
+		return nReads;
+	};
+	auto fnMappedPass = [&]() {
+		int nReads = 0;
+		for (const CDiskTxPos& pos : vPos) {
+			CTransaction tx;
+			try {
+				if (ReadFromBlockFileView(pos.nFile, pos.nTxPos, SER_DISK, tx))
+					nReads++;
+			} catch (std::exception& e) {
+			}
+		}
+		return nReads;
+	};
+
+	// the first pass warms the page cache for the second, so each way runs
+	// once first and once second and the times are summed
+	int     nStdioReads  = 0;
+	int     nMappedReads = 0;
+	int64_t nTimeStdio   = 0;
+	int64_t nTimeMapped  = 0;
+	for (int nRound = 0; nRound < 2; nRound++) {
+		for (int nPass = 0; nPass < 2; nPass++) {
+			int64_t nStart = GetTimeMicros();
+			if ((nRound + nPass) % 2 == 0) {
+				nStdioReads += fnStdioPass();
+				nTimeStdio += GetTimeMicros() - nStart;
+			} else {
+				nMappedReads += fnMappedPass();
+				nTimeMapped += GetTimeMicros() - nStart;
+			}
+		}
+	}
+
+	Object obj;
+	obj.push_back(Pair("reads", 2 * (int)vPos.size()));
+	obj.push_back(Pair("stdioreads", nStdioReads));
+	obj.push_back(Pair("stdiopersec", nTimeStdio > 0 ? nStdioReads * 1e6 / nTimeStdio : 0.0));
+	obj.push_back(Pair("mappedreads", nMappedReads));
+	obj.push_back(Pair("mappedpersec", nTimeMapped > 0 ? nMappedReads * 1e6 / nTimeMapped : 0.0));
+	return obj;
+}
+
 Value getblockhash(const Array& params, bool fHelp) {
 	if (fHelp || params.size() != 1)
 		throw runtime_error(
@@ -406,6 +572,67 @@ Value getcheckpoint(const Array& params, bool fHelp) {
 	return result;
 }
 
+static Object DBStatsToJSON(const CLevelDBStats& stats) {
+	Object result;
+	result.push_back(Pair("size", (uint64_t)stats.nApproximateSize));
+	result.push_back(Pair("memory", (uint64_t)stats.nMemoryUsage));
+	result.push_back(Pair("cacheusage", (uint64_t)stats.nCacheUsage));
+	result.push_back(Pair("writebuffer", (uint64_t)stats.nWriteBufferSize));
+	result.push_back(Pair("maxfilesize", (uint64_t)stats.nMaxFileSize));
+	result.push_back(Pair("commits", stats.nCommits));
+	result.push_back(Pair("committime", stats.nCommitTime / 1000));
+	result.push_back(Pair("committimemax", stats.nCommitTimeMax / 1000));
+	result.push_back(Pair("stats", stats.strStats));
+	return result;
+}
+
+Value getdbstats(const Array& params, bool fHelp) {
+	if (fHelp || params.size() != 0)
+		throw runtime_error(
+		    "getdbstats\n"
+		    "Returns LevelDB statistics of the tx and peg databases:\n"
+		    "  size: approximate size on disk, memory: memtables and readers,\n"
+		    "  cacheusage: block cache in use, writebuffer/maxfilesize: options,\n"
+		    "  commits/committime/committimemax: batch writes, time in ms\n"
+		    "  (includes waits on compaction), stats: leveldb.stats");
+
+	Object        result;
+	CLevelDBStats txstats;
+	if (CTxDB::GetStats(txstats))
+		result.push_back(Pair("txleveldb", DBStatsToJSON(txstats)));
+	CLevelDBStats pegstats;
+	if (CPegDB::GetStats(pegstats))
+		result.push_back(Pair("pegleveldb", DBStatsToJSON(pegstats)));
+	return result;
+}
+
+Value getpegpruneinfo(const Array& params, bool fHelp) {
+	if (fHelp || params.size() != 0)
+		throw runtime_error(
+		    "getpegpruneinfo\n"
+		    "Returns state of the background pruning of spent peg fractions:\n"
+		    "  enabled, prunedheight: blocks pruned through this height,\n"
+		    "  targetheight: best height minus prune interval, pendingblocks,\n"
+		    "  erasedkeys/compactions/lastcompacttime: since startup,\n"
+		    "  pegdbsize: approximate size of pegleveldb on disk");
+
+	CPegPruneInfo info = GetPegPruneInfo();
+
+	Object result;
+	result.push_back(Pair("enabled", info.fEnabled));
+	result.push_back(Pair("prunedheight", info.nPrunedHeight));
+	result.push_back(Pair("targetheight", info.nTargetHeight));
+	result.push_back(
+	    Pair("pendingblocks", std::max(0, info.nTargetHeight - info.nPrunedHeight)));
+	result.push_back(Pair("erasedkeys", info.nErasedKeys));
+	result.push_back(Pair("compactions", info.nCompactions));
+	result.push_back(Pair("lastcompacttime", info.nLastCompactTime));
+	CLevelDBStats pegstats;
+	if (CPegDB::GetStats(pegstats))
+		result.push_back(Pair("pegdbsize", (uint64_t)pegstats.nApproximateSize));
+	return result;
+}
+
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out, bool fIncludeHex);
 
 Value gettxout(const Array& params, bool fHelp) {
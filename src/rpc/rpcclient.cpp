@@ -121,6 +121,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"getblockbynumber", 0},
     {"getblockbynumber", 1},
     {"getblockhash", 0},
+    {"benchtxreads", 0},
     {"bridgeautomate", 1},
     {"bridgeautomate", 2},
     {"bridgeautomate", 3},
@@ -660,6 +660,7 @@ Value signrawtransaction(const Array& params, bool fHelp) {
 	// mergedTx will end up with all the signatures; it
 	// starts as a clone of the rawtx:
 	CTransaction mergedTx(txVariants[0]);
+	mergedTx.ClearHashCache();  // signatures are added below
 	bool         fComplete      = true;
 	int64_t      nVirtBlockTime = GetAdjustedTime();
 
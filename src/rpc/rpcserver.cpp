@@ -204,6 +204,9 @@ static const CRPCCommand vRPCCommands[] = {
     {"getdifficulty", &getdifficulty, true, false, false},
     {"getinfo", &getinfo, true, false, false},
     {"getrawmempool", &getrawmempool, true, false, false},
+    {"getmempoolinfo", &getmempoolinfo, true, false, false},
+    {"getbenchstats", &getbenchstats, true, false, false},
+    {"benchtxreads", &benchtxreads, false, true, false},
     {"getblock", &getblock, false, false, false},
     {"getblockbynumber", &getblockbynumber, false, false, false},
     {"getblockhash", &getblockhash, false, false, false},
@@ -214,6 +217,8 @@ static const CRPCCommand vRPCCommands[] = {
     {"signrawtransaction", &signrawtransaction, false, false, false},
     {"sendrawtransaction", &sendrawtransaction, false, false, false},
     {"getcheckpoint", &getcheckpoint, true, false, false},
+    {"getdbstats", &getdbstats, true, false, false},
+    {"getpegpruneinfo", &getpegpruneinfo, true, false, false},
     {"sendalert", &sendalert, false, false, false},
     {"validateaddress", &validateaddress, true, false, false},
     {"validatepubkey", &validatepubkey, true, false, false},
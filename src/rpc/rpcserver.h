@@ -193,10 +193,15 @@ extern json_spirit::Value getblockcount(const json_spirit::Array& params,
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getbenchstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value benchtxreads(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getdbstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getpegpruneinfo(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getpeginfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getfractions(const json_spirit::Array& params, bool fHelp);
@@ -3,6 +3,8 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <atomic>
+
 #include <boost/tuple/tuple.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 
@@ -2364,7 +2366,66 @@ bool CScript::ToNotary(std::string& notary) const {
 	return is_notary;
 }
 
+uint256 CScriptAddressCache::Key(const CScript& script) {
+	return Hash(script.begin(), script.end());
+}
+
+bool CScriptAddressCache::Get(const CScript& script, std::string& sAddress) {
+	uint256                                 key = Key(script);
+	boost::shared_lock<boost::shared_mutex> lock(cs_addrcache);
+
+	auto mi = mapAddresses.find(key);
+	if (mi == mapAddresses.end() || mi->second.first != &Params()) {
+		nMisses++;
+		return false;
+	}
+	nHits++;
+	sAddress = mi->second.second;
+	return true;
+}
+
+void CScriptAddressCache::Set(const CScript& script, const std::string& sAddress) {
+	// standard scripts are ~25 bytes, 100,000 entries is under 10MB
+	int64_t nMaxCacheSize = GetArg("-maxaddrcachesize", 100000);
+	if (nMaxCacheSize <= 0)
+		return;
+
+	uint256                                 key = Key(script);
+	boost::unique_lock<boost::shared_mutex> lock(cs_addrcache);
+
+	while (static_cast<int64_t>(mapAddresses.size()) >= nMaxCacheSize) {
+		// evict a random entry, same as the signature cache: keys are
+		// hashes so the entry after a random hash is a random one
+		auto it = mapAddresses.lower_bound(GetRandHash());
+		if (it == mapAddresses.end())
+			it = mapAddresses.begin();
+		mapAddresses.erase(it);
+	}
+
+	mapAddresses[key] = addrdata_type(&Params(), sAddress);
+}
+
+void CScriptAddressCache::GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const {
+	nHitsOut   = nHits;
+	nMissesOut = nMisses;
+}
+
+size_t CScriptAddressCache::Size() {
+	boost::shared_lock<boost::shared_mutex> lock(cs_addrcache);
+	return mapAddresses.size();
+}
+
+static CScriptAddressCache scriptAddressCache;
+
+void GetScriptAddressCacheStats(uint64_t& nHits, uint64_t& nMisses) {
+	scriptAddressCache.GetStats(nHits, nMisses);
+}
+
 std::string CScript::ToAddress(bool* ptrIsNotary, string* ptrNotary) const {
+	std::string sCached;
+	if (scriptAddressCache.Get(*this, sCached))
+		return sCached;
+
 	int                    nRequired;
 	txnouttype             type;
 	vector<CTxDestination> addresses;
@@ -2378,8 +2439,12 @@ std::string CScript::ToAddress(bool* ptrIsNotary, string* ptrNotary) const {
 			str_addr_all += str_addr;
 			fNone = false;
 		}
-		if (!fNone)
+		if (!fNone) {
+			// only destination scripts are cached, for them the notary
+			// out-params are not touched so a cache hit behaves the same
+			scriptAddressCache.Set(*this, str_addr_all);
 			return str_addr_all;
+		}
 	}
 
 	if (ptrNotary || ptrIsNotary) {
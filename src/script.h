@@ -6,6 +6,8 @@
 #ifndef H_BITCOIN_SCRIPT
 #define H_BITCOIN_SCRIPT
 
+#include <atomic>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -20,6 +22,7 @@
 
 typedef std::vector<unsigned char> vchtype;
 
+class CChainParams;
 class CKeyStore;
 class CTransaction;
 
@@ -690,6 +693,29 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack,
                 uint32_t                                  flags,
                 int                                       nHashType,
                 std::set<vchtype>&                        sSignedPubk);
+// Valid base58 results of CScript::ToAddress. Inputs and outputs of every
+// connected transaction are converted to addresses (fractions pools, address
+// index) and the same scripts repeat a lot between blocks, while the base58
+// encoding itself is bignum division. Entries are keyed by the script hash:
+// scripts share long prefixes (76a914...), hashes are uniform so the entry
+// after a random key is a random one to evict.
+class CScriptAddressCache {
+private:
+	typedef std::pair<const CChainParams*, std::string> addrdata_type;
+	std::map<uint256, addrdata_type>                    mapAddresses;
+	boost::shared_mutex                                 cs_addrcache;
+	std::atomic<uint64_t>                               nHits{0};
+	std::atomic<uint64_t>                               nMisses{0};
+
+	static uint256 Key(const CScript& script);
+
+public:
+	bool   Get(const CScript& script, std::string& sAddress);
+	void   Set(const CScript& script, const std::string& sAddress);
+	void   GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const;
+	size_t Size();
+};
+
 bool Solver(const CScript&                            scriptPubKey,
             txnouttype&                               typeRet,
             std::vector<std::vector<unsigned char> >& vSolutionsRet);
@@ -705,6 +731,7 @@ bool       ExtractDestinations(const CScript&               scriptPubKey,
                                txnouttype&                  typeRet,
                                std::vector<CTxDestination>& addressRet,
                                int&                         nRequiredRet);
+void       GetScriptAddressCacheStats(uint64_t& nHits, uint64_t& nMisses);
 bool       SignSignature(const CKeyStore& keystore,
                          const CScript&   fromPubKey,
                          CTransaction&    txTo,
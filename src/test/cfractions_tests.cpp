@@ -8,6 +8,24 @@
 
 BOOST_AUTO_TEST_SUITE(cfractions_tests)
 
+// xorshift64, deterministic for a given seed
+static uint64_t NextRandom(uint64_t& seed)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static CFractions RandomStdFractions(uint64_t& seed)
+{
+    CFractions fr(0, CFractions::STD);
+    for (int i = 0; i < PEG_SIZE; i++) {
+        fr.f[i] = int64_t(NextRandom(seed) % 1000000000);
+    }
+    return fr;
+}
+
 BOOST_AUTO_TEST_CASE(cfractions_equality)
 {
     int x = 10;
@@ -105,4 +123,113 @@ BOOST_AUTO_TEST_CASE(ccompressedfractions_leaf2)
     }
 }
 
+BOOST_AUTO_TEST_CASE(cfractions_split_accumulate)
+{
+    // AddSplitTo/SubSplitFrom must match the LowPart/HighPart temporaries
+    // used before by CalculateStandardFractions, for STD and VALUE inputs
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+    std::vector<int> supplies{0, 1, 37, 599, PEG_SIZE - 1, PEG_SIZE};
+    for (int round = 0; round < 20; round++) {
+        CFractions fr = RandomStdFractions(seed);
+        CFractions frValue(int64_t(NextRandom(seed) % 100000000000LL), CFractions::VALUE);
+
+        for (int supply : supplies) {
+            for (const CFractions* src : {&fr, &frValue}) {
+                CFractions low_ref(0, CFractions::STD);
+                CFractions high_ref(0, CFractions::STD);
+                int64_t nLowRef = 0;
+                int64_t nHighRef = 0;
+                low_ref += src->LowPart(supply, &nLowRef);
+                high_ref += src->HighPart(supply, &nHighRef);
+
+                CFractions low; // default VALUE destinations as in pools
+                CFractions high;
+                int64_t nLow = 0;
+                int64_t nHigh = 0;
+                src->AddSplitTo(supply, low, high, &nLow, &nHigh);
+
+                BOOST_CHECK(nLow == nLowRef);
+                BOOST_CHECK(nHigh == nHighRef);
+                BOOST_CHECK(nLow + nHigh == src->Total());
+                BOOST_CHECK(low.nFlags & CFractions::STD);
+                BOOST_CHECK(high.nFlags & CFractions::STD);
+                for (int i = 0; i < PEG_SIZE; i++) {
+                    BOOST_CHECK(low.f[i] == low_ref.f[i]);
+                    BOOST_CHECK(high.f[i] == high_ref.f[i]);
+                }
+
+                int64_t nLowDeduct = 0;
+                int64_t nHighDeduct = 0;
+                src->SubSplitFrom(supply, low, high, &nLowDeduct, &nHighDeduct);
+                BOOST_CHECK(nLowDeduct == nLowRef);
+                BOOST_CHECK(nHighDeduct == nHighRef);
+                BOOST_CHECK(low.Total() == 0);
+                BOOST_CHECK(high.Total() == 0);
+                for (int i = 0; i < PEG_SIZE; i++) {
+                    BOOST_CHECK(low.f[i] == 0);
+                    BOOST_CHECK(high.f[i] == 0);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cfractions_split_peglevel)
+{
+    // SplitAt/AddSplitTo/SubSplitFrom with a peglevel must match the
+    // LowPart/HighPart(CPegLevel) pair including the partial last slot
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+    for (int round = 0; round < 50; round++) {
+        CFractions fr = RandomStdFractions(seed);
+
+        CPegLevel level(1, 0, 0, int(NextRandom(seed) % PEG_SIZE), 0, 0);
+        level.nShift = int16_t(NextRandom(seed) % 20) - 10;
+        if (level.nSupply + level.nShift < 0)
+            level.nShift = 0;
+        if (round % 2) {
+            level.nShiftLastTotal = int64_t(NextRandom(seed) % 1000000) + 1;
+            level.nShiftLastPart = int64_t(NextRandom(seed) % uint64_t(level.nShiftLastTotal));
+        }
+        if (round == 10) {
+            level.nSupply = PEG_SIZE - 1;
+            level.nShift = 0;
+        }
+        if (round == 11) {
+            level.nSupply = 0;
+            level.nShift = 0;
+        }
+
+        int64_t nLowRef = 0;
+        int64_t nHighRef = 0;
+        CFractions low_ref = fr.LowPart(level, &nLowRef);
+        CFractions high_ref = fr.HighPart(level, &nHighRef);
+
+        CFractions low(7, CFractions::VALUE);
+        CFractions high(7, CFractions::VALUE);
+        int64_t nLow = 0;
+        int64_t nHigh = 0;
+        fr.SplitAt(level, low, high, &nLow, &nHigh);
+
+        BOOST_CHECK(nLow == nLowRef);
+        BOOST_CHECK(nHigh == nHighRef);
+        BOOST_CHECK(nLow + nHigh == fr.Total());
+        BOOST_CHECK(low.nFlags == CFractions::STD);
+        BOOST_CHECK(high.nFlags == CFractions::STD);
+        for (int i = 0; i < PEG_SIZE; i++) {
+            BOOST_CHECK(low.f[i] == low_ref.f[i]);
+            BOOST_CHECK(high.f[i] == high_ref.f[i]);
+        }
+
+        fr.AddSplitTo(level, low, high, nullptr, nullptr);
+        fr.SubSplitFrom(level, low, high, nullptr, nullptr);
+        fr.SubSplitFrom(level, low, high, nullptr, nullptr);
+        for (int i = 0; i < PEG_SIZE; i++) {
+            BOOST_CHECK(low.f[i] == 0);
+            BOOST_CHECK(high.f[i] == 0);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
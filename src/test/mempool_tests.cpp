@@ -0,0 +1,259 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "txmempool.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+// one output per nValue, spending the given outpoints
+static CTransaction MakeTx(const vector<COutPoint>& vPrevouts, const vector<int64_t>& vValues)
+{
+    CTransaction tx;
+    tx.nTime = 1500000000;
+    for (const COutPoint& prevout : vPrevouts)
+        tx.vin.push_back(CTxIn(prevout));
+    for (int64_t nValue : vValues)
+        tx.vout.push_back(CTxOut(nValue, CScript() << OP_TRUE));
+    return tx;
+}
+
+// adds tx as AcceptToMemoryPool does with a pool limit of nMaxUsage,
+// false when tx was evicted itself
+static bool AddTx(CTxMemPool& pool, CTransaction& tx, int64_t nFee, size_t nMaxUsage = SIZE_MAX)
+{
+    uint256      hash = tx.GetHash();
+    MapPrevOut   mapPrevOuts;
+    MapFractions mapOutputsFractions;
+    for (const CTxIn& txin : tx.vin)
+        mapPrevOuts[uint320(txin.prevout.hash, txin.prevout.n)] = CTxOut(COIN, CScript());
+    for (size_t i = 0; i < tx.vout.size(); i++)
+        mapOutputsFractions[uint320(hash, i)] = CFractions(tx.vout[i].nValue, CFractions::VALUE);
+    CTxMemPoolEntry entry(tx, MapPrevTx(), nFee, 0, tx.nTime);
+    return pool.addUncheckedAndTrim(hash, tx, entry, mapPrevOuts, MapFractions(),
+                                    mapOutputsFractions, nMaxUsage);
+}
+
+// memory tx takes in an empty pool
+static size_t UsageOf(CTransaction& tx, int64_t nFee)
+{
+    CTxMemPool pool;
+    AddTx(pool, tx, nFee);
+    return pool.DynamicMemoryUsage();
+}
+
+// ancestor and descendant values of tx must be those of the listed txs
+static void CheckEntry(CTxMemPool&                 pool,
+                       const CTransaction&         tx,
+                       const vector<CTransaction>& vAncestors,
+                       const vector<CTransaction>& vDescendants)
+{
+    auto it = pool.mapEntries.find(tx.GetHash());
+    BOOST_REQUIRE(it != pool.mapEntries.end());
+    const CTxMemPoolEntry& entry = it->second;
+
+    uint64_t nSize = entry.nTxSize;
+    int64_t  nFees = entry.nFee;
+    for (const CTransaction& txAncestor : vAncestors) {
+        nSize += pool.mapEntries[txAncestor.GetHash()].nTxSize;
+        nFees += pool.mapEntries[txAncestor.GetHash()].nFee;
+    }
+    BOOST_CHECK_EQUAL(entry.nCountWithAncestors, 1 + vAncestors.size());
+    BOOST_CHECK_EQUAL(entry.nSizeWithAncestors, nSize);
+    BOOST_CHECK_EQUAL(entry.nFeesWithAncestors, nFees);
+
+    nSize = entry.nTxSize;
+    nFees = entry.nFee;
+    for (const CTransaction& txDescendant : vDescendants) {
+        nSize += pool.mapEntries[txDescendant.GetHash()].nTxSize;
+        nFees += pool.mapEntries[txDescendant.GetHash()].nFee;
+    }
+    BOOST_CHECK_EQUAL(entry.nCountWithDescendants, 1 + vDescendants.size());
+    BOOST_CHECK_EQUAL(entry.nSizeWithDescendants, nSize);
+    BOOST_CHECK_EQUAL(entry.nFeesWithDescendants, nFees);
+}
+
+// the score indexes hold exactly the current scores of the entries
+static void CheckIndexes(CTxMemPool& pool)
+{
+    set<pair<double, uint256>> setAncestorFeeRate;
+    set<pair<double, uint256>> setDescendantScore;
+    for (const auto& item : pool.mapEntries) {
+        setAncestorFeeRate.insert(make_pair(item.second.GetAncestorFeePerKb(), item.first));
+        setDescendantScore.insert(make_pair(item.second.GetDescendantScore(), item.first));
+    }
+    BOOST_CHECK(pool.setByAncestorFeeRate == setAncestorFeeRate);
+    BOOST_CHECK(pool.setByDescendantScore == setDescendantScore);
+    BOOST_CHECK_EQUAL(pool.setByTime.size(), pool.mapEntries.size());
+    BOOST_CHECK_EQUAL(pool.mapEntries.size(), pool.mapTx.size());
+}
+
+static vector<uint256> AncestorFeeRateOrder(CTxMemPool& pool)
+{
+    vector<uint256> vOrder;
+    for (const auto& item : pool.setByAncestorFeeRate)
+        vOrder.push_back(item.second);
+    return vOrder;
+}
+
+BOOST_AUTO_TEST_CASE(mempool_ancestor_descendant_state)
+{
+    // parent with two children, joined again by the grandchild
+    CTxMemPool   pool;
+    CTransaction parent = MakeTx({COutPoint(uint256(1), 0)}, {10 * COIN, 10 * COIN});
+    CTransaction child1 = MakeTx({COutPoint(parent.GetHash(), 0)}, {9 * COIN});
+    CTransaction child2 = MakeTx({COutPoint(parent.GetHash(), 1)}, {8 * COIN});
+    CTransaction grandchild =
+        MakeTx({COutPoint(child1.GetHash(), 0), COutPoint(child2.GetHash(), 0)}, {16 * COIN});
+
+    auto checkChain = [&]() {
+        CheckEntry(pool, parent, {}, {child1, child2, grandchild});
+        CheckEntry(pool, child1, {parent}, {grandchild});
+        CheckEntry(pool, child2, {parent}, {grandchild});
+        CheckEntry(pool, grandchild, {parent, child1, child2}, {});
+        CheckIndexes(pool);
+        // the low fee parent drags down every package it is in
+        vector<uint256> vOrder = {parent.GetHash(), child2.GetHash(), grandchild.GetHash(),
+                                  child1.GetHash()};
+        BOOST_CHECK(AncestorFeeRateOrder(pool) == vOrder);
+    };
+
+    BOOST_CHECK(AddTx(pool, parent, 1000));
+    BOOST_CHECK(AddTx(pool, child1, 900000));
+    BOOST_CHECK(AddTx(pool, child2, 30000));
+    BOOST_CHECK(AddTx(pool, grandchild, 200000));
+    checkChain();
+
+    // parent mined: the children lose it as an ancestor
+    BOOST_CHECK(pool.remove(parent));
+    BOOST_CHECK(!pool.exists(parent.GetHash()));
+    CheckEntry(pool, child1, {}, {grandchild});
+    CheckEntry(pool, child2, {}, {grandchild});
+    CheckEntry(pool, grandchild, {child1, child2}, {});
+    CheckIndexes(pool);
+    vector<uint256> vOrder = {child2.GetHash(), grandchild.GetHash(), child1.GetHash()};
+    BOOST_CHECK(AncestorFeeRateOrder(pool) == vOrder);
+
+    // block disconnected: the parent comes back under its children
+    BOOST_CHECK(AddTx(pool, parent, 1000));
+    checkChain();
+
+    // a conflict removes the parent with everything spending it
+    BOOST_CHECK(pool.remove(parent, true));
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(pool.mapEntries.empty());
+    BOOST_CHECK(pool.mapNextTx.empty());
+    CheckIndexes(pool);
+    BOOST_CHECK(pool.setByAncestorFeeRate.empty());
+    BOOST_CHECK(pool.setByDescendantScore.empty());
+}
+
+BOOST_AUTO_TEST_CASE(mempool_trim_order)
+{
+    CTxMemPool   pool;
+    CTransaction txA = MakeTx({COutPoint(uint256(1), 0)}, {COIN});
+    CTransaction txB = MakeTx({COutPoint(uint256(2), 0)}, {COIN});
+    // a low fee parent with a low fee child goes with it
+    CTransaction txLowParent = MakeTx({COutPoint(uint256(3), 0)}, {COIN});
+    CTransaction txLowChild  = MakeTx({COutPoint(txLowParent.GetHash(), 0)}, {COIN});
+    // a low fee parent paid for by its child stays with it
+    CTransaction txPaidParent = MakeTx({COutPoint(uint256(4), 0)}, {COIN});
+    CTransaction txPaidChild  = MakeTx({COutPoint(txPaidParent.GetHash(), 0)}, {COIN});
+
+    BOOST_CHECK(AddTx(pool, txA, 1000));
+    BOOST_CHECK(AddTx(pool, txLowParent, 2000));
+    BOOST_CHECK(AddTx(pool, txLowChild, 3000));
+    BOOST_CHECK(AddTx(pool, txB, 10000));
+    BOOST_CHECK(AddTx(pool, txPaidParent, 1000));
+    BOOST_CHECK(AddTx(pool, txPaidChild, 100000));
+    CheckIndexes(pool);
+
+    // each trim by one byte takes the lowest score with its descendants
+    vector<vector<CTransaction>> vEvictions = {
+        {txA},
+        {txLowParent, txLowChild},
+        {txB},
+        {txPaidParent, txPaidChild},
+    };
+    for (const vector<CTransaction>& vEvicted : vEvictions) {
+        BOOST_CHECK(pool.setByDescendantScore.begin()->second == vEvicted[0].GetHash());
+        size_t nPoolSize = pool.size();
+        BOOST_CHECK_EQUAL(pool.TrimToSize(pool.DynamicMemoryUsage() - 1), vEvicted.size());
+        BOOST_CHECK_EQUAL(pool.size(), nPoolSize - vEvicted.size());
+        for (const CTransaction& tx : vEvicted)
+            BOOST_CHECK(!pool.exists(tx.GetHash()));
+        CheckIndexes(pool);
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.nEvicted, 6U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_usage_accounting)
+{
+    CTxMemPool   pool;
+    CTransaction parent = MakeTx({COutPoint(uint256(1), 0)}, {10 * COIN, 10 * COIN});
+    CTransaction child1 = MakeTx({COutPoint(parent.GetHash(), 0)}, {9 * COIN});
+    CTransaction child2 = MakeTx({COutPoint(parent.GetHash(), 1)}, {8 * COIN});
+    CTransaction grandchild =
+        MakeTx({COutPoint(child1.GetHash(), 0), COutPoint(child2.GetHash(), 0)}, {16 * COIN});
+    vector<CTransaction*> vTxs = {&parent, &child1, &child2, &grandchild};
+
+    auto checkEmpty = [&]() {
+        BOOST_CHECK_EQUAL(pool.nUsage, 0U);
+        BOOST_CHECK_EQUAL(pool.nFractionsUsage, 0U);
+        BOOST_CHECK_EQUAL(pool.nBytes, 0U);
+        BOOST_CHECK(pool.mapPackedFractions.empty());
+        BOOST_CHECK(pool.mapEntries.empty());
+        BOOST_CHECK(pool.setByAncestorFeeRate.empty());
+        BOOST_CHECK(pool.setByDescendantScore.empty());
+        BOOST_CHECK(pool.setByTime.empty());
+    };
+
+    // mined one by one
+    size_t nUsage = 0;
+    for (CTransaction* ptx : vTxs) {
+        nUsage += UsageOf(*ptx, 10000);
+        BOOST_CHECK(AddTx(pool, *ptx, 10000));
+    }
+    BOOST_CHECK(pool.nUsage > 0 && pool.nFractionsUsage > 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nUsage);
+    for (CTransaction* ptx : vTxs)
+        BOOST_CHECK(pool.remove(*ptx));
+    checkEmpty();
+
+    // evicted as one package
+    for (CTransaction* ptx : vTxs)
+        BOOST_CHECK(AddTx(pool, *ptx, 10000));
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nUsage);
+    BOOST_CHECK_EQUAL(pool.TrimToSize(0), vTxs.size());
+    checkEmpty();
+}
+
+BOOST_AUTO_TEST_CASE(mempool_full_rejects_lowest)
+{
+    CTxMemPool   pool;
+    CTransaction txA    = MakeTx({COutPoint(uint256(1), 0)}, {COIN});
+    CTransaction txB    = MakeTx({COutPoint(uint256(2), 0)}, {COIN});
+    CTransaction txLow  = MakeTx({COutPoint(uint256(3), 0)}, {COIN});
+    CTransaction txHigh = MakeTx({COutPoint(uint256(4), 0)}, {COIN});
+    BOOST_CHECK(AddTx(pool, txA, 10000));
+    BOOST_CHECK(AddTx(pool, txB, 20000));
+    size_t nUsage = pool.DynamicMemoryUsage();
+
+    // no room for one more: the new tx has the lowest score and goes
+    BOOST_CHECK(!AddTx(pool, txLow, 1000, nUsage + UsageOf(txLow, 1000) - 1));
+    BOOST_CHECK(!pool.exists(txLow.GetHash()));
+    BOOST_CHECK(pool.exists(txA.GetHash()));
+    BOOST_CHECK(pool.exists(txB.GetHash()));
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nUsage);
+
+    // a better paying one takes the place of the lowest in the pool
+    BOOST_CHECK(AddTx(pool, txHigh, 50000, nUsage + UsageOf(txHigh, 50000) - 1));
+    BOOST_CHECK(pool.exists(txHigh.GetHash()));
+    BOOST_CHECK(!pool.exists(txA.GetHash()));
+    BOOST_CHECK(pool.exists(txB.GetHash()));
+    CheckIndexes(pool);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
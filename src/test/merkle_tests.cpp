@@ -14,6 +14,8 @@
 
 #include "pegdata.h"
 #include "peg.h"
+#include "util.h"
+#include "utilstrencodings.h"
 
 #define ok(ethcop) BOOST_CHECK(ethcop >= 0)
 
@@ -464,4 +466,98 @@ BOOST_AUTO_TEST_CASE(merkle_r3)
 }
 
 
+BOOST_AUTO_TEST_CASE(merkle_bin_leaf)
+{
+    // same leaf as merkle_x1 leaf1, encoded without hex round trips
+    std::string addr = "0x93AAfed0319B064De0acC8233283F293eE6aa8e0";
+    std::string txid = "868f1a68b5c405c1aada5bd040d8d291e20ba119c7e81af285a7d90ac14b313f:1";
+    std::vector<int64_t> cfs{0, 2285064261L, 1528644339, 1022619876, 684103824, 457646172, 306152323, 204807256, 95177528, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 505719484, 480934199, 457363637, 434948244, 413631447, 393359383, 374080856, 355747171};
+    CCompressedFractions cfr(cfs, 0, 30, 8);
+
+    MerkleHash leaf;
+    BOOST_CHECK(ComputeBurnMerkleLeaf(addr, cfr, txid, leaf));
+    BOOST_CHECK(HexStr(leaf.begin(), leaf.end()) == "2717fa101ab8ae201e9d852b0522cc7f3486494557b48af679ed1864a407fca0");
+
+    // mint leaves, vectors from the libethc encoder which this one replaces
+    std::string from_hex = "93aafed0319b064de0acc8233283f293ee6aa8e0";
+    std::vector<unsigned char> from = ParseHex(from_hex);
+    std::vector<int64_t> sections(cfs.begin(), cfs.end());
+    std::string leaf_hex;
+    BOOST_CHECK(ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", sections, 7, 3, "0x" + from_hex, leaf_hex));
+    BOOST_CHECK(leaf_hex == "e1d64dca0daa673049e2dc51a40c9ff7b90c60c25cf67bb740c202b3efa31d1f");
+    MerkleHash leaf_bin;
+    BOOST_CHECK(ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", sections, 7, 3, from, leaf_bin));
+    BOOST_CHECK(HexStr(leaf_bin.begin(), leaf_bin.end()) == "e1d64dca0daa673049e2dc51a40c9ff7b90c60c25cf67bb740c202b3efa31d1f");
+
+    // invalid sender is skipped, no address word
+    BOOST_CHECK(ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", sections, 7, 3, "0x93aa", leaf_hex));
+    BOOST_CHECK(leaf_hex == "7af4978291d3ce08a5d7ee32621177afa8039299537a8510ab9da42bd5129701");
+    BOOST_CHECK(ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", sections, 7, 3, std::vector<unsigned char>(), leaf_bin));
+    BOOST_CHECK(HexStr(leaf_bin.begin(), leaf_bin.end()) == "7af4978291d3ce08a5d7ee32621177afa8039299537a8510ab9da42bd5129701");
+
+    // more than 128 abi words, beyond the libethc frame buffer
+    std::vector<int64_t> many_sections;
+    for (int i = 0; i < 200; i++)
+        many_sections.push_back(int64_t(i) * 1000003);
+    BOOST_CHECK(ComputeMintMerkleLeaf("bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty", many_sections, 150, 5, from, leaf_bin));
+    BOOST_CHECK(HexStr(leaf_bin.begin(), leaf_bin.end()) == "aad77ed9a50f93351981062cf1130e29c0e5e6d11363b927584ae224371613cb");
+}
+
+static MerkleHash merkle_hash_from_hex(const std::string& hex)
+{
+    std::vector<unsigned char> vch = ParseHex(hex);
+    MerkleHash h;
+    std::copy(vch.begin(), vch.end(), h.begin());
+    return h;
+}
+
+BOOST_AUTO_TEST_CASE(merkle_bin_root)
+{
+    MerkleHash leaf = merkle_hash_from_hex("196f07b6a6c4ffce308dcd52718709d7d004e880b28d5137ce031b615677516e");
+    vector<MerkleHash> proofs;
+    proofs.push_back(merkle_hash_from_hex("5b65a8bab16f67b9ac7d236b1742ee7f51c609a1c9397436a36999c9c5d2fbd2"));
+    proofs.push_back(merkle_hash_from_hex("ecc84858472abcf7fcff03be2e00eb2f37fca8e2e2f6f40461ef25777c64bbd1"));
+    proofs.push_back(merkle_hash_from_hex("d1654ca022398e95c7c430b13d6a61d46840fe8eaae1e4fd0221ca96dead1fde"));
+
+    MerkleHash root;
+    BOOST_CHECK(ComputeMintMerkleRoot(leaf, proofs, root));
+    BOOST_CHECK(HexStr(root.begin(), root.end()) == "28b2bc124313241cbe20f357409bd3fa05d867345796adae1c836c49651712d5");
+
+    // proof equal to the branch can not match
+    proofs.push_back(root);
+    BOOST_CHECK(!ComputeMintMerkleRoot(leaf, proofs, root));
+}
+
+BOOST_AUTO_TEST_CASE(merkle_batch_tree)
+{
+    // same root and paths as merklecpp for any leaves count
+    for (size_t n = 1; n <= 130; n++) {
+        vector<MerkleHash> leaves(n);
+        merkle::TreeT<32, sha256_keccak> tree;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t seed = n * 1000 + i;
+            eth_keccak256(leaves[i].data(), (uint8_t*)&seed, sizeof(seed));
+            tree.insert(leaves[i].data());
+        }
+        CMerkleBatchTree batch;
+        batch.Build(leaves);
+        const MerkleHash& root = batch.Root();
+        BOOST_CHECK(HexStr(root.begin(), root.end()) == tree.root().to_string());
+        vector<MerkleHash> proofs;
+        for (size_t i = 0; i < n; i++) {
+            auto path = tree.path(i);
+            batch.Path(i, proofs);
+            BOOST_CHECK_EQUAL(proofs.size(), path->size());
+            size_t j = 0;
+            for (const auto& elm : *path) {
+                BOOST_CHECK(j < proofs.size() && HexStr(proofs[j].begin(), proofs[j].end()) == elm.hash.to_string());
+                j++;
+            }
+            MerkleHash proof_root;
+            BOOST_CHECK(ComputeMintMerkleRoot(leaves[i], proofs, proof_root));
+            BOOST_CHECK(proof_root == root);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
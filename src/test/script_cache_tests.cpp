@@ -0,0 +1,81 @@
+#include <boost/test/unit_test.hpp>
+
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(script_cache_tests)
+
+// pay to key hash scripts, all sharing the 76a914 prefix
+static CScript P2PKHScript(uint32_t n)
+{
+    vector<unsigned char> vchHash(20, 0);
+    for (int i = 0; i < 4; i++)
+        vchHash[16 + i] = (unsigned char)(n >> (24 - 8 * i));
+    CScript script;
+    script << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG;
+    return script;
+}
+
+static string AddressOf(uint32_t n)
+{
+    return "addr" + to_string(n);
+}
+
+BOOST_AUTO_TEST_CASE(script_cache_hit_miss)
+{
+    CScriptAddressCache cache;
+    string              sAddress;
+    uint64_t            nHits, nMisses;
+
+    BOOST_CHECK(!cache.Get(P2PKHScript(1), sAddress));
+    cache.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 0U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+
+    cache.Set(P2PKHScript(1), AddressOf(1));
+    BOOST_CHECK(cache.Get(P2PKHScript(1), sAddress));
+    BOOST_CHECK_EQUAL(sAddress, AddressOf(1));
+    BOOST_CHECK(!cache.Get(P2PKHScript(2), sAddress));
+    BOOST_CHECK_EQUAL(sAddress, AddressOf(1));
+
+    cache.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(script_cache_eviction)
+{
+    const int    nMax     = 16;
+    const string sOldSize = GetArg("-maxaddrcachesize", "");
+    mapArgs["-maxaddrcachesize"] = to_string(nMax);
+
+    CScriptAddressCache cache;
+    string              sAddress;
+    for (uint32_t n = 0; n < 2 * nMax; n++) {
+        cache.Set(P2PKHScript(n), AddressOf(n));
+        BOOST_CHECK(cache.Size() <= size_t(nMax));
+        BOOST_CHECK(cache.Get(P2PKHScript(n), sAddress));
+        BOOST_CHECK_EQUAL(sAddress, AddressOf(n));
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), size_t(nMax));
+
+    // evicting the smallest key each time would leave only the newest
+    // scripts, a random pick keeps some of the first ones (all of them
+    // gone is a 16!/16^16 chance)
+    int nFirstKept = 0;
+    for (uint32_t n = 0; n < nMax; n++) {
+        if (cache.Get(P2PKHScript(n), sAddress))
+            nFirstKept++;
+    }
+    BOOST_CHECK(nFirstKept > 0);
+
+    if (sOldSize.empty())
+        mapArgs.erase("-maxaddrcachesize");
+    else
+        mapArgs["-maxaddrcachesize"] = sOldSize;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
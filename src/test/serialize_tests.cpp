@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include "main.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -43,4 +44,48 @@ BOOST_AUTO_TEST_CASE(varints)
 
 }
 
+BOOST_AUTO_TEST_CASE(hash_cache)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = 1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000;
+    BOOST_CHECK(!tx.fHashCached);
+    uint256 hashTx = tx.GetHash();
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    CTransaction txRead;
+    ss >> txRead;
+    BOOST_CHECK(txRead.fHashCached);
+    BOOST_CHECK(txRead.GetHash() == hashTx);
+
+    CTransaction txCopy(txRead);
+    BOOST_CHECK(txCopy.GetHash() == hashTx);
+    txCopy.ClearHashCache();
+    txCopy.vout[0].nValue = 2000;
+    BOOST_CHECK(txCopy.GetHash() != hashTx);
+    BOOST_CHECK(txCopy.GetHash() == SerializeHash(txCopy));
+
+    CBlock block;
+    block.nVersion = CBlock::CURRENT_VERSION;
+    block.nBits    = 1;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock    = block.GetHash();
+    BOOST_CHECK(!block.fHashCached);
+
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    CBlock blockRead;
+    ssBlock >> blockRead;
+    BOOST_CHECK(!blockRead.fHashCached);
+    BOOST_CHECK(blockRead.GetHash() == hashBlock);
+    BOOST_CHECK(blockRead.fHashCached);
+    blockRead.nNonce++;
+    blockRead.ClearHashCache();
+    BOOST_CHECK(blockRead.GetHash() != hashBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
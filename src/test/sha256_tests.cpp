@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "main.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(sha256_tests)
+
+// every combination of the instruction set extensions, those the cpu lacks are skipped anyway
+static const unsigned int nDisableMasks = SHA256_USE_SSE41 | SHA256_USE_AVX2 | SHA256_USE_SHANI;
+
+static string SHA256Hex(const string& data, size_t nSplit) {
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256 sha;
+    nSplit = std::min(nSplit, data.size());
+    sha.Write((const unsigned char*)data.data(), nSplit);
+    sha.Write((const unsigned char*)data.data() + nSplit, data.size() - nSplit);
+    sha.Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+BOOST_AUTO_TEST_CASE(sha256_vectors)
+{
+    string million(1000000, 'a');
+    for (unsigned int nDisable = 0; nDisable <= nDisableMasks; nDisable++) {
+        SHA256AutoDetect(nDisable);
+        for (size_t nSplit : {0, 1, 63, 64, 65, 1000}) {
+            BOOST_CHECK_EQUAL(SHA256Hex("", nSplit),
+                              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+            BOOST_CHECK_EQUAL(SHA256Hex("abc", nSplit),
+                              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+            BOOST_CHECK_EQUAL(SHA256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                                        nSplit),
+                              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+            BOOST_CHECK_EQUAL(SHA256Hex(million, nSplit),
+                              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        }
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64_matches_hash)
+{
+    for (unsigned int nDisable = 0; nDisable <= nDisableMasks; nDisable++) {
+        SHA256AutoDetect(nDisable);
+        // covers the 8 and 4 lane batches and the single input tail
+        for (size_t n = 0; n <= 33; n++) {
+            vector<unsigned char> in(64 * n), out(32 * n);
+            for (size_t i = 0; i < in.size(); i++)
+                in[i] = (unsigned char)(i * 7 + n * 13 + nDisable);
+            SHA256D64(out.data(), in.data(), n);
+            for (size_t i = 0; i < n; i++) {
+                uint256 hash = Hash(in.begin() + 64 * i, in.begin() + 64 * (i + 1));
+                BOOST_CHECK(memcmp(hash.begin(), &out[32 * i], 32) == 0);
+            }
+        }
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(sha256_merkle_root)
+{
+    for (int n = 1; n <= 40; n++) {
+        vector<uint256> vTxHashes;
+        for (int i = 0; i < n; i++)
+            vTxHashes.push_back(Hash(BEGIN(i), END(i)));
+
+        // the pairwise tree as built before the batched hashing
+        vector<uint256> vTree = vTxHashes;
+        int j = 0;
+        for (int nSize = n; nSize > 1; nSize = (nSize + 1) / 2) {
+            for (int i = 0; i < nSize; i += 2) {
+                int i2 = std::min(i + 1, nSize - 1);
+                vTree.push_back(Hash(BEGIN(vTree[j + i]), END(vTree[j + i]),
+                                     BEGIN(vTree[j + i2]), END(vTree[j + i2])));
+            }
+            j += nSize;
+        }
+
+        CBlock block;
+        BOOST_CHECK(block.BuildMerkleTree(vTxHashes) == vTree.back());
+        BOOST_CHECK(block.vMerkleTree == vTree);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,479 @@
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "chainparams.h"
+#include "main.h"
+#include "pegdb-leveldb.h"
+#include "serialize.h"
+#include "txdb-leveldb.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(txdb_tests)
+
+static const string sAddr1 = "bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9ty";
+static const string sAddr2 = "bMmZDpZAVPmfxHqMmkhuUJmfE3GLMzL9tz";
+
+// keys are written to leveldb as serialized strings
+static string DiskKey(const string& sKey)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << sKey;
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(txdb_key_txout_roundtrip)
+{
+    const uint320 vTxouts[] = {
+        uint320(),
+        uint320(uint256("868f1a68b5c405c1aada5bd040d8d291e20ba119c7e81af285a7d90ac14b313f"), 1),
+        uint320(uint256("00000000000000000000000000000000000000000000000000000000000000ff"), 0xffffffffffffULL),
+        uint320_MAX,
+    };
+    for (const uint320& txoutid : vTxouts) {
+        string sKey = CTxDB::TxoutKey(CTxDB::DBKEY_UTXO, sAddr1, txoutid);
+        BOOST_CHECK_EQUAL(sKey.size(), 1 + sAddr1.size() + 40);
+        BOOST_CHECK_EQUAL(sKey[0], char(CTxDB::DBKEY_UTXO));
+        BOOST_CHECK(CTxDB::ParseKeyTxout(sKey, 1 + sAddr1.size()) == txoutid);
+        // bytes in GetHex() order, same ordering as the former hex text keys
+        BOOST_CHECK_EQUAL(HexStr(sKey.begin() + 1 + sAddr1.size(), sKey.end()), txoutid.GetHex());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(txdb_key_be64_roundtrip)
+{
+    const uint64_t vValues[] = {0, 1, 0xff, 0x100, 1400000000, 0x0123456789abcdefULL, INT64_MAX,
+                                UINT64_MAX};
+    for (uint64_t n : vValues) {
+        string sKey = CTxDB::FrozenQueueKey(n, uint320());
+        BOOST_CHECK_EQUAL(sKey.size(), 1 + 8 + 40);
+        BOOST_CHECK_EQUAL(CTxDB::ParseKeyBE64(sKey, 1), n);
+    }
+    const int64_t vIndexes[] = {0, 1, 255, 256, 123456789, INT64_MAX};
+    for (int64_t nIndex : vIndexes) {
+        string sKey = CTxDB::BalanceKey(sAddr1, nIndex);
+        BOOST_CHECK_EQUAL(sKey.size(), 1 + sAddr1.size() + 8);
+        BOOST_CHECK_EQUAL(INT64_MAX - int64_t(CTxDB::ParseKeyBE64(sKey, 1 + sAddr1.size())), nIndex);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(txdb_key_balance_order)
+{
+    // the last balance record of an address comes first in a scan
+    const int64_t vIndexes[] = {0, 1, 255, 256, 65536, 123456789, INT64_MAX - 1};
+    for (size_t i = 1; i < sizeof(vIndexes) / sizeof(vIndexes[0]); i++) {
+        string sOlder = CTxDB::BalanceKey(sAddr1, vIndexes[i - 1]);
+        string sNewer = CTxDB::BalanceKey(sAddr1, vIndexes[i]);
+        BOOST_CHECK(sNewer < sOlder);
+        BOOST_CHECK(DiskKey(sNewer) < DiskKey(sOlder));
+        // the scan start key sorts before every record of the address
+        BOOST_CHECK(DiskKey(CTxDB::BalanceKey(sAddr1, INT64_MAX)) <= DiskKey(sNewer));
+    }
+    // and all records of an address come before those of the next one
+    BOOST_CHECK(DiskKey(CTxDB::BalanceKey(sAddr1, 0)) < DiskKey(CTxDB::BalanceKey(sAddr2, INT64_MAX)));
+}
+
+BOOST_AUTO_TEST_CASE(txdb_key_frozen_queue_range)
+{
+    // ReadFrozenQueue takes [FrozenQueueKey(0, 0), FrozenQueueKey(nLockTime, max)]
+    const uint64_t nLockTime = 1500000000;
+    string sMin = DiskKey(CTxDB::FrozenQueueKey(0, uint320()));
+    string sMax = DiskKey(CTxDB::FrozenQueueKey(nLockTime, uint320_MAX));
+
+    const uint320 txoutid(uint256("868f1a68b5c405c1aada5bd040d8d291e20ba119c7e81af285a7d90ac14b313f"), 1);
+    const uint64_t vIn[] = {0, 1, 256, nLockTime - 1, nLockTime};
+    for (uint64_t n : vIn) {
+        string sKey = DiskKey(CTxDB::FrozenQueueKey(n, txoutid));
+        BOOST_CHECK(sMin <= sKey && sKey <= sMax);
+    }
+    const uint64_t vOut[] = {nLockTime + 1, nLockTime + 256, uint64_t(1) << 40, UINT64_MAX};
+    for (uint64_t n : vOut) {
+        string sKey = DiskKey(CTxDB::FrozenQueueKey(n, uint320()));
+        BOOST_CHECK(sKey > sMax);
+    }
+    // lock time orders first, txoutid within the same lock time
+    BOOST_CHECK(CTxDB::FrozenQueueKey(255, uint320_MAX) < CTxDB::FrozenQueueKey(256, uint320()));
+    BOOST_CHECK(CTxDB::FrozenQueueKey(256, uint320(1)) < CTxDB::FrozenQueueKey(256, uint320(2)));
+}
+
+#ifndef WIN32
+// A txdb in a temporary data dir with a short chain in mapBlockIndex
+struct BlockIndexSnapshotSetup {
+    boost::filesystem::path pathTemp;
+    vector<uint256>         vHashes;
+
+    BlockIndexSnapshotSetup() {
+        pathTemp = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("test_bitbay_%%%%%%%%");
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        ClearDatadirCache();
+        CTxDB txdb("cr+");
+        for (int i = 0; i < 10; i++)
+            vHashes.push_back(Hash(BEGIN(i), END(i)));
+        Build();
+    }
+
+    ~BlockIndexSnapshotSetup() {
+        Clear();
+        hashBestChain = 0;
+        CTxDB().Close();
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+
+    void Build() {
+        Clear();
+        CBlockIndex* pindexPrev = NULL;
+        for (size_t i = 0; i < vHashes.size(); i++) {
+            CBlockIndex* pindex     = new CBlockIndex();
+            pindex->phashBlock      = &mapBlockIndex.insert(vHashes[i], pindex).first->first;
+            pindex->nHeight         = i;
+            pindex->nFile           = 1;
+            pindex->nBlockPos       = 1000 * i;
+            pindex->nMoneySupply    = i * COIN;
+            pindex->nPegSupplyIndex = i;
+            pindex->nTime           = 1400000000 + 64 * i;
+            if (pindexPrev) {
+                pindex->SetPrev(pindexPrev);
+                pindexPrev->SetNext(pindex);
+            }
+            pindexPrev = pindex;
+        }
+        hashBestChain = vHashes.back();
+        CTxDB().WriteHashBestChain(hashBestChain);
+    }
+
+    void Clear() {
+        for (const auto& item : mapBlockIndex)
+            delete item.second;
+        mapBlockIndex.clear();
+        pindexGenesisBlock = NULL;
+    }
+
+    bool Read() {
+        Clear();
+        return CTxDB().ReadBlockIndexSnapshot([](const string&) {});
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(txdb_blockindex_snapshot_roundtrip, BlockIndexSnapshotSetup)
+{
+    BOOST_CHECK(CTxDB().WriteBlockIndexSnapshot());
+    BOOST_CHECK(Read());
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), vHashes.size());
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        auto mi = mapBlockIndex.find(vHashes[i]);
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        const CBlockIndex* pindex = mi->second;
+        BOOST_CHECK(pindex->GetBlockHash() == vHashes[i]);
+        BOOST_CHECK_EQUAL(pindex->nHeight, int(i));
+        BOOST_CHECK_EQUAL(pindex->nBlockPos, 1000 * i);
+        BOOST_CHECK_EQUAL(pindex->nMoneySupply, int64_t(i) * COIN);
+        BOOST_CHECK_EQUAL(pindex->nPegSupplyIndex, int(i));
+        BOOST_CHECK_EQUAL(pindex->nTime, 1400000000 + 64 * i);
+        BOOST_CHECK(i == 0 ? !pindex->Prev() : pindex->Prev()->GetBlockHash() == vHashes[i - 1]);
+        BOOST_CHECK(i + 1 == vHashes.size() ? !pindex->Next()
+                                            : pindex->Next()->GetBlockHash() == vHashes[i + 1]);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(txdb_blockindex_snapshot_stale, BlockIndexSnapshotSetup)
+{
+    // the best chain moved on after the snapshot
+    BOOST_CHECK(CTxDB().WriteBlockIndexSnapshot());
+    CTxDB().WriteHashBestChain(vHashes.front());
+    BOOST_CHECK(!Read());
+    BOOST_CHECK(mapBlockIndex.empty());
+
+    // a block index record was written after the snapshot
+    Build();
+    BOOST_CHECK(CTxDB().WriteBlockIndexSnapshot());
+    CTxDB().WriteBlockIndex(CDiskBlockIndex(mapBlockIndex.find(vHashes.back())->second));
+    BOOST_CHECK(!Read());
+    BOOST_CHECK(mapBlockIndex.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(txdb_blockindex_snapshot_corrupt, BlockIndexSnapshotSetup)
+{
+    boost::filesystem::path path = GetDataDir() / "blkindex.snap";
+
+    // one bit flipped in the first record
+    BOOST_CHECK(CTxDB().WriteBlockIndexSnapshot());
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, 100, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, 100, SEEK_SET);
+    fputc(ch ^ 0x01, file);
+    fclose(file);
+    BOOST_CHECK(!Read());
+    BOOST_CHECK(mapBlockIndex.empty());
+
+    // truncated
+    Build();
+    BOOST_CHECK(CTxDB().WriteBlockIndexSnapshot());
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) / 2);
+    BOOST_CHECK(!Read());
+    BOOST_CHECK(mapBlockIndex.empty());
+}
+// Adds a peg db and a peg start height to the temporary data dir
+struct PegBalanceRebuildSetup : public BlockIndexSnapshotSetup {
+    int nPegStartHeightOld;
+
+    PegBalanceRebuildSetup() {
+        nPegStartHeightOld = nPegStartHeight;
+        nPegStartHeight    = 100;
+        CPegDB pegdb("cr+");
+    }
+
+    ~PegBalanceRebuildSetup() {
+        nPegStartHeight = nPegStartHeightOld;
+        CPegDB().Close();
+    }
+};
+
+// fractions of a peg era txout, not shaped like the value of its amount
+static CFractions TestPegFractions(int n)
+{
+    CFractions fractions(0, CFractions::STD);
+    for (int i = 0; i < PEG_SIZE; i++)
+        fractions.f[i] = (i * 7 + n * 13) % 1000;
+    return fractions;
+}
+
+static bool SamePegBalance(const CFractions& a, const CFractions& b)
+{
+    CFractions aStd = a.Std();
+    CFractions bStd = b.Std();
+    for (int i = 0; i < PEG_SIZE; i++) {
+        if (aStd.f[i] != bStd.f[i])
+            return false;
+    }
+    return a.Total() == b.Total();
+}
+
+static int FindUtxoLoadShard(CTxDB& txdb, const string& sAddress)
+{
+    int nShards = 0;
+    BOOST_REQUIRE(txdb.ReadUtxoLoadShards(nShards));
+    for (int i = 0; i < nShards; i++) {
+        CUtxoLoadShard shard;
+        BOOST_REQUIRE(txdb.ReadUtxoLoadShard(i, shard));
+        if (shard.sBegin <= sAddress && (shard.sEnd.empty() || sAddress < shard.sEnd))
+            return i;
+    }
+    return -1;
+}
+
+BOOST_FIXTURE_TEST_CASE(txdb_pegbalance_rebuild_resume, PegBalanceRebuildSetup)
+{
+    // addresses under different leading chars end up in different shards
+    const vector<string> vAddresses = {
+        "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2", sAddr1, sAddr2,
+        "zQ8ukGVb4VK2ePcvHxZDYuTFsn6UmSZBgN", Params().PegInflateAddr(),
+        Params().PegDeflateAddr(), Params().PegNochangeAddr(),
+    };
+    set<string> setSkip = {Params().PegInflateAddr(), Params().PegDeflateAddr(),
+                           Params().PegNochangeAddr()};
+
+    CTxDB                   txdb("r+");
+    CPegDB                  pegdb("r+");
+    map<string, CFractions> mapExpected;
+    int                     n = 0;
+    for (const string& sAddress : vAddresses) {
+        CFractions& expected = mapExpected[sAddress];
+        expected             = CFractions(0, CFractions::VALUE);
+        for (int i = 0; i < 4; i++, n++) {
+            CAddressUnspent unspent;
+            unspent.txoutid = uint320(Hash(BEGIN(n), END(n)), i);
+            unspent.nIndex  = i;
+            // the first two are before the peg start
+            unspent.nHeight = nPegStartHeight - 2 + i;
+            CFractions fractions(100 * COIN + n, CFractions::VALUE);
+            if (unspent.nHeight >= nPegStartHeight) {
+                fractions = TestPegFractions(n);
+                BOOST_CHECK(pegdb.WriteFractions(unspent.txoutid, fractions));
+                if (setSkip.count(sAddress))
+                    fractions = CFractions(fractions.Total(), CFractions::VALUE);
+            }
+            unspent.nAmount = fractions.Total();
+            BOOST_CHECK(txdb.AddUnspent(sAddress, unspent.txoutid, unspent));
+            expected += fractions;
+        }
+    }
+
+    auto load_msg = [](const string&) {};
+    auto check    = [&]() {
+        for (const string& sAddress : vAddresses) {
+            CFractions pegbalance;
+            BOOST_CHECK(txdb.ReadPegBalance(sAddress, pegbalance));
+            BOOST_CHECK_MESSAGE(SamePegBalance(pegbalance, mapExpected[sAddress]), sAddress);
+        }
+    };
+
+    BOOST_CHECK(txdb.RebuildPegBalances(load_msg));
+    check();
+    int nShards = 0;
+    BOOST_CHECK(txdb.ReadUtxoLoadShards(nShards));
+    set<int> setShards;
+    for (const string& sAddress : vAddresses)
+        setShards.insert(FindUtxoLoadShard(txdb, sAddress));
+    BOOST_CHECK(setShards.size() >= 2);
+    BOOST_CHECK(!setShards.count(-1));
+
+    // the state an interrupted run leaves: a shard done up to sAddr1, one
+    // not started, balances past the checkpoints not yet written
+    const string   sAddr3  = vAddresses[3];
+    int            nShard1 = FindUtxoLoadShard(txdb, sAddr1);
+    int            nShard2 = FindUtxoLoadShard(txdb, sAddr3);
+    CUtxoLoadShard shard;
+    BOOST_REQUIRE(nShard1 != nShard2);
+    BOOST_CHECK(txdb.ReadUtxoLoadShard(nShard1, shard));
+    shard.sLast = sAddr1;
+    shard.fDone = false;
+    BOOST_CHECK(txdb.WriteUtxoLoadShard(nShard1, shard));
+    BOOST_CHECK(txdb.ReadUtxoLoadShard(nShard2, shard));
+    shard.sLast.clear();
+    shard.fDone = false;
+    BOOST_CHECK(txdb.WriteUtxoLoadShard(nShard2, shard));
+    for (const string& sAddress : vAddresses) {
+        if (sAddress > sAddr1 && FindUtxoLoadShard(txdb, sAddress) == nShard1)
+            BOOST_CHECK(txdb.WritePegBalance(sAddress, CFractions(1, CFractions::VALUE)));
+        if (FindUtxoLoadShard(txdb, sAddress) == nShard2)
+            BOOST_CHECK(txdb.WritePegBalance(sAddress, CFractions(1, CFractions::VALUE)));
+    }
+
+    BOOST_CHECK(txdb.RebuildPegBalances(load_msg));
+    check();
+    for (int i = 0; i < nShards; i++) {
+        BOOST_CHECK(txdb.ReadUtxoLoadShard(i, shard));
+        BOOST_CHECK(shard.fDone);
+    }
+}
+// One step of the address updates of a block: a peg balance change or a
+// balance record
+struct AddressUpdate {
+    enum { DEDUCT, APPEND, BALANCE } op;
+    string     sAddress;
+    CFractions fractions;
+    bool       peg_on;
+    int64_t    nIndex;
+};
+
+static void ApplyAddressUpdates(CTxDB&                       txdb,
+                                CAddressBlockOverlay*        poverlay,
+                                const vector<AddressUpdate>& vUpdates)
+{
+    BOOST_REQUIRE(txdb.TxnBegin());
+    for (const AddressUpdate& update : vUpdates) {
+        CAddressBalance balance;
+        balance.nIndex   = update.nIndex;
+        balance.nHeight  = 200 + update.nIndex;
+        balance.nCredit  = update.nIndex * COIN;
+        balance.nBalance = (update.nIndex + 1) * COIN;
+        switch (update.op) {
+        case AddressUpdate::DEDUCT:
+            BOOST_CHECK(poverlay ? poverlay->DeductSpent(txdb, update.sAddress, update.fractions,
+                                                         update.peg_on)
+                                 : txdb.DeductSpent(update.sAddress, update.fractions,
+                                                    update.peg_on));
+            break;
+        case AddressUpdate::APPEND:
+            BOOST_CHECK(poverlay ? poverlay->AppendUnspent(txdb, update.sAddress,
+                                                           update.fractions, update.peg_on)
+                                 : txdb.AppendUnspent(update.sAddress, update.fractions,
+                                                      update.peg_on));
+            break;
+        case AddressUpdate::BALANCE:
+            BOOST_CHECK(poverlay ? poverlay->AddBalance(txdb, update.sAddress, update.nIndex,
+                                                        balance)
+                                 : txdb.AddBalance(update.sAddress, update.nIndex, balance));
+            break;
+        }
+    }
+    if (poverlay)
+        BOOST_CHECK(poverlay->Flush(txdb));
+    BOOST_REQUIRE(txdb.TxnCommit());
+}
+
+// peg balance and last balance record of an address as stored
+static string AddressState(CTxDB& txdb, const string& sAddress)
+{
+    CDataStream     ss(SER_DISK, CLIENT_VERSION);
+    CFractions      pegbalance;
+    CAddressBalance balance;
+    int64_t         nIdx = -1;
+    BOOST_CHECK(txdb.ReadPegBalance(sAddress, pegbalance));
+    pegbalance.Pack(ss, nullptr, false /*compress*/);
+    if (txdb.ReadAddressLastBalance(sAddress, balance, nIdx))
+        ss << balance;
+    ss << nIdx;
+    return ss.str();
+}
+
+BOOST_FIXTURE_TEST_CASE(txdb_address_overlay_same_as_direct, BlockIndexSnapshotSetup)
+{
+    const string sAddr3 = "zQ8ukGVb4VK2ePcvHxZDYuTFsn6UmSZBgN";
+    const vector<string> vAddresses = {sAddr1, sAddr2, sAddr3};
+
+    CFractions fractions1 = TestPegFractions(1);
+    CFractions fractions2 = TestPegFractions(2);
+    CFractions fractions3 = TestPegFractions(3);
+    CFractions value(500 * COIN, CFractions::VALUE);
+    CFractions valueSpent(120 * COIN, CFractions::VALUE);
+
+    vector<AddressUpdate> vUpdates = {
+        {AddressUpdate::APPEND, sAddr1, fractions1, true, 0},
+        {AddressUpdate::DEDUCT, sAddr1, fractions2, true, 0},
+        {AddressUpdate::BALANCE, sAddr1, CFractions(), true, 1},
+        {AddressUpdate::APPEND, sAddr2, value, false, 0},
+        {AddressUpdate::DEDUCT, sAddr2, valueSpent, false, 0},
+        {AddressUpdate::BALANCE, sAddr2, CFractions(), true, 0},
+        {AddressUpdate::APPEND, sAddr1, fractions3, true, 0},
+        {AddressUpdate::APPEND, sAddr2, fractions1, true, 0},
+        {AddressUpdate::BALANCE, sAddr2, CFractions(), true, 1},
+        {AddressUpdate::DEDUCT, sAddr3, fractions2, true, 0},
+        {AddressUpdate::APPEND, sAddr1, value, false, 0},
+        {AddressUpdate::DEDUCT, sAddr1, fractions1, true, 0},
+        {AddressUpdate::BALANCE, sAddr1, CFractions(), true, 2},
+        {AddressUpdate::APPEND, sAddr3, fractions3, true, 0},
+    };
+
+    // state before the block: sAddr1 has a peg balance and a balance record
+    CTxDB           txdb("r+");
+    CAddressBalance balance;
+    balance.nBalance = 1000 * COIN;
+    BOOST_CHECK(txdb.WritePegBalance(sAddr1, fractions3));
+    BOOST_CHECK(txdb.AddBalance(sAddr1, 0, balance));
+    map<string, string> mapBefore;
+    for (const string& sAddress : vAddresses)
+        mapBefore[sAddress] = AddressState(txdb, sAddress);
+
+    ApplyAddressUpdates(txdb, NULL, vUpdates);
+    map<string, string> mapDirect;
+    for (const string& sAddress : vAddresses)
+        mapDirect[sAddress] = AddressState(txdb, sAddress);
+
+    // back to the state before the block
+    BOOST_CHECK(txdb.WritePegBalance(sAddr1, fractions3));
+    BOOST_CHECK(txdb.WritePegBalance(sAddr2, CFractions(0, CFractions::VALUE)));
+    BOOST_CHECK(txdb.WritePegBalance(sAddr3, CFractions(0, CFractions::VALUE)));
+    for (const AddressUpdate& update : vUpdates) {
+        if (update.op == AddressUpdate::BALANCE)
+            BOOST_CHECK(txdb.EraseBalance(update.sAddress, update.nIndex));
+    }
+    for (const string& sAddress : vAddresses)
+        BOOST_CHECK(AddressState(txdb, sAddress) == mapBefore[sAddress]);
+
+    CAddressBlockOverlay overlay;
+    ApplyAddressUpdates(txdb, &overlay, vUpdates);
+    BOOST_CHECK_EQUAL(overlay.size(), 0U);
+    for (const string& sAddress : vAddresses)
+        BOOST_CHECK_MESSAGE(AddressState(txdb, sAddress) == mapDirect[sAddress], sAddress);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -28,20 +28,77 @@
 #include <fstream>
 #include <iostream>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 using namespace boost;
 namespace fs = boost::filesystem;
 
 leveldb::DB* txdb;  // global pointer for LevelDB object instance
 
-static leveldb::Options GetOptions() {
+static leveldb::Options    txdb_options;  // options of the global instance
+static CLevelDBCommitTimes txdb_commit_times;
+
+leveldb::Options GetLevelDBOptions(bool fPegDB) {
+	// budget covers block cache and write buffer, default keeps -dbcache per database
+	int64_t nTotalMB  = GetArg("-leveldbcache", GetArg("-dbcache", 50) * 2);
+	int64_t nBudgetMB = fPegDB ? GetArg("-pegdbcache", nTotalMB / 2)
+	                           : GetArg("-txdbcache", nTotalMB - nTotalMB / 2);
+	nBudgetMB         = std::max<int64_t>(nBudgetMB, 8);
+
+	size_t nBudget      = size_t(nBudgetMB) << 20;
+	size_t nWriteBuffer = std::min<size_t>(std::max<size_t>(nBudget / 4, 4 << 20), 64 << 20);
+
 	leveldb::Options options;
-	int              nCacheSizeMB = GetArg("-dbcache", 50);
-	options.block_cache           = leveldb::NewLRUCache(nCacheSizeMB * 1048576);
-	options.filter_policy         = leveldb::NewBloomFilterPolicy(10);
+	options.block_cache       = leveldb::NewLRUCache(nBudget - nWriteBuffer);
+	options.write_buffer_size = nWriteBuffer;
+	options.filter_policy     = leveldb::NewBloomFilterPolicy(10);
+	// fewer, larger tables: less files churn on compactions during sync
+	options.max_file_size = 8 << 20;
+	LogPrintf("%s LevelDB cache %dMB, write buffer %dMB\n", fPegDB ? "Peg" : "Tx",
+	          (nBudget - nWriteBuffer) >> 20, nWriteBuffer >> 20);
 	return options;
 }
 
+void CLevelDBCommitTimes::Add(int64_t nMicros) {
+	nCommits++;
+	nTime += nMicros;
+	int64_t nMax = nTimeMax;
+	while (nMicros > nMax && !nTimeMax.compare_exchange_weak(nMax, nMicros)) {
+	}
+}
+
+bool GetLevelDBStats(leveldb::DB*               pdb,
+                     const leveldb::Options&    options,
+                     const CLevelDBCommitTimes& times,
+                     CLevelDBStats&             stats) {
+	if (!pdb)
+		return false;
+	pdb->GetProperty("leveldb.stats", &stats.strStats);
+	string strMemory;
+	if (pdb->GetProperty("leveldb.approximate-memory-usage", &strMemory))
+		stats.nMemoryUsage = atoi64(strMemory);
+	leveldb::Range range("", string(64, '\xff'));
+	pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+	if (options.block_cache)
+		stats.nCacheUsage = options.block_cache->TotalCharge();
+	stats.nWriteBufferSize = options.write_buffer_size;
+	stats.nMaxFileSize     = options.max_file_size;
+	stats.nCommits         = times.nCommits;
+	stats.nCommitTime      = times.nTime;
+	stats.nCommitTimeMax   = times.nTimeMax;
+	return true;
+}
+
+bool CTxDB::GetStats(CLevelDBStats& stats) {
+	return GetLevelDBStats(txdb, txdb_options, txdb_commit_times, stats);
+}
+
 static void init_blockindex(leveldb::Options& options,
                             bool              fRemoveOld       = false,
                             bool              fCreateBootstrap = false) {
@@ -77,6 +134,7 @@ static void init_blockindex(leveldb::Options& options,
 		throw runtime_error(strprintf("init_blockindex(): error opening database environment %s",
 		                              status.ToString()));
 	}
+	txdb_options = options;
 }
 
 // CDB subclasses are created and destroyed VERY OFTEN. That's why
@@ -93,9 +151,8 @@ CTxDB::CTxDB(const char* pszMode) {
 
 	bool fCreate = strchr(pszMode, 'c');
 
-	options                   = GetOptions();
+	options                   = GetLevelDBOptions(false);
 	options.create_if_missing = fCreate;
-	options.filter_policy     = leveldb::NewBloomFilterPolicy(10);
 
 	init_blockindex(options);  // Init directory
 	pdb = txdb;
@@ -133,7 +190,8 @@ CTxDB::CTxDB(const char* pszMode) {
 
 void CTxDB::Close() {
 	delete txdb;
-	txdb = pdb = NULL;
+	txdb = pdb   = NULL;
+	txdb_options = leveldb::Options();
 	delete options.filter_policy;
 	options.filter_policy = NULL;
 	delete options.block_cache;
@@ -150,7 +208,9 @@ bool CTxDB::TxnBegin() {
 
 bool CTxDB::TxnCommit() {
 	assert(activeBatch);
+	int64_t         nStart = GetTimeMicros();
 	leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+	txdb_commit_times.Add(GetTimeMicros() - nStart);
 	delete activeBatch;
 	activeBatch = NULL;
 	if (!status.ok()) {
@@ -303,76 +363,196 @@ bool CTxDB::EraseTxIndex(const CTransaction& tx) {
 	return Erase(make_pair(string("tx"), hash));
 }
 
-// bool SetTxIndexesV1(CTxDB & ctxdb,
-//                     LoadMsg load_msg);
+// One-shot index migrations split the records by the first byte of their
+// serialized hash into MIGRATION_RANGES key ranges, commits every
+// MAX_MIGRATION_BATCH records carry the progress of the range.
+static const int MIGRATION_RANGES    = 16;
+static const int MAX_MIGRATION_BATCH = 10000;
 
-static bool SetTxIndexesV1(CTxDB& ctxdb, LoadMsg load_msg) {
-	if (!ctxdb.TxnBegin())
-		return error("SetTxIndexesV1() : TxnBegin failed");
+bool CTxDB::EraseIndexMigration(const std::string& strName) {
+	for (int i = 0; i < MIGRATION_RANGES; i++)
+		Erase(make_pair(string("migration"), make_pair(strName, i)));
+	return true;
+}
 
-	leveldb::Iterator* iterator = txdb->NewIterator(leveldb::ReadOptions());
-	// Seek to start key.
-	CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-	ssStartKey << make_pair(string("tx"), uint256(0));
+bool CTxDB::MigrateIndexRange(const std::string&    strType,
+                              const std::string&    strName,
+                              int                   nRange,
+                              CIndexMigrationRange& range,
+                              IndexMigrationFn      fn,
+                              std::atomic<int64_t>& nRecords,
+                              std::atomic<bool>&    fFailed) {
+	// own instance, the batch of this one is not shared between threads
+	CTxDB txdb("r+");
+
+	int nEnd = (nRange + 1) * 256 / MIGRATION_RANGES;
+	leveldb::ReadOptions options;
+	options.fill_cache          = false;
+	leveldb::Iterator* iterator = pdb->NewIterator(options);
+	CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
+	if (range.hashLast != 0)
+		ssStartKey << make_pair(strType, range.hashLast);
+	else
+		ssStartKey << make_pair(strType, uint256(nRange * 256 / MIGRATION_RANGES));
 	iterator->Seek(ssStartKey.str());
-	// Now read each entry.
-	int indexCount = 0;
-	while (iterator->Valid()) {
-		boost::this_thread::interruption_point();
-		// Unpack keys and values.
+
+	if (!txdb.TxnBegin()) {
+		delete iterator;
+		return error("MigrateIndexRange() : TxnBegin failed");
+	}
+	int  nBatch = 0;
+	bool fOk    = true;
+	while (iterator->Valid() && !fFailed) {
 		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
 		ssKey.write(iterator->key().data(), iterator->key().size());
+		string strKeyType;
+		ssKey >> strKeyType;
+		// Did we reach the end of the data to read?
+		if (strKeyType != strType)
+			break;
+		uint256 hash;
+		ssKey >> hash;
+		if (*hash.begin() >= nEnd)
+			break;
+		if (hash == range.hashLast) {
+			iterator->Next();
+			continue;  // done before the restart
+		}
+
 		CDataStream ssValue(SER_DISK, CLIENT_VERSION);
 		ssValue.write(iterator->value().data(), iterator->value().size());
-		string strType;
-		ssKey >> strType;
-		// Did we reach the end of the data to read?
-		if (strType != "tx")
+		if (!fn(txdb, hash, ssValue)) {
+			fOk = false;
 			break;
+		}
+		iterator->Next();
+		nRecords++;
+		if (++nBatch >= MAX_MIGRATION_BATCH) {
+			range.hashLast = hash;
+			if (!txdb.Write(make_pair(string("migration"), make_pair(strName, nRange)), range) ||
+			    !txdb.TxnCommit() || !txdb.TxnBegin()) {
+				fOk = error("MigrateIndexRange() : commit failed");
+				break;
+			}
+			nBatch = 0;
+		}
+	}
+	delete iterator;
+	if (!fOk || fFailed)
+		return false;
 
-		uint256     txhash;
-		auto        keypair = make_pair(string("tx"), txhash);
-		CDataStream ssKeyRead(SER_DISK, CLIENT_VERSION);
-		ssKeyRead.write(iterator->key().data(), iterator->key().size());
-		ssKeyRead >> keypair;
+	range.fDone = true;
+	if (!txdb.Write(make_pair(string("migration"), make_pair(strName, nRange)), range) ||
+	    !txdb.TxnCommit())
+		return error("MigrateIndexRange() : commit failed");
+	return true;
+}
 
-		CTxIndex txindex;
-		if (!ctxdb.ReadTxIndex(keypair.second, txindex)) {
-			return error("SetTxIndexesV1() : ReadTxIndex failed, txhash %s",
-			             keypair.second.GetHex());
+static void ThreadMigrateIndex(CTxDB*                             ptxdb,
+                               const std::string*                 pstrType,
+                               const std::string*                 pstrName,
+                               std::vector<CIndexMigrationRange>* pvRanges,
+                               IndexMigrationFn*                  pfn,
+                               std::atomic<int>*                  pnNext,
+                               std::atomic<int>*                  pnWorkers,
+                               std::atomic<int64_t>*              pnRecords,
+                               std::atomic<bool>*                 pfFailed) {
+	RenameThread("bitbay-migrate");
+	try {
+		while (!*pfFailed) {
+			int nRange = (*pnNext)++;
+			if (nRange >= int(pvRanges->size()))
+				break;
+			CIndexMigrationRange& range = (*pvRanges)[nRange];
+			if (range.fDone)
+				continue;
+			if (!ptxdb->MigrateIndexRange(*pstrType, *pstrName, nRange, range, *pfn,
+			                              *pnRecords, *pfFailed))
+				*pfFailed = true;
 		}
+	} catch (std::exception& e) {
+		PrintExceptionContinue(&e, "ThreadMigrateIndex()");
+		*pfFailed = true;
+	}
+	(*pnWorkers)--;
+}
+
+bool CTxDB::MigrateIndex(const std::string& strType,
+                         const std::string& strName,
+                         const std::string& strProgress,
+                         IndexMigrationFn   fn,
+                         LoadMsg            load_msg) {
+	int64_t                           nStart = GetTimeMicros();
+	std::vector<CIndexMigrationRange> vRanges(MIGRATION_RANGES);
+	int                               nResumed = 0;
+	for (int i = 0; i < MIGRATION_RANGES; i++) {
+		if (Read(make_pair(string("migration"), make_pair(strName, i)), vRanges[i]))
+			nResumed++;
+	}
+	if (nResumed > 0)
+		LogPrintf("MigrateIndex() : %s resumes %d of %d ranges\n", strName, nResumed,
+		          MIGRATION_RANGES);
+
+	int nThreads = GetArg("-migratethreads", 0);
+	if (nThreads <= 0)
+		nThreads = boost::thread::hardware_concurrency();
+	nThreads = std::max(1, std::min(nThreads, 16));
+
+	std::atomic<int>     nNext(0);
+	std::atomic<int>     nWorkers(nThreads);
+	std::atomic<int64_t> nRecords(0);
+	std::atomic<bool>    fFailed(false);
+	boost::thread_group  workers;
+	for (int i = 0; i < nThreads; i++)
+		workers.create_thread(boost::bind(&ThreadMigrateIndex, this, &strType, &strName, &vRanges,
+		                                  &fn, &nNext, &nWorkers, &nRecords, &fFailed));
+	try {
+		while (nWorkers > 0) {
+			MilliSleep(500);
+			load_msg(strProgress + std::to_string(nRecords));
+		}
+	} catch (boost::thread_interrupted&) {
+		// committed chunks are kept, the next start resumes after them
+		fFailed = true;
+		workers.join_all();
+		throw;
+	}
+	workers.join_all();
+	if (fFailed)
+		return error("MigrateIndex() : %s failed", strName);
+
+	LogPrintf("MigrateIndex() : %s %d records, %d threads, %.2fs\n", strName, int64_t(nRecords),
+	          nThreads, (GetTimeMicros() - nStart) * 0.000001);
+	return true;
+}
+
+static bool SetTxIndexesV1(CTxDB& ctxdb, LoadMsg load_msg) {
+	IndexMigrationFn fn = [](CTxDB& txdb, const uint256& txhash, CDataStream& ssValue) {
+		CTxIndex txindex;
+		ssValue >> txindex;
 
 		uint256  blockhash;
 		uint32_t nTxIndex = 0;
-		txindex.nHeight   = txindex.GetHeightInMainChain(&nTxIndex, keypair.second, &blockhash);
+		txindex.nHeight   = txindex.GetHeightInMainChain(&nTxIndex, txhash, &blockhash);
 		if (txindex.nHeight == 0) {
 			return error("SetTxIndexesV1() : GetHeightInMainChain failed, txhash %s",
-			             keypair.second.GetHex());
+			             txhash.GetHex());
 		}
 		txindex.nIndex   = uint16_t(nTxIndex);
 		txindex.nVersion = 1;
 
-		if (!ctxdb.UpdateTxIndex(keypair.second, txindex)) {
+		if (!txdb.UpdateTxIndex(txhash, txindex))
 			return error("SetTxIndexesV1() : UpdateTxIndex failed");
-		}
-
-		iterator->Next();
-
-		indexCount++;
-		if (indexCount % 10000 == 0) {
-			load_msg(std::string(" update tx indexes: ") + std::to_string(indexCount));
-			// commit on every 10k
-			if (!ctxdb.TxnCommit())
-				return error("SetTxIndexesV1() : TxnCommit failed");
-			if (!ctxdb.TxnBegin())
-				return error("SetTxIndexesV1() : TxnBegin failed");
-		}
-	}
-	delete iterator;
+		return true;
+	};
+	if (!ctxdb.MigrateIndex("tx", "txindexv1", " update tx indexes: ", fn, load_msg))
+		return error("SetTxIndexesV1() : MigrateIndex failed");
 
+	if (!ctxdb.TxnBegin())
+		return error("SetTxIndexesV1() : TxnBegin failed");
 	if (!ctxdb.WriteTxIndexIsV1Ready(true))
 		return error("SetTxIndexesV1() : flag write failed");
-
+	ctxdb.EraseIndexMigration("txindexv1");
 	if (!ctxdb.TxnCommit())
 		return error("SetTxIndexesV1() : TxnCommit failed");
 
@@ -404,8 +584,17 @@ bool CTxDB::ReadDiskTx(COutPoint outpoint, CTransaction& tx) {
 	return ReadDiskTx(outpoint.hash, tx, txindex);
 }
 
+// set once a snapshot id is written, later index changes invalidate it
+static std::atomic<bool> fBlockIndexSnapshotId(false);
+
 bool CTxDB::WriteBlockIndex(const CDiskBlockIndex& blockindex) {
-	return Write(make_pair(string("blockindex"), blockindex.GetBlockHash()), blockindex);
+	return WriteBlockIndex(blockindex.GetBlockHash(), blockindex);
+}
+
+bool CTxDB::WriteBlockIndex(const uint256& hashBlock, const CDiskBlockIndex& blockindex) {
+	if (fBlockIndexSnapshotId)
+		EraseBlockIndexSnapshotId();
+	return Write(make_pair(string("blockindex"), hashBlock), blockindex);
 }
 
 bool CTxDB::ReadHashBestChain(uint256& hashBestChain) {
@@ -464,6 +653,18 @@ bool CTxDB::WritePegPruneEnabled(bool fEnabled) {
 	return Write(string("pegPruneEnabled"), fEnabled);
 }
 
+bool CTxDB::ReadBlockIndexSnapshotId(uint64_t& nId) {
+	return Read(string("blockIndexSnapshot"), nId);
+}
+
+bool CTxDB::WriteBlockIndexSnapshotId(uint64_t nId) {
+	return Write(string("blockIndexSnapshot"), nId);
+}
+
+bool CTxDB::EraseBlockIndexSnapshotId() {
+	return Erase(string("blockIndexSnapshot"));
+}
+
 bool CTxDB::ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust) {
 	return Read(string("bnBestInvalidTrust"), bnBestInvalidTrust);
 }
@@ -491,16 +692,170 @@ CBlockIndex* CTxDB::InsertBlockIndex(uint256 hash) {
 	return pindexNew;
 }
 
-bool CTxDB::LoadBlockIndex(LoadMsg load_msg) {
-	if (mapBlockIndex.size() > 0) {
-		// Already loaded once in this session. It can happen during migration
-		// from BDB.
-		return true;
+CBlockIndex* CTxDB::InsertDiskBlockIndex(const uint256&         blockHash,
+                                         const CDiskBlockIndex& diskindex) {
+	// Construct block index object
+	CBlockIndex* pindexNew = InsertBlockIndex(blockHash);
+	pindexNew->SetPrev(InsertBlockIndex(diskindex.hashPrev));
+	pindexNew->SetNext(InsertBlockIndex(diskindex.hashNext));
+	pindexNew->nFile             = diskindex.nFile;
+	pindexNew->nBlockPos         = diskindex.nBlockPos;
+	pindexNew->nHeight           = diskindex.nHeight;
+	pindexNew->nMint             = diskindex.nMint;
+	pindexNew->nMoneySupply      = diskindex.nMoneySupply;
+	pindexNew->nPegSupplyIndex   = diskindex.nPegSupplyIndex;
+	pindexNew->nPegVotesInflate  = diskindex.nPegVotesInflate;
+	pindexNew->nPegVotesDeflate  = diskindex.nPegVotesDeflate;
+	pindexNew->nPegVotesNochange = diskindex.nPegVotesNochange;
+	pindexNew->nFlags            = diskindex.nFlags;
+	pindexNew->nStakeModifier    = diskindex.nStakeModifier;
+	pindexNew->bnStakeModifierV2 = diskindex.bnStakeModifierV2;
+	pindexNew->prevoutStake      = diskindex.prevoutStake;
+	pindexNew->nStakeTime        = diskindex.nStakeTime;
+	pindexNew->hashProof         = diskindex.hashProof;
+	pindexNew->nVersion          = diskindex.nVersion;
+	pindexNew->hashMerkleRoot    = diskindex.hashMerkleRoot;
+	pindexNew->nTime             = diskindex.nTime;
+	pindexNew->nBits             = diskindex.nBits;
+	pindexNew->nNonce            = diskindex.nNonce;
+
+	// Watch for genesis block
+	if (pindexGenesisBlock == NULL && blockHash == Params().HashGenesisBlock())
+		pindexGenesisBlock = pindexNew;
+
+	if (!pindexNew->CheckIndex())
+		return NULL;
+
+	// NovaCoin: build setStakeSeen
+	if (pindexNew->IsProofOfStake())
+		setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+	return pindexNew;
+}
+
+// Block index snapshot: header, records of block hash and disk index, and
+// the hash of all preceding bytes. It is only used while the db holds the
+// same id, the id is erased when the index is loaded or written to.
+static const uint32_t BLOCKINDEX_SNAPSHOT_MAGIC   = 0x78696262;  // "bbix"
+static const int      BLOCKINDEX_SNAPSHOT_VERSION = 1;
+
+static void ClearBlockIndex() {
+	for (const auto& item : mapBlockIndex)
+		delete item.second;
+	mapBlockIndex.clear();
+	setStakeSeen.clear();
+	pindexGenesisBlock = NULL;
+}
+
+bool CTxDB::ReadBlockIndexSnapshot(LoadMsg load_msg) {
+#ifdef WIN32
+	return false;
+#else
+	uint64_t nId = 0;
+	if (!ReadBlockIndexSnapshotId(nId))
+		return false;
+
+	fs::path path = GetDataDir() / "blkindex.snap";
+	int      fd   = open(path.string().c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= (off_t)sizeof(uint256)) {
+		close(fd);
+		return false;
 	}
-	// The block index is an in-memory structure that maps hashes to on-disk
-	// locations where the contents of the block can be found. Here, we scan it
-	// out of the DB and into mapBlockIndex.
-	leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	CBlockFileViewRef view = std::make_shared<CBlockFileView>(0, (const char*)p, st.st_size);
+
+	size_t  nPayload = view->nSize - sizeof(uint256);
+	uint256 hashChecksum;
+	memcpy(&hashChecksum, view->pbegin + nPayload, sizeof(uint256));
+	if (Hash(view->pbegin, view->pbegin + nPayload) != hashChecksum) {
+		LogPrintf("ReadBlockIndexSnapshot() : checksum mismatch, loading from db\n");
+		return false;
+	}
+
+	try {
+		CBlockFileReader reader(view, 0, SER_DISK, CLIENT_VERSION);
+		uint32_t         nMagic      = 0;
+		int              nVersion    = 0;
+		uint64_t         nSnapshotId = 0;
+		uint256          hashBest;
+		uint64_t         nRecords = 0;
+		reader >> nMagic >> nVersion >> nSnapshotId >> hashBest >> nRecords;
+		uint256 hashBestDb;
+		if (nMagic != BLOCKINDEX_SNAPSHOT_MAGIC || nVersion != BLOCKINDEX_SNAPSHOT_VERSION ||
+		    nSnapshotId != nId || !ReadHashBestChain(hashBestDb) || hashBestDb != hashBest) {
+			LogPrintf("ReadBlockIndexSnapshot() : snapshot is stale, loading from db\n");
+			return false;
+		}
+
+		mapBlockIndex.reserve(nRecords);
+		for (uint64_t i = 0; i < nRecords; i++) {
+			uint256         blockHash;
+			CDiskBlockIndex diskindex;
+			reader >> blockHash >> diskindex;
+			if (!InsertDiskBlockIndex(blockHash, diskindex))
+				throw runtime_error(strprintf("CheckIndex failed at %d", diskindex.nHeight));
+			if ((i + 1) % 100000 == 0)
+				load_msg(std::to_string(i + 1));
+		}
+	} catch (std::exception& e) {
+		LogPrintf("ReadBlockIndexSnapshot() : %s, loading from db\n", e.what());
+		ClearBlockIndex();
+		return false;
+	}
+	return true;
+#endif
+}
+
+bool CTxDB::WriteBlockIndexSnapshot() {
+	int64_t  nStart  = GetTimeMicros();
+	fs::path path    = GetDataDir() / "blkindex.snap";
+	fs::path pathTmp = GetDataDir() / "blkindex.snap.new";
+	uint64_t nId     = GetRand(std::numeric_limits<uint64_t>::max());
+
+	// the old snapshot is not valid anymore whatever happens next
+	EraseBlockIndexSnapshotId();
+	try {
+		CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+		if (!fileout)
+			return error("WriteBlockIndexSnapshot() : open %s failed", pathTmp.string());
+		CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+		uint64_t    nRecords = mapBlockIndex.size();
+		fileout << BLOCKINDEX_SNAPSHOT_MAGIC << BLOCKINDEX_SNAPSHOT_VERSION << nId
+		        << hashBestChain << nRecords;
+		hasher << BLOCKINDEX_SNAPSHOT_MAGIC << BLOCKINDEX_SNAPSHOT_VERSION << nId
+		       << hashBestChain << nRecords;
+		for (const auto& item : mapBlockIndex) {
+			CDiskBlockIndex diskindex(item.second);
+			fileout << item.first << diskindex;
+			hasher << item.first << diskindex;
+		}
+		fileout << hasher.GetHash();
+		FileCommit(fileout);
+	} catch (std::exception& e) {
+		return error("WriteBlockIndexSnapshot() : %s", e.what());
+	}
+	if (!RenameOver(pathTmp, path))
+		return error("WriteBlockIndexSnapshot() : rename failed");
+	if (!WriteBlockIndexSnapshotId(nId))
+		return error("WriteBlockIndexSnapshot() : WriteBlockIndexSnapshotId failed");
+	fBlockIndexSnapshotId = true;
+
+	LogPrintf("WriteBlockIndexSnapshot() : %u block indexes in %dms\n", mapBlockIndex.size(),
+	          (GetTimeMicros() - nStart) / 1000);
+	return true;
+}
+
+// Scans the block index records of the db into mapBlockIndex
+bool CTxDB::LoadBlockIndexRecords(LoadMsg load_msg) {
+	leveldb::ReadOptions options;
+	options.fill_cache          = false;
+	leveldb::Iterator* iterator = pdb->NewIterator(options);
 	// Seek to start key.
 	CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
 	ssStartKey << make_pair(string("blockindex"), uint256(0));
@@ -522,45 +877,13 @@ bool CTxDB::LoadBlockIndex(LoadMsg load_msg) {
 		CDiskBlockIndex diskindex;
 		ssValue >> diskindex;
 
-		uint256 blockHash = diskindex.GetBlockHash();
-		// Construct block index object
-		CBlockIndex* pindexNew = InsertBlockIndex(blockHash);
-		pindexNew->SetPrev(InsertBlockIndex(diskindex.hashPrev));
-		pindexNew->SetNext(InsertBlockIndex(diskindex.hashNext));
-		pindexNew->nFile             = diskindex.nFile;
-		pindexNew->nBlockPos         = diskindex.nBlockPos;
-		pindexNew->nHeight           = diskindex.nHeight;
-		pindexNew->nMint             = diskindex.nMint;
-		pindexNew->nMoneySupply      = diskindex.nMoneySupply;
-		pindexNew->nPegSupplyIndex   = diskindex.nPegSupplyIndex;
-		pindexNew->nPegVotesInflate  = diskindex.nPegVotesInflate;
-		pindexNew->nPegVotesDeflate  = diskindex.nPegVotesDeflate;
-		pindexNew->nPegVotesNochange = diskindex.nPegVotesNochange;
-		pindexNew->nFlags            = diskindex.nFlags;
-		pindexNew->nStakeModifier    = diskindex.nStakeModifier;
-		pindexNew->bnStakeModifierV2 = diskindex.bnStakeModifierV2;
-		pindexNew->prevoutStake      = diskindex.prevoutStake;
-		pindexNew->nStakeTime        = diskindex.nStakeTime;
-		pindexNew->hashProof         = diskindex.hashProof;
-		pindexNew->nVersion          = diskindex.nVersion;
-		pindexNew->hashMerkleRoot    = diskindex.hashMerkleRoot;
-		pindexNew->nTime             = diskindex.nTime;
-		pindexNew->nBits             = diskindex.nBits;
-		pindexNew->nNonce            = diskindex.nNonce;
-
-		// Watch for genesis block
-		if (pindexGenesisBlock == NULL && blockHash == Params().HashGenesisBlock())
-			pindexGenesisBlock = pindexNew;
-
-		if (!pindexNew->CheckIndex()) {
+		uint256      blockHash = diskindex.GetBlockHash();
+		CBlockIndex* pindexNew = InsertDiskBlockIndex(blockHash, diskindex);
+		if (!pindexNew) {
 			delete iterator;
-			return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+			return error("LoadBlockIndex() : CheckIndex failed at %d", diskindex.nHeight);
 		}
 
-		// NovaCoin: build setStakeSeen
-		if (pindexNew->IsProofOfStake())
-			setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
 		iterator->Next();
 		indexCount++;
 		if (indexCount % 10000 == 0) {
@@ -568,6 +891,240 @@ bool CTxDB::LoadBlockIndex(LoadMsg load_msg) {
 		}
 	}
 	delete iterator;
+	return true;
+}
+
+typedef map<pair<uint32_t, uint32_t>, CBlockIndex*> MapBlockPos;
+
+// Startup verification of one block at -checklevel, fBad is set when it
+// fails a check, false is returned when the block can not be read
+static bool VerifyBlock(CTxDB&             txdb,
+                        CBlockIndex*       pindex,
+                        int                nCheckLevel,
+                        const MapBlockPos& mapBlockPos,
+                        bool&              fBad) {
+	fBad = false;
+	CBlock block;
+	if (!block.ReadFromDisk(pindex))
+		return false;
+	// check level 1: verify block validity
+	// check level 7: verify block signature too
+	// blocks are verified on several threads already, check on this one
+	if (nCheckLevel > 0 &&
+	    !block.CheckBlock(true, true, (nCheckLevel > 6), false /*parallel*/)) {
+		LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight,
+		          pindex->GetBlockHash().ToString());
+		fBad = true;
+	}
+	// check level 2: verify transaction index validity
+	if (nCheckLevel > 1) {
+		for (const CTransaction& tx : block.vtx) {
+			uint256  hashTx = tx.GetHash();
+			CTxIndex txindex;
+			if (txdb.ReadTxIndex(hashTx, txindex)) {
+				// check level 3: checker transaction hashes
+				if (nCheckLevel > 2 || pindex->nFile != txindex.pos.nFile ||
+				    pindex->nBlockPos != txindex.pos.nBlockPos) {
+					// either an error or a duplicate transaction
+					CTransaction txFound;
+					if (!txFound.ReadFromDisk(txindex.pos)) {
+						LogPrintf(
+						    "LoadBlockIndex() : *** cannot read mislocated transaction %s\n",
+						    hashTx.ToString());
+						fBad = true;
+					} else if (txFound.GetHash() != hashTx)  // not a duplicate tx
+					{
+						LogPrintf("LoadBlockIndex(): *** invalid tx position for %s\n",
+						          hashTx.ToString());
+						fBad = true;
+					}
+				}
+				// check level 4: check whether spent txouts were spent within the main chain
+				uint32_t nOutput = 0;
+				if (nCheckLevel > 3) {
+					for (const CDiskTxPos& txpos : txindex.vSpent) {
+						if (!txpos.IsNull()) {
+							pair<uint32_t, uint32_t> posFind =
+							    make_pair(txpos.nFile, txpos.nBlockPos);
+							// spent in this block or above, blocks at or below
+							// the checked range are not in the map
+							auto mi = mapBlockPos.find(posFind);
+							if (mi == mapBlockPos.end() ||
+							    mi->second->nHeight < pindex->nHeight) {
+								LogPrintf(
+								    "LoadBlockIndex(): *** found bad spend at %d, "
+								    "hashBlock=%s, hashTx=%s\n",
+								    pindex->nHeight, pindex->GetBlockHash().ToString(),
+								    hashTx.ToString());
+								fBad = true;
+							}
+							// check level 6: check whether spent txouts were spent by a valid
+							// transaction that consume them
+							if (nCheckLevel > 5) {
+								CTransaction txSpend;
+								if (!txSpend.ReadFromDisk(txpos)) {
+									LogPrintf(
+									    "LoadBlockIndex(): *** cannot read spending "
+									    "transaction of %s:%i from disk\n",
+									    hashTx.ToString(), nOutput);
+									fBad = true;
+								} else if (!txSpend.CheckTransaction()) {
+									LogPrintf(
+									    "LoadBlockIndex(): *** spending transaction of %s:%i "
+									    "is invalid\n",
+									    hashTx.ToString(), nOutput);
+									fBad = true;
+								} else {
+									bool fFound = false;
+									for (const CTxIn& txin : txSpend.vin) {
+										if (txin.prevout.hash == hashTx &&
+										    txin.prevout.n == nOutput)
+											fFound = true;
+									}
+									if (!fFound) {
+										LogPrintf(
+										    "LoadBlockIndex(): *** spending transaction of "
+										    "%s:%i does not spend it\n",
+										    hashTx.ToString(), nOutput);
+										fBad = true;
+									}
+								}
+							}
+						}
+						nOutput++;
+					}
+				}
+			}
+			// check level 5: check whether all prevouts are marked spent
+			if (nCheckLevel > 4) {
+				for (const CTxIn& txin : tx.vin) {
+					CTxIndex txindex;
+					if (txdb.ReadTxIndex(txin.prevout.hash, txindex))
+						if (txindex.vSpent.size() - 1 < txin.prevout.n ||
+						    txindex.vSpent[txin.prevout.n].IsNull()) {
+							LogPrintf(
+							    "LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n",
+							    txin.prevout.hash.ToString(), txin.prevout.n,
+							    hashTx.ToString());
+							fBad = true;
+						}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+enum { VERIFY_OK = 0, VERIFY_BAD = 1, VERIFY_UNREADABLE = 2 };
+
+static void ThreadVerifyBlocks(const vector<CBlockIndex*>* pvBlocks,
+                               int                         nCheckLevel,
+                               const MapBlockPos*          pmapBlockPos,
+                               vector<char>*               pvResults,
+                               std::atomic<size_t>*        pnNext,
+                               std::atomic<size_t>*        pnDone,
+                               std::atomic<bool>*          pfStop) {
+	RenameThread("bitbay-verify");
+	CTxDB txdb("r");
+	while (!*pfStop) {
+		size_t i = (*pnNext)++;
+		if (i >= pvBlocks->size())
+			break;
+		char nResult = VERIFY_OK;
+		try {
+			bool fBad = false;
+			if (!VerifyBlock(txdb, (*pvBlocks)[i], nCheckLevel, *pmapBlockPos, fBad))
+				nResult = VERIFY_UNREADABLE;
+			else if (fBad)
+				nResult = VERIFY_BAD;
+		} catch (std::exception& e) {
+			PrintExceptionContinue(&e, "ThreadVerifyBlocks()");
+			nResult = VERIFY_UNREADABLE;
+		}
+		(*pvResults)[i] = nResult;
+		(*pnDone)++;
+	}
+}
+
+// Verifies the last nCheckDepth blocks of the best chain over a pool of
+// -blockcheckthreads workers. Blocks are independent once the positions
+// of the checked range are known: a spend is valid at level 4 when it is
+// in a block at or above the spent one. Workers take blocks from the tip
+// down, so reads of the block files stay close to sequential. pindexFork
+// is set before the lowest bad block, as the serial loop did.
+static bool VerifyBlocks(int nCheckDepth, int nCheckLevel, CBlockIndex*& pindexFork,
+                         LoadMsg load_msg) {
+	int64_t              nStart = GetTimeMicros();
+	vector<CBlockIndex*> vBlocks;
+	MapBlockPos          mapBlockPos;
+	for (CBlockIndex* pindex = pindexBest; pindex && pindex->Prev(); pindex = pindex->Prev()) {
+		if (pindex->nHeight < nBestHeight - nCheckDepth)
+			break;
+		vBlocks.push_back(pindex);
+		if (nCheckLevel > 1)
+			mapBlockPos[make_pair(pindex->nFile, pindex->nBlockPos)] = pindex;
+	}
+
+	int nThreads = GetArg("-blockcheckthreads", 0);
+	if (nThreads <= 0)
+		nThreads = boost::thread::hardware_concurrency();
+	nThreads = std::max(1, std::min(nThreads, 16));
+	nThreads = std::min<int>(nThreads, std::max<size_t>(vBlocks.size(), 1));
+
+	vector<char>        vResults(vBlocks.size(), VERIFY_OK);
+	std::atomic<size_t> nNext(0);
+	std::atomic<size_t> nDone(0);
+	std::atomic<bool>   fStop(false);
+	boost::thread_group workers;
+	for (int i = 0; i < nThreads; i++)
+		workers.create_thread(boost::bind(&ThreadVerifyBlocks, &vBlocks, nCheckLevel, &mapBlockPos,
+		                                  &vResults, &nNext, &nDone, &fStop));
+	try {
+		while (nDone < vBlocks.size()) {
+			MilliSleep(100);
+			load_msg(std::string(" verify blocks: ") + std::to_string(nDone) + "/" +
+			         std::to_string(vBlocks.size()));
+		}
+	} catch (boost::thread_interrupted&) {
+		fStop = true;
+		workers.join_all();
+		throw;
+	}
+	workers.join_all();
+
+	for (size_t i = 0; i < vBlocks.size(); i++) {
+		if (vResults[i] == VERIFY_UNREADABLE)
+			return error("LoadBlockIndex() : block.ReadFromDisk failed at %d",
+			             vBlocks[i]->nHeight);
+		if (vResults[i] == VERIFY_BAD)
+			pindexFork = vBlocks[i]->Prev();
+	}
+	LogPrintf("Verified %u blocks with %d threads in %dms\n", vBlocks.size(), nThreads,
+	          (GetTimeMicros() - nStart) / 1000);
+	return true;
+}
+
+bool CTxDB::LoadBlockIndex(LoadMsg load_msg) {
+	if (mapBlockIndex.size() > 0) {
+		// Already loaded once in this session. It can happen during migration
+		// from BDB.
+		return true;
+	}
+	// The block index is an in-memory structure that maps hashes to on-disk
+	// locations where the contents of the block can be found. Here, we scan it
+	// out of the DB and into mapBlockIndex.
+	int64_t nStart    = GetTimeMicros();
+	bool    fSnapshot = GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT) &&
+	                 ReadBlockIndexSnapshot(load_msg);
+	// the snapshot is used once, next load is from the db unless written again
+	EraseBlockIndexSnapshotId();
+	if (!fSnapshot) {
+		if (!LoadBlockIndexRecords(load_msg))
+			return false;
+	}
+	LogPrintf("LoadBlockIndex() : %u block indexes from %s in %dms\n", mapBlockIndex.size(),
+	          fSnapshot ? "snapshot" : "db", (GetTimeMicros() - nStart) / 1000);
 
 	boost::this_thread::interruption_point();
 
@@ -640,117 +1197,9 @@ bool CTxDB::LoadBlockIndex(LoadMsg load_msg) {
 	if (nCheckDepth > nBestHeight)
 		nCheckDepth = nBestHeight;
 	LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
-	CBlockIndex*                                pindexFork = NULL;
-	map<pair<uint32_t, uint32_t>, CBlockIndex*> mapBlockPos;
-	for (CBlockIndex* pindex = pindexBest; pindex && pindex->Prev(); pindex = pindex->Prev()) {
-		boost::this_thread::interruption_point();
-		if (pindex->nHeight < nBestHeight - nCheckDepth)
-			break;
-		CBlock block;
-		if (!block.ReadFromDisk(pindex))
-			return error("LoadBlockIndex() : block.ReadFromDisk failed");
-		// check level 1: verify block validity
-		// check level 7: verify block signature too
-		if (nCheckLevel > 0 && !block.CheckBlock(true, true, (nCheckLevel > 6))) {
-			LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight,
-			          pindex->GetBlockHash().ToString());
-			pindexFork = pindex->Prev();
-		}
-		// check level 2: verify transaction index validity
-		if (nCheckLevel > 1) {
-			pair<uint32_t, uint32_t> pos = make_pair(pindex->nFile, pindex->nBlockPos);
-			mapBlockPos[pos]             = pindex;
-			for (const CTransaction& tx : block.vtx) {
-				uint256  hashTx = tx.GetHash();
-				CTxIndex txindex;
-				if (ReadTxIndex(hashTx, txindex)) {
-					// check level 3: checker transaction hashes
-					if (nCheckLevel > 2 || pindex->nFile != txindex.pos.nFile ||
-					    pindex->nBlockPos != txindex.pos.nBlockPos) {
-						// either an error or a duplicate transaction
-						CTransaction txFound;
-						if (!txFound.ReadFromDisk(txindex.pos)) {
-							LogPrintf(
-							    "LoadBlockIndex() : *** cannot read mislocated transaction %s\n",
-							    hashTx.ToString());
-							pindexFork = pindex->Prev();
-						} else if (txFound.GetHash() != hashTx)  // not a duplicate tx
-						{
-							LogPrintf("LoadBlockIndex(): *** invalid tx position for %s\n",
-							          hashTx.ToString());
-							pindexFork = pindex->Prev();
-						}
-					}
-					// check level 4: check whether spent txouts were spent within the main chain
-					uint32_t nOutput = 0;
-					if (nCheckLevel > 3) {
-						for (const CDiskTxPos& txpos : txindex.vSpent) {
-							if (!txpos.IsNull()) {
-								pair<uint32_t, uint32_t> posFind =
-								    make_pair(txpos.nFile, txpos.nBlockPos);
-								if (!mapBlockPos.count(posFind)) {
-									LogPrintf(
-									    "LoadBlockIndex(): *** found bad spend at %d, "
-									    "hashBlock=%s, hashTx=%s\n",
-									    pindex->nHeight, pindex->GetBlockHash().ToString(),
-									    hashTx.ToString());
-									pindexFork = pindex->Prev();
-								}
-								// check level 6: check whether spent txouts were spent by a valid
-								// transaction that consume them
-								if (nCheckLevel > 5) {
-									CTransaction txSpend;
-									if (!txSpend.ReadFromDisk(txpos)) {
-										LogPrintf(
-										    "LoadBlockIndex(): *** cannot read spending "
-										    "transaction of %s:%i from disk\n",
-										    hashTx.ToString(), nOutput);
-										pindexFork = pindex->Prev();
-									} else if (!txSpend.CheckTransaction()) {
-										LogPrintf(
-										    "LoadBlockIndex(): *** spending transaction of %s:%i "
-										    "is invalid\n",
-										    hashTx.ToString(), nOutput);
-										pindexFork = pindex->Prev();
-									} else {
-										bool fFound = false;
-										for (const CTxIn& txin : txSpend.vin) {
-											if (txin.prevout.hash == hashTx &&
-											    txin.prevout.n == nOutput)
-												fFound = true;
-										}
-										if (!fFound) {
-											LogPrintf(
-											    "LoadBlockIndex(): *** spending transaction of "
-											    "%s:%i does not spend it\n",
-											    hashTx.ToString(), nOutput);
-											pindexFork = pindex->Prev();
-										}
-									}
-								}
-							}
-							nOutput++;
-						}
-					}
-				}
-				// check level 5: check whether all prevouts are marked spent
-				if (nCheckLevel > 4) {
-					for (const CTxIn& txin : tx.vin) {
-						CTxIndex txindex;
-						if (ReadTxIndex(txin.prevout.hash, txindex))
-							if (txindex.vSpent.size() - 1 < txin.prevout.n ||
-							    txindex.vSpent[txin.prevout.n].IsNull()) {
-								LogPrintf(
-								    "LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n",
-								    txin.prevout.hash.ToString(), txin.prevout.n,
-								    hashTx.ToString());
-								pindexFork = pindex->Prev();
-							}
-					}
-				}
-			}
-		}
-	}
+	CBlockIndex* pindexFork = NULL;
+	if (!VerifyBlocks(nCheckDepth, nCheckLevel, pindexFork, load_msg))
+		return false;
 
 	// CBlockIndex* pindex = FindBlockByHeight(20000);
 	// LogPrintf("LoadBlockIndex(): *** 20000 %s\n", pindex->GetBlockHash().ToString());
@@ -813,10 +1262,141 @@ bool CTxDB::WriteUtxoDbIsReady(bool bReady) {
 	return Write(string("utxoDbIsReady"), bReady);
 }
 
+bool CTxDB::ReadUtxoDbKeysVersion(int& nKeysVersion) {
+	nKeysVersion = 0;
+	return Read(string("utxoDbKeysVersion"), nKeysVersion);
+}
+
+bool CTxDB::WriteUtxoDbKeysVersion(int nKeysVersion) {
+	return Write(string("utxoDbKeysVersion"), nKeysVersion);
+}
+
+bool CTxDB::ReadUtxoLoadHeight(int& nHeight) {
+	return Read(string("utxoLoadHeight"), nHeight);
+}
+
+bool CTxDB::WriteUtxoLoadHeight(int nHeight) {
+	return Write(string("utxoLoadHeight"), nHeight);
+}
+
+bool CTxDB::ReadUtxoLoadShards(int& nShards) {
+	nShards = 0;
+	return Read(string("utxoLoadShards"), nShards);
+}
+
+bool CTxDB::WriteUtxoLoadShards(int nShards) {
+	return Write(string("utxoLoadShards"), nShards);
+}
+
+bool CTxDB::ReadUtxoLoadShard(int nShard, CUtxoLoadShard& shard) {
+	return Read(make_pair(string("utxoLoadShard"), nShard), shard);
+}
+
+bool CTxDB::WriteUtxoLoadShard(int nShard, const CUtxoLoadShard& shard) {
+	return Write(make_pair(string("utxoLoadShard"), nShard), shard);
+}
+
+bool CTxDB::EraseUtxoLoadCheckpoints() {
+	int nShards = 0;
+	ReadUtxoLoadShards(nShards);
+	for (int i = 0; i < nShards; i++)
+		Erase(make_pair(string("utxoLoadShard"), i));
+	Erase(string("utxoLoadShards"));
+	return Erase(string("utxoLoadHeight"));
+}
+
+// 1: binary address index keys, 0: hex text keys ("utxo", "addr", ...)
+static const int UTXODB_KEYS_VERSION = 1;
+
+static void AppendKeyBE64(string& sKey, uint64_t n) {
+	for (int i = 7; i >= 0; i--)
+		sKey.push_back(char((n >> (i * 8)) & 0xff));
+}
+
+uint64_t CTxDB::ParseKeyBE64(const string& sKey, size_t nPos) {
+	uint64_t n = 0;
+	for (size_t i = 0; i < 8; i++)
+		n = (n << 8) | (unsigned char)sKey[nPos + i];
+	return n;
+}
+
+static void AppendKeyTxout(string& sKey, uint320 txoutid) {
+	// most significant byte first, same order as GetHex()
+	for (unsigned char* p = txoutid.end(); p != txoutid.begin();)
+		sKey.push_back(char(*--p));
+}
+
+uint320 CTxDB::ParseKeyTxout(const string& sKey, size_t nPos) {
+	uint320 txoutid;
+	for (unsigned char* p = txoutid.end(); p != txoutid.begin();)
+		*--p = (unsigned char)sKey[nPos++];
+	return txoutid;
+}
+
+static const size_t nKeyAddressLen = 34;
+static const size_t nKeyTxoutLen   = 40;
+
+string CTxDB::AddressKey(char type, const string& sAddress) {
+	string sKey(1, type);
+	sKey += sAddress;
+	return sKey;
+}
+
+string CTxDB::TxoutKey(char type, const string& sAddress, const uint320& txoutid) {
+	string sKey = AddressKey(type, sAddress);
+	AppendKeyTxout(sKey, txoutid);
+	return sKey;
+}
+
+string CTxDB::BalanceKey(const string& sAddress, int64_t nIndex) {
+	// reversed index, the last balance record is the first one in a scan
+	string sKey = AddressKey(DBKEY_BALANCE, sAddress);
+	AppendKeyBE64(sKey, uint64_t(INT64_MAX - nIndex));
+	return sKey;
+}
+
+string CTxDB::FrozenQueueKey(uint64_t nLockTime, const uint320& txoutid) {
+	string sKey(1, char(DBKEY_FQUEUE));
+	AppendKeyBE64(sKey, nLockTime);
+	AppendKeyTxout(sKey, txoutid);
+	return sKey;
+}
+
+// Erases all records with keys starting with sPrefix, beginning from sStart
+// (the lowest key of the same length). Sequential scan, does not fill cache.
+static void EraseKeysWithPrefix(leveldb::DB*  pdb,
+                                const string& sStart,
+                                const string& sPrefix,
+                                const string& sLabel,
+                                LoadMsg       load_msg) {
+	leveldb::ReadOptions options;
+	options.fill_cache          = false;
+	leveldb::Iterator* iterator = pdb->NewIterator(options);
+	CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
+	ssStartKey << sStart;
+	iterator->Seek(ssStartKey.str());
+	int n = 0;
+	while (iterator->Valid()) {
+		if (n % 10000 == 0) {
+			load_msg(std::string(" cleanup ") + sLabel + ": " + std::to_string(n));
+		}
+		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+		ssKey.write(iterator->key().data(), iterator->key().size());
+		string sKey;
+		ssKey >> sKey;
+		if (!boost::starts_with(sKey, sPrefix))
+			break;
+		string sDeleteKey = iterator->key().ToString();
+		iterator->Next();
+		pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
+		n++;
+	}
+	delete iterator;
+}
+
 bool CTxDB::ReadAddressLastBalance(string sAddress, CAddressBalance& balance, int64_t& nIdx) {
 	nIdx             = -1;
-	string sNum      = strprintf("%016x", 0);
-	string sStartKey = "addr" + sAddress + sNum;
+	string sStartKey = BalanceKey(sAddress, INT64_MAX);
 	string sRawKey;
 	string sRawValue;
 	if (!Seek(sStartKey, sRawKey, sRawValue))
@@ -827,10 +1407,9 @@ bool CTxDB::ReadAddressLastBalance(string sAddress, CAddressBalance& balance, in
 	ssKey.write(sRawKey.data(), sRawKey.size());
 	string sKey;
 	ssKey >> sKey;
-	if (boost::starts_with(sKey, "addr" + sAddress)) {
-		sNum = sKey.substr(4 + 34);
-		std::istringstream(sNum) >> std::hex >> nIdx;
-		nIdx = INT64_MAX - nIdx;
+	if (sKey.size() == sStartKey.size() &&
+	    boost::starts_with(sKey, AddressKey(DBKEY_BALANCE, sAddress))) {
+		nIdx = INT64_MAX - int64_t(ParseKeyBE64(sKey, 1 + nKeyAddressLen));
 		CDataStream ssValue(SER_DISK, CLIENT_VERSION);
 		ssValue.write(sRawValue.data(), sRawValue.size());
 		ssValue >> balance;
@@ -843,16 +1422,16 @@ bool CTxDB::ReadAddressLastBalance(string sAddress, CAddressBalance& balance, in
 bool CTxDB::ReadAddressBalanceRecords(string sAddress, vector<CAddressBalance>& vRecords) {
 	bool               fFound   = false;
 	leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-	string             sNum     = strprintf("%016x", 0);
+	string             sPrefix  = AddressKey(DBKEY_BALANCE, sAddress);
 	CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-	ssStartKey << "addr" + sAddress + sNum;
+	ssStartKey << BalanceKey(sAddress, INT64_MAX);
 	iterator->Seek(ssStartKey.str());
 	while (iterator->Valid()) {
 		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
 		ssKey.write(iterator->key().data(), iterator->key().size());
 		string sKey;
 		ssKey >> sKey;
-		if (boost::starts_with(sKey, "addr" + sAddress)) {
+		if (boost::starts_with(sKey, sPrefix)) {
 			CAddressBalance balance;
 			CDataStream     ssValue(SER_DISK, CLIENT_VERSION);
 			ssValue.write(iterator->value().data(), iterator->value().size());
@@ -872,22 +1451,21 @@ bool CTxDB::ReadAddressBalanceRecords(string sAddress, vector<CAddressBalance>&
 bool CTxDB::ReadAddressUnspent(string sAddress, vector<CAddressUnspent>& vRecords) {
 	bool               fFound   = false;
 	leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-	string             sNum     = strprintf("%080x", 0);
+	string             sPrefix  = AddressKey(DBKEY_UTXO, sAddress);
 	CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-	ssStartKey << "utxo" + sAddress + sNum;
+	ssStartKey << TxoutKey(DBKEY_UTXO, sAddress, uint320());
 	iterator->Seek(ssStartKey.str());
 	while (iterator->Valid()) {
 		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
 		ssKey.write(iterator->key().data(), iterator->key().size());
 		string sKey;
 		ssKey >> sKey;
-		if (boost::starts_with(sKey, "utxo" + sAddress)) {
+		if (boost::starts_with(sKey, sPrefix)) {
 			CAddressUnspent utxo;
 			CDataStream     ssValue(SER_DISK, CLIENT_VERSION);
 			ssValue.write(iterator->value().data(), iterator->value().size());
 			ssValue >> utxo;
-			string txoutidhex = sKey.substr(4 + 34, 80);
-			utxo.txoutid      = uint320(txoutidhex);
+			utxo.txoutid = ParseKeyTxout(sKey, 1 + nKeyAddressLen);
 			vRecords.push_back(utxo);
 			fFound = true;
 		} else {
@@ -903,22 +1481,21 @@ bool CTxDB::ReadAddressUnspent(string sAddress, vector<CAddressUnspent>& vRecord
 bool CTxDB::ReadAddressFrozen(string sAddress, vector<CAddressUnspent>& vRecords) {
 	bool               fFound   = false;
 	leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-	string             sNum     = strprintf("%080x", 0);
+	string             sPrefix  = AddressKey(DBKEY_FTXO, sAddress);
 	CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-	ssStartKey << "ftxo" + sAddress + sNum;
+	ssStartKey << TxoutKey(DBKEY_FTXO, sAddress, uint320());
 	iterator->Seek(ssStartKey.str());
 	while (iterator->Valid()) {
 		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
 		ssKey.write(iterator->key().data(), iterator->key().size());
 		string sKey;
 		ssKey >> sKey;
-		if (boost::starts_with(sKey, "ftxo" + sAddress)) {
+		if (boost::starts_with(sKey, sPrefix)) {
 			CAddressUnspent utxo;
 			CDataStream     ssValue(SER_DISK, CLIENT_VERSION);
 			ssValue.write(iterator->value().data(), iterator->value().size());
 			ssValue >> utxo;
-			string txoutidhex = sKey.substr(4 + 34, 80);
-			utxo.txoutid      = uint320(txoutidhex);
+			utxo.txoutid = ParseKeyTxout(sKey, 1 + nKeyAddressLen);
 			vRecords.push_back(utxo);
 			fFound = true;
 		} else {
@@ -931,193 +1508,294 @@ bool CTxDB::ReadAddressFrozen(string sAddress, vector<CAddressUnspent>& vRecords
 }
 
 bool CTxDB::ReadFrozenQueue(uint64_t nLockTime, vector<CFrozenQueued>& records) {
-	string                                    sMinTime  = strprintf("%016x", 0);
-	string                                    sMaxTime  = strprintf("%016x", nLockTime);
-	string                                    sMinTxout = uint320().GetHex();
-	string                                    sMaxTxout = uint320_MAX.GetHex();
 	vector<std::pair<string, CFrozenQueued> > values;
-	string                                    sMinKey = "fqueue" + sMinTime + sMinTxout;
-	string                                    sMaxKey = "fqueue" + sMaxTime + sMaxTxout;
-	bool                                      fFound  = Range(sMinKey, sMaxKey, values);
+	string sMinKey = FrozenQueueKey(0, uint320());
+	string sMaxKey = FrozenQueueKey(nLockTime, uint320_MAX);
+	bool   fFound  = Range(sMinKey, sMaxKey, values);
 	records.resize(values.size());
 	for (size_t i = 0; i < values.size(); i++) {
-		string sLockTimeHex = values[i].first.substr(6, 16);
-		string sTxoutidHex  = values[i].first.substr(6 + 16, 80);
-		records[i].sAddress = values[i].second.sAddress;
-		records[i].nAmount  = values[i].second.nAmount;
-		records[i].txoutid  = uint320(sTxoutidHex);
-		std::istringstream(sLockTimeHex) >> std::hex >> records[i].nLockTime;
+		const string& sKey   = values[i].first;
+		records[i].sAddress  = values[i].second.sAddress;
+		records[i].nAmount   = values[i].second.nAmount;
+		records[i].nLockTime = ParseKeyBE64(sKey, 1);
+		records[i].txoutid   = ParseKeyTxout(sKey, 1 + 8);
 	}
 	return fFound;
 }
 
 bool CTxDB::ReadFrozenQueued(uint64_t nLockTime, uint320 txoutid, CFrozenQueued& record) {
-	string sTime  = strprintf("%016x", nLockTime);
-	string sTxout = txoutid.GetHex();
-	string sKey   = "fqueue" + sTime + sTxout;
-	return Read(sKey, record);
+	return Read(FrozenQueueKey(nLockTime, txoutid), record);
 }
 
 bool CTxDB::CleanupUtxoData(LoadMsg load_msg) {
-	// remove old balance records
-	{
-		leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-		string             sNum     = strprintf("%016x", 0);
-		CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-		string             sStart = strprintf("%034x", 0);
-		ssStartKey << "addr" + sStart + sNum;
-		iterator->Seek(ssStartKey.str());
-		int n = 0;
-		while (iterator->Valid()) {
-			if (n % 10000 == 0) {
-				load_msg(std::string(" cleanup #1: ") + std::to_string(n));
-			}
-			CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-			ssKey.write(iterator->key().data(), iterator->key().size());
-			string sKey;
-			ssKey >> sKey;
-			if (boost::starts_with(sKey, "addr")) {
-				string sDeleteKey = iterator->key().ToString();
-				iterator->Next();
-				pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
-				n++;
-				continue;
-			} else {
+	string sAddr0(nKeyAddressLen, '\0');
+	EraseKeysWithPrefix(pdb, BalanceKey(sAddr0, INT64_MAX), string(1, DBKEY_BALANCE), "#1",
+	                    load_msg);
+	EraseKeysWithPrefix(pdb, TxoutKey(DBKEY_UTXO, sAddr0, uint320()), string(1, DBKEY_UTXO), "#2",
+	                    load_msg);
+	EraseKeysWithPrefix(pdb, TxoutKey(DBKEY_FTXO, sAddr0, uint320()), string(1, DBKEY_FTXO), "#3",
+	                    load_msg);
+	EraseKeysWithPrefix(pdb, FrozenQueueKey(0, uint320()), string(1, DBKEY_FQUEUE), "#4",
+	                    load_msg);
+
+	// records of hex text keys layout (utxo db keys version 0)
+	string sHexAddr0 = strprintf("%034x", 0);
+	string sHexIdx0  = strprintf("%016x", 0);
+	string sHexTxout = strprintf("%080x", 0);  // 256+64
+	EraseKeysWithPrefix(pdb, "addr" + sHexAddr0 + sHexIdx0, "addr", "#1", load_msg);
+	EraseKeysWithPrefix(pdb, "utxo" + sHexAddr0 + sHexTxout, "utxo", "#2", load_msg);
+	EraseKeysWithPrefix(pdb, "ftxo" + sHexAddr0 + sHexTxout, "ftxo", "#3", load_msg);
+	EraseKeysWithPrefix(pdb, "fqueue" + sHexIdx0 + sHexTxout, "fqueue", "#4", load_msg);
+
+	CleanupPegBalances(load_msg);
+	// a fresh rebuild starts from scratch
+	EraseUtxoLoadCheckpoints();
+	return true;
+}
+
+bool CTxDB::CleanupPegBalances(LoadMsg load_msg) {
+	string sAddr0(nKeyAddressLen, '\0');
+	EraseKeysWithPrefix(pdb, AddressKey(DBKEY_PEGBALANCE, sAddr0), string(1, DBKEY_PEGBALANCE),
+	                    "#5", load_msg);
+	EraseKeysWithPrefix(pdb, "pegbalance" + strprintf("%034x", 0), "pegbalance", "#5", load_msg);
+	return true;
+}
+
+// Peg balances of all addresses recomputed from the utxo records. The
+// address key range is split into shards of about the same size on disk,
+// shards are processed by worker threads, each one sums up the fractions
+// of an address in memory and writes its peg balance once, committing the
+// balances with the shard progress every MAX_UTXO_LOAD_SHARD_BATCH records.
+static const int     UTXO_LOAD_SHARDS          = 64;
+static const int64_t MAX_UTXO_LOAD_SHARD_BATCH = 10000;
+
+static const char* pszBase58Chars = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+static void ThreadRebuildPegBalances(CTxDB*                       ptxdb,
+                                     std::vector<CUtxoLoadShard>* pvShards,
+                                     std::atomic<int>*            pnNext,
+                                     std::atomic<int>*            pnWorkers,
+                                     std::set<std::string>*       psetSkip,
+                                     std::atomic<int64_t>*        pnUnspents,
+                                     std::atomic<bool>*           pfFailed) {
+	RenameThread("bitbay-utxoload");
+	try {
+		while (!*pfFailed) {
+			int nShard = (*pnNext)++;
+			if (nShard >= int(pvShards->size()))
 				break;
-			}
-			iterator->Next();
-			n++;
-		}
-		delete iterator;
-	}
-	// remove old utxo records
-	{
-		leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-		string             sTxout   = strprintf("%080x", 0);  // 256+64
-		CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-		string             sStart = strprintf("%034x", 0);
-		ssStartKey << "utxo" + sStart + sTxout;
-		iterator->Seek(ssStartKey.str());
-		int n = 0;
-		while (iterator->Valid()) {
-			if (n % 10000 == 0) {
-				load_msg(std::string(" cleanup #2: ") + std::to_string(n));
-			}
-			CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-			ssKey.write(iterator->key().data(), iterator->key().size());
-			string sKey;
-			ssKey >> sKey;
-			if (boost::starts_with(sKey, "utxo")) {
-				string sDeleteKey = iterator->key().ToString();
-				iterator->Next();
-				pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
-				n++;
+			CUtxoLoadShard& shard = (*pvShards)[nShard];
+			if (shard.fDone)
 				continue;
-			} else {
-				break;
-			}
-			iterator->Next();
-			n++;
+			if (!ptxdb->RebuildPegBalancesShard(nShard, shard, *psetSkip, *pnUnspents,
+			                                    *pfFailed))
+				*pfFailed = true;
 		}
+	} catch (std::exception& e) {
+		PrintExceptionContinue(&e, "ThreadRebuildPegBalances()");
+		*pfFailed = true;
+	}
+	(*pnWorkers)--;
+}
+
+bool CTxDB::RebuildPegBalancesShard(int                          nShard,
+                                    CUtxoLoadShard&              shard,
+                                    const std::set<std::string>& setSkipAddresses,
+                                    std::atomic<int64_t>&        nUnspents,
+                                    std::atomic<bool>&           fFailed) {
+	// own instances, the batch of this one is not shared between threads
+	CTxDB  txdb("r+");
+	CPegDB pegdb("r");
+
+	CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+	ssStartKey << TxoutKey(DBKEY_UTXO, shard.sLast.empty() ? shard.sBegin : shard.sLast,
+	                       uint320());
+	leveldb::ReadOptions options;
+	options.fill_cache          = false;
+	leveldb::Iterator* iterator = pdb->NewIterator(options);
+	iterator->Seek(ssStartKey.str());
+
+	if (!txdb.TxnBegin()) {
 		delete iterator;
+		return error("RebuildPegBalancesShard() : TxnBegin failed");
 	}
-	// remove old frozen records
-	{
-		leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-		string             sTxout   = strprintf("%080x", 0);  // 256+64
-		CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-		string             sStart = strprintf("%034x", 0);
-		ssStartKey << "ftxo" + sStart + sTxout;
-		iterator->Seek(ssStartKey.str());
-		int n = 0;
-		while (iterator->Valid()) {
-			if (n % 10000 == 0) {
-				load_msg(std::string(" cleanup #3: ") + std::to_string(n));
-			}
-			CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-			ssKey.write(iterator->key().data(), iterator->key().size());
-			string sKey;
-			ssKey >> sKey;
-			if (boost::starts_with(sKey, "ftxo")) {
-				string sDeleteKey = iterator->key().ToString();
-				iterator->Next();
-				pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
-				n++;
-				continue;
-			} else {
-				break;
-			}
+
+	string     sAddressPrev;
+	CFractions pegbalance(0, CFractions::VALUE);
+	int64_t    nBatch = 0;
+	bool       fOk    = true;
+	while (iterator->Valid() && !fFailed) {
+		CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+		ssKey.write(iterator->key().data(), iterator->key().size());
+		string sKey;
+		ssKey >> sKey;
+		if (sKey.empty() || sKey[0] != DBKEY_UTXO)
+			break;
+		string sAddress = sKey.substr(1, nKeyAddressLen);
+		if (!shard.sEnd.empty() && sAddress >= shard.sEnd)
+			break;
+		if (!shard.sLast.empty() && sAddress == shard.sLast) {
 			iterator->Next();
-			n++;
+			continue;  // done before the restart
 		}
-		delete iterator;
-	}
-	// remove old frozen queue records
-	{
-		leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-		string             sTime    = strprintf("%016x", 0);
-		string             sTxout   = strprintf("%080x", 0);  // 256+64
-		CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-		ssStartKey << "fqueue" + sTime + sTxout;
-		iterator->Seek(ssStartKey.str());
-		int n = 0;
-		while (iterator->Valid()) {
-			if (n % 10000 == 0) {
-				load_msg(std::string(" cleanup #4: ") + std::to_string(n));
+
+		if (sAddress != sAddressPrev) {
+			if (!sAddressPrev.empty()) {
+				if (!txdb.WritePegBalance(sAddressPrev, pegbalance)) {
+					fOk = error("RebuildPegBalancesShard() : WritePegBalance failed");
+					break;
+				}
+				// commit only on address boundary, sLast is complete
+				if (nBatch >= MAX_UTXO_LOAD_SHARD_BATCH) {
+					shard.sLast = sAddressPrev;
+					if (!txdb.WriteUtxoLoadShard(nShard, shard) || !txdb.TxnCommit() ||
+					    !txdb.TxnBegin()) {
+						fOk = error("RebuildPegBalancesShard() : commit failed");
+						break;
+					}
+					nBatch = 0;
+				}
 			}
-			CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-			ssKey.write(iterator->key().data(), iterator->key().size());
-			string sKey;
-			ssKey >> sKey;
-			if (boost::starts_with(sKey, "fqueue")) {
-				string sDeleteKey = iterator->key().ToString();
-				iterator->Next();
-				pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
-				n++;
-				continue;
-			} else {
+			sAddressPrev = sAddress;
+			pegbalance   = CFractions(0, CFractions::VALUE);
+		}
+
+		CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+		ssValue.write(iterator->value().data(), iterator->value().size());
+		CAddressUnspent unspent;
+		ssValue >> unspent;
+
+		// non-peg unspents are still summed up as peg based
+		CFractions fractions(unspent.nAmount, CFractions::VALUE);
+		if (unspent.nHeight >= nPegStartHeight && !setSkipAddresses.count(sAddress)) {
+			uint320 txoutid = ParseKeyTxout(sKey, 1 + nKeyAddressLen);
+			if (!pegdb.ReadFractions(txoutid, fractions, true /*must_have*/)) {
+				fOk = error("RebuildPegBalancesShard() : ReadFractions failed");
 				break;
 			}
-			iterator->Next();
-			n++;
 		}
-		delete iterator;
+		pegbalance += fractions;
+
+		iterator->Next();
+		nBatch++;
+		nUnspents++;
 	}
-	CleanupPegBalances(load_msg);
+	delete iterator;
+	if (!fOk || fFailed)
+		return false;
+
+	if (!sAddressPrev.empty() && !txdb.WritePegBalance(sAddressPrev, pegbalance))
+		return error("RebuildPegBalancesShard() : WritePegBalance failed");
+	shard.fDone = true;
+	if (!txdb.WriteUtxoLoadShard(nShard, shard) || !txdb.TxnCommit())
+		return error("RebuildPegBalancesShard() : commit failed");
 	return true;
 }
 
-bool CTxDB::CleanupPegBalances(LoadMsg load_msg) {
-	// remove old pegbalance records
-	{
-		leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-		string             sStart   = strprintf("%034x", 0);
-		CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-		ssStartKey << "pegbalance" + sStart;
-		iterator->Seek(ssStartKey.str());
-		int n = 0;
-		while (iterator->Valid()) {
-			if (n % 10000 == 0) {
-				load_msg(std::string(" cleanup #5: ") + std::to_string(n));
+bool CTxDB::RebuildPegBalances(LoadMsg load_msg) {
+	int64_t                     nStart  = GetTimeMicros();
+	int                         nShards = 0;
+	std::vector<CUtxoLoadShard> vShards;
+	if (ReadUtxoLoadShards(nShards)) {
+		vShards.resize(nShards);
+		for (int i = 0; i < nShards; i++) {
+			if (!ReadUtxoLoadShard(i, vShards[i]))
+				return error("RebuildPegBalances() : ReadUtxoLoadShard %d failed", i);
+		}
+		LogPrintf("RebuildPegBalances() : resume %d shards\n", nShards);
+	} else {
+		CleanupPegBalances(load_msg);
+
+		// split by two leading address chars weighted by their size on disk
+		vector<string>   vPrefixes;
+		vector<uint64_t> vSizes;
+		vector<string>   vKeys;
+		for (const char* p1 = pszBase58Chars; *p1; p1++) {
+			for (const char* p2 = pszBase58Chars; *p2; p2++) {
+				string sAddress(nKeyAddressLen, '\0');
+				sAddress[0] = *p1;
+				sAddress[1] = *p2;
+				CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+				ssKey << TxoutKey(DBKEY_UTXO, sAddress, uint320());
+				vPrefixes.push_back(sAddress);
+				vKeys.push_back(ssKey.str());
 			}
-			CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-			ssKey.write(iterator->key().data(), iterator->key().size());
-			string sKey;
-			ssKey >> sKey;
-			if (boost::starts_with(sKey, "pegbalance")) {
-				string sDeleteKey = iterator->key().ToString();
-				iterator->Next();
-				pdb->Delete(leveldb::WriteOptions(), sDeleteKey);
-				n++;
-				continue;
-			} else {
-				break;
+		}
+		vector<leveldb::Range> vRanges;
+		for (size_t i = 0; i < vKeys.size(); i++) {
+			CDataStream ssEndKey(SER_DISK, CLIENT_VERSION);
+			ssEndKey << TxoutKey(DBKEY_UTXO, string(nKeyAddressLen, '\xff'), uint320_MAX);
+			vRanges.push_back(leveldb::Range(vKeys[i], i + 1 < vKeys.size() ? vKeys[i + 1]
+			                                                                 : ssEndKey.str()));
+		}
+		vSizes.resize(vRanges.size());
+		pdb->GetApproximateSizes(vRanges.data(), vRanges.size(), vSizes.data());
+		uint64_t nTotal = 0;
+		for (uint64_t& nSize : vSizes)
+			nTotal += ++nSize;  // unflushed ranges still count
+
+		uint64_t nPart = nTotal / UTXO_LOAD_SHARDS + 1;
+		uint64_t nSum  = 0;
+		for (size_t i = 0; i < vPrefixes.size(); i++) {
+			if (vShards.empty() || nSum >= nPart) {
+				if (!vShards.empty())
+					vShards.back().sEnd = vPrefixes[i];
+				vShards.push_back(CUtxoLoadShard());
+				// first shard also covers keys before the base58 range
+				vShards.back().sBegin = vShards.size() == 1 ? string(nKeyAddressLen, '\0')
+				                                            : vPrefixes[i];
+				nSum = 0;
 			}
-			iterator->Next();
-			n++;
+			nSum += vSizes[i];
 		}
-		delete iterator;
+		nShards = vShards.size();
+
+		if (!TxnBegin())
+			return error("RebuildPegBalances() : TxnBegin failed");
+		for (int i = 0; i < nShards; i++)
+			WriteUtxoLoadShard(i, vShards[i]);
+		WriteUtxoLoadShards(nShards);
+		if (!TxnCommit())
+			return error("RebuildPegBalances() : TxnCommit failed");
 	}
+
+	int nThreads = GetArg("-utxoloadthreads", 0);
+	if (nThreads <= 0)
+		nThreads = boost::thread::hardware_concurrency();
+	nThreads = std::max(1, std::min(nThreads, 16));
+
+	std::set<std::string> setSkipAddresses;
+	setSkipAddresses.insert(Params().PegInflateAddr());
+	setSkipAddresses.insert(Params().PegDeflateAddr());
+	setSkipAddresses.insert(Params().PegNochangeAddr());
+
+	std::atomic<int>     nNext(0);
+	std::atomic<int>     nWorkers(nThreads);
+	std::atomic<int64_t> nUnspents(0);
+	std::atomic<bool>    fFailed(false);
+	boost::thread_group  workers;
+	for (int i = 0; i < nThreads; i++)
+		workers.create_thread(boost::bind(&ThreadRebuildPegBalances, this, &vShards, &nNext,
+		                                  &nWorkers, &setSkipAddresses, &nUnspents, &fFailed));
+	try {
+		while (nWorkers > 0) {
+			MilliSleep(500);
+			load_msg(std::string(" balances: ") + std::to_string(nUnspents) + " shards: " +
+			         std::to_string(std::min<int>(nNext, nShards)) + "/" +
+			         std::to_string(nShards));
+		}
+	} catch (boost::thread_interrupted&) {
+		// workers use the state of this frame, committed shards resume later
+		fFailed = true;
+		workers.join_all();
+		throw;
+	}
+	workers.join_all();
+	if (fFailed)
+		return error("RebuildPegBalances() : failed");
+
+	LogPrintf("RebuildPegBalances() : %d unspents in %d shards, %d threads, %.2fs\n",
+	          int64_t(nUnspents), nShards, nThreads, (GetTimeMicros() - nStart) * 0.000001);
 	return true;
 }
 
@@ -1127,182 +1805,124 @@ bool CTxDB::LoadUtxoData(LoadMsg load_msg) {
 
 	ReadUtxoDbIsReady(fIsReady);
 
+	int nKeysVersion = 0;
+	ReadUtxoDbKeysVersion(nKeysVersion);
+	if (fIsReady && nKeysVersion < UTXODB_KEYS_VERSION) {
+		// migrate: rebuild address index with binary keys, old records are cleaned up
+		LogPrintf("LoadUtxoData() : rebuild address index, keys version %d\n", nKeysVersion);
+		fIsReady = false;
+	}
+
 	//    fIsReady = false;
 	//    fEnabled = true;
 
-	set<string> setSkipAddresses;
-	setSkipAddresses.insert(Params().PegInflateAddr());
-	setSkipAddresses.insert(Params().PegDeflateAddr());
-	setSkipAddresses.insert(Params().PegNochangeAddr());
-
 	if (!fIsReady && fEnabled) {
-		// remove all first
-		CleanupUtxoData(load_msg);
+		// an interrupted rebuild continues from its checkpoints
+		int  nLoadHeight = -1;
+		int  nShards     = 0;
+		bool fResume     = ReadUtxoLoadHeight(nLoadHeight);
+		if (fResume) {
+			LogPrintf("LoadUtxoData() : resume rebuild after height %d\n", nLoadHeight);
+		} else {
+			// remove all first
+			CleanupUtxoData(load_msg);
+		}
 		// pegdb is ready
 		CPegDB pegdb("r");
 		// over all blocks
 
 		CBlockIndex* pindex = pindexGenesisBlock;
-		while (pindex) {
-			if (pindex->nHeight % 1000 == 0) {
-				load_msg(std::string(" balances changes: ") + std::to_string(pindex->nHeight));
-			}
-			CBlock block;
-			if (!block.ReadFromDisk(pindex, true))
-				return error("LoadUtxoData() : block ReadFromDisk failed");
-
-			// fill address map
-			for (size_t i = 0; i < block.vtx.size(); i++) {
-				const CTransaction& tx = block.vtx[i];
-				MapPrevTx           mapInputs;
-				MapFractions        mapInputsFractions;
-				for (size_t j = 0; j < tx.vin.size(); j++) {
-					if (tx.IsCoinBase())
-						continue;
-					if (tx.IsCoinMint())
-						continue;
-					const COutPoint& prevout = tx.vin[j].prevout;
-					if (prevout.hash == uint256(0))
-						continue;
-					CTxIndex& prevtxindex = mapInputs[prevout.hash].first;
-					if (!ReadTxIndex(prevout.hash, prevtxindex))
-						return error("LoadUtxoData() : ReadTxIndex failed");
-					CTransaction& prev = mapInputs[prevout.hash].second;
-					if (!ReadDiskTx(prevout.hash, prev))
-						return error("LoadUtxoData() : ReadDiskTx failed");
-					// Read input fractions
-					auto        txoutid   = uint320(prevout.hash, prevout.n);
-					CFractions& fractions = mapInputsFractions[txoutid];
-					fractions             = CFractions(0, CFractions::VALUE);
-					if (!pegdb.ReadFractions(txoutid, fractions, true)) {  // must_have
-						mapInputsFractions.erase(txoutid);
-					}
+		while (pindex && pindex->nHeight <= nLoadHeight)
+			pindex = pindex->Next();
+		if (!ReadUtxoLoadShards(nShards)) {
+			while (pindex) {
+				if (pindex->nHeight % 1000 == 0) {
+					load_msg(std::string(" balances changes: ") +
+					         std::to_string(pindex->nHeight));
+					boost::this_thread::interruption_point();
 				}
-				MapFractions mapOutputsFractions;
-				for (size_t j = 0; j < tx.vout.size(); j++) {
-					// Read output fractions
-					auto        txoutid   = uint320(tx.GetHash(), j);
-					CFractions& fractions = mapOutputsFractions[txoutid];
-					fractions             = CFractions(0, CFractions::VALUE);
-					if (!pegdb.ReadFractions(txoutid, fractions, true)) {  // must_have
-						mapOutputsFractions.erase(txoutid);
+				CBlock block;
+				if (!block.ReadFromDisk(pindex, true))
+					return error("LoadUtxoData() : block ReadFromDisk failed");
+
+				// every block is one batch with its checkpoint
+				if (!TxnBegin())
+					return error("LoadUtxoData() : TxnBegin failed");
+
+				// fill address map
+				CAddressBlockOverlay overlay;
+				for (size_t i = 0; i < block.vtx.size(); i++) {
+					const CTransaction& tx = block.vtx[i];
+					MapPrevTx           mapInputs;
+					MapFractions        mapInputsFractions;
+					for (size_t j = 0; j < tx.vin.size(); j++) {
+						if (tx.IsCoinBase())
+							continue;
+						if (tx.IsCoinMint())
+							continue;
+						const COutPoint& prevout = tx.vin[j].prevout;
+						if (prevout.hash == uint256(0))
+							continue;
+						CTxIndex& prevtxindex = mapInputs[prevout.hash].first;
+						if (!ReadTxIndex(prevout.hash, prevtxindex))
+							return error("LoadUtxoData() : ReadTxIndex failed");
+						CTransaction& prev = mapInputs[prevout.hash].second;
+						if (!ReadDiskTx(prevout.hash, prev))
+							return error("LoadUtxoData() : ReadDiskTx failed");
+						// Read input fractions
+						auto        txoutid   = uint320(prevout.hash, prevout.n);
+						CFractions& fractions = mapInputsFractions[txoutid];
+						fractions             = CFractions(0, CFractions::VALUE);
+						if (!pegdb.ReadFractions(txoutid, fractions, true)) {  // must_have
+							mapInputsFractions.erase(txoutid);
+						}
+					}
+					MapFractions mapOutputsFractions;
+					for (size_t j = 0; j < tx.vout.size(); j++) {
+						// Read output fractions
+						auto        txoutid   = uint320(tx.GetHash(), j);
+						CFractions& fractions = mapOutputsFractions[txoutid];
+						fractions             = CFractions(0, CFractions::VALUE);
+						if (!pegdb.ReadFractions(txoutid, fractions, true)) {  // must_have
+							mapOutputsFractions.erase(txoutid);
+						}
 					}
+					if (!tx.ConnectUtxo(*this, overlay, pindex, i, mapInputs, mapInputsFractions,
+					                    mapOutputsFractions))
+						return error("LoadUtxoData() : tx.ConnectUtxo failed");
 				}
-				if (!tx.ConnectUtxo(*this, pindex, i, mapInputs, mapInputsFractions,
-				                    mapOutputsFractions))
-					return error("LoadUtxoData() : tx.ConnectUtxo failed");
+				MapFractions mapFractionsEmpty;  // empty as all is in pegdb already
+				if (!block.ProcessFrozenQueue(*this, pegdb, overlay, mapFractionsEmpty, pindex,
+				                              true /*fLoading*/))
+					return error("LoadUtxoData() : ConnectFrozenQueue failed");
+				if (!overlay.Flush(*this))
+					return error("LoadUtxoData() : address balances flush failed");
+				if (!WriteUtxoLoadHeight(pindex->nHeight))
+					return error("LoadUtxoData() : WriteUtxoLoadHeight failed");
+				if (!TxnCommit())
+					return error("LoadUtxoData() : TxnCommit failed");
+
+				pindex = pindex->Next();
 			}
-			MapFractions mapFractionsEmpty;  // empty as all is in pegdb already
-			if (!block.ProcessFrozenQueue(*this, pegdb, mapFractionsEmpty, pindex,
-			                              true /*fLoading*/))
-				return error("LoadUtxoData() : ConnectFrozenQueue failed");
-
-			pindex = pindex->Next();
 		}
 
 		// when it is ready we recalc pegbalances as if prune enabled
 		// we do not have pegdatas of those txouts which were pruned
 		// so all pegbalances are recalculated from unspent pegdata
-		CleanupPegBalances(load_msg);
-		{
-			// two passes:
-			// first pass to collect and add all non-peg unspents without counting peg fractions
-			// secod pass to collect and add all peg-based unspent with peg append/deduct
-			{
-				leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-				string             sTxout   = strprintf("%080x", 0);  // 256+64
-				CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-				string             sStart = strprintf("%034x", 0);
-				ssStartKey << "utxo" + sStart + sTxout;
-				iterator->Seek(ssStartKey.str());
-				int n = 0;
-				while (iterator->Valid()) {
-					if (n % 10000 == 0) {
-						load_msg(std::string(" balances: ") + std::to_string(n));
-					}
-					CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-					ssKey.write(iterator->key().data(), iterator->key().size());
-					string sKey;
-					ssKey >> sKey;
-					if (boost::starts_with(sKey, "utxo")) {
-						CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-						ssValue.write(iterator->value().data(), iterator->value().size());
-						CAddressUnspent unspent;
-						ssValue >> unspent;
-						string sAddress = sKey.substr(4, 34);
-
-						CFractions fractions(unspent.nAmount, CFractions::VALUE);
-						bool       peg_on = unspent.nHeight >= nPegStartHeight;
-						if (!peg_on) {
-							if (!AppendUnspent(sAddress, fractions,
-							                   true /*still sumup as pegbased*/))
-								return error("LoadUtxoData() : AppendUnspent failed");
-						}
-
-						iterator->Next();
-						n++;
-						continue;
-					} else {
-						break;
-					}
-					iterator->Next();
-					n++;
-				}
-				delete iterator;
-			}
-			// peg-based
-			{
-				leveldb::Iterator* iterator = pdb->NewIterator(leveldb::ReadOptions());
-				string             sTxout   = strprintf("%080x", 0);  // 256+64
-				CDataStream        ssStartKey(SER_DISK, CLIENT_VERSION);
-				string             sStart = strprintf("%034x", 0);
-				ssStartKey << "utxo" + sStart + sTxout;
-				iterator->Seek(ssStartKey.str());
-				int n = 0;
-				while (iterator->Valid()) {
-					if (n % 10000 == 0) {
-						load_msg(std::string(" balances: ") + std::to_string(n));
-					}
-					CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-					ssKey.write(iterator->key().data(), iterator->key().size());
-					string sKey;
-					ssKey >> sKey;
-					if (boost::starts_with(sKey, "utxo")) {
-						CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-						ssValue.write(iterator->value().data(), iterator->value().size());
-						CAddressUnspent unspent;
-						ssValue >> unspent;
-						string  sAddress    = sKey.substr(4, 34);
-						string  sTxoutidHex = sKey.substr(4 + 34, 80);
-						uint320 txoutid(sTxoutidHex);
-
-						CFractions fractions(unspent.nAmount, CFractions::VALUE);
-						bool       peg_on = unspent.nHeight >= nPegStartHeight;
-						if (peg_on) {
-							if (!setSkipAddresses.count(sAddress))
-								if (!pegdb.ReadFractions(txoutid, fractions, true /*must_have*/))
-									return error("LoadUtxoData() : ReadFractions failed");
-							if (!AppendUnspent(sAddress, fractions, peg_on))
-								return error("LoadUtxoData() : AppendUnspent failed");
-						}
-
-						iterator->Next();
-						n++;
-						continue;
-					} else {
-						break;
-					}
-					iterator->Next();
-					n++;
-				}
-				delete iterator;
-			}
-		}
+		if (!RebuildPegBalances(load_msg))
+			return false;
 
 		boost::this_thread::interruption_point();
 
-		// utxo db is ready for use
-		WriteUtxoDbIsReady(true);
+		// utxo db is ready for use, the checkpoints go with the same commit:
+		// left behind they would make the next rebuild skip its work
+		if (!TxnBegin())
+			return error("LoadUtxoData() : TxnBegin failed");
+		if (!WriteUtxoDbKeysVersion(UTXODB_KEYS_VERSION) || !WriteUtxoDbIsReady(true))
+			return error("LoadUtxoData() : ready flag write failed");
+		EraseUtxoLoadCheckpoints();
+		if (!TxnCommit())
+			return error("LoadUtxoData() : TxnCommit failed");
 	}
 
 	if (fIsReady && !fEnabled) {
@@ -1317,7 +1937,7 @@ bool CTxDB::LoadUtxoData(LoadMsg load_msg) {
 bool CTxDB::DeductSpent(std::string sAddress, const CFractions& fractions, bool peg_on) {
 	CFractions  base(0, CFractions::VALUE);
 	std::string strValue;
-	if (ReadStr("pegbalance" + sAddress, strValue)) {
+	if (ReadStr(AddressKey(DBKEY_PEGBALANCE, sAddress), strValue)) {
 		CDataStream finp(strValue.data(), strValue.data() + strValue.size(), SER_DISK,
 		                 CLIENT_VERSION);
 		if (!base.Unpack(finp))
@@ -1330,13 +1950,13 @@ bool CTxDB::DeductSpent(std::string sAddress, const CFractions& fractions, bool
 	}
 	CDataStream fout(SER_DISK, CLIENT_VERSION);
 	base.Pack(fout, nullptr, false /*compress*/);
-	return Write("pegbalance" + sAddress, fout);
+	return Write(AddressKey(DBKEY_PEGBALANCE, sAddress), fout);
 }
 
 bool CTxDB::AppendUnspent(std::string sAddress, const CFractions& fractions, bool peg_on) {
 	CFractions  base(0, CFractions::VALUE);
 	std::string strValue;
-	if (ReadStr("pegbalance" + sAddress, strValue)) {
+	if (ReadStr(AddressKey(DBKEY_PEGBALANCE, sAddress), strValue)) {
 		CDataStream finp(strValue.data(), strValue.data() + strValue.size(), SER_DISK,
 		                 CLIENT_VERSION);
 		if (!base.Unpack(finp))
@@ -1349,13 +1969,13 @@ bool CTxDB::AppendUnspent(std::string sAddress, const CFractions& fractions, boo
 	}
 	CDataStream fout(SER_DISK, CLIENT_VERSION);
 	base.Pack(fout, nullptr, false /*compress*/);
-	return Write("pegbalance" + sAddress, fout);
+	return Write(AddressKey(DBKEY_PEGBALANCE, sAddress), fout);
 }
 
 bool CTxDB::ReadPegBalance(std::string sAddress, CFractions& fractions) {
 	fractions = CFractions(0, CFractions::VALUE);
 	std::string strValue;
-	if (ReadStr("pegbalance" + sAddress, strValue)) {
+	if (ReadStr(AddressKey(DBKEY_PEGBALANCE, sAddress), strValue)) {
 		CDataStream finp(strValue.data(), strValue.data() + strValue.size(), SER_DISK,
 		                 CLIENT_VERSION);
 		if (!fractions.Unpack(finp))
@@ -1363,3 +1983,97 @@ bool CTxDB::ReadPegBalance(std::string sAddress, CFractions& fractions) {
 	}
 	return true;
 }
+
+bool CTxDB::WritePegBalance(std::string sAddress, const CFractions& fractions) {
+	CDataStream fout(SER_DISK, CLIENT_VERSION);
+	fractions.Pack(fout, nullptr, false /*compress*/);
+	return Write(AddressKey(DBKEY_PEGBALANCE, sAddress), fout);
+}
+
+bool CAddressBlockOverlay::ReadAddressLastBalance(CTxDB&             txdb,
+                                                  const std::string& sAddress,
+                                                  CAddressBalance&   balance,
+                                                  int64_t&           nIdx) {
+	CAddressState& state = mapStates[sAddress];
+	if (!state.fBalanceLoaded) {
+		state.fHasBalance =
+		    txdb.ReadAddressLastBalance(sAddress, state.balance, state.nLastIndex);
+		state.fBalanceLoaded = true;
+	}
+	nIdx = state.nLastIndex;
+	if (state.fHasBalance)
+		balance = state.balance;
+	return state.fHasBalance;
+}
+
+bool CAddressBlockOverlay::AddBalance(CTxDB&                 txdb,
+                                      const std::string&     sAddress,
+                                      int64_t                nIndex,
+                                      const CAddressBalance& balance) {
+	if (!txdb.AddBalance(sAddress, nIndex, balance))
+		return false;
+	CAddressState& state = mapStates[sAddress];
+	state.fBalanceLoaded = true;
+	state.fHasBalance    = true;
+	state.nLastIndex     = nIndex;
+	state.balance        = balance;
+	return true;
+}
+
+CAddressBlockOverlay::CAddressState* CAddressBlockOverlay::GetPegState(
+    CTxDB& txdb, const std::string& sAddress) {
+	CAddressState& state = mapStates[sAddress];
+	if (!state.fPegLoaded) {
+		if (!txdb.ReadPegBalance(sAddress, state.pegbalance))
+			return nullptr;
+		state.fPegLoaded = true;
+	}
+	return &state;
+}
+
+bool CAddressBlockOverlay::DeductSpent(CTxDB&             txdb,
+                                       const std::string& sAddress,
+                                       const CFractions&  fractions,
+                                       bool               peg_on) {
+	CAddressState* pstate = GetPegState(txdb, sAddress);
+	if (!pstate)
+		return false;
+	CFractions& base = pstate->pegbalance;
+	if (!peg_on) {
+		base = CFractions(base.Total() - fractions.Total(), CFractions::VALUE);
+	} else {
+		base -= fractions;
+	}
+	pstate->fPegDirty = true;
+	return true;
+}
+
+bool CAddressBlockOverlay::AppendUnspent(CTxDB&             txdb,
+                                         const std::string& sAddress,
+                                         const CFractions&  fractions,
+                                         bool               peg_on) {
+	CAddressState* pstate = GetPegState(txdb, sAddress);
+	if (!pstate)
+		return false;
+	CFractions& base = pstate->pegbalance;
+	if (!peg_on) {
+		base = CFractions(base.Total() + fractions.Total(), CFractions::VALUE);
+	} else {
+		base += fractions;
+	}
+	pstate->fPegDirty = true;
+	return true;
+}
+
+bool CAddressBlockOverlay::Flush(CTxDB& txdb) {
+	for (auto& item : mapStates) {
+		CAddressState& state = item.second;
+		if (!state.fPegDirty)
+			continue;
+		if (!txdb.WritePegBalance(item.first, state.pegbalance))
+			return false;
+		state.fPegDirty = false;
+	}
+	mapStates.clear();
+	return true;
+}
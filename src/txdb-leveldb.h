@@ -9,13 +9,73 @@
 
 #include "main.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+// LevelDB options with the memory budget of txleveldb or pegleveldb:
+// -leveldbcache is split between both unless -txdbcache/-pegdbcache set.
+leveldb::Options GetLevelDBOptions(bool fPegDB);
+
+// Batch commits timing of one database, write stalls of compaction
+// show up here as the batch write waits for the memtable to flush.
+struct CLevelDBCommitTimes {
+	std::atomic<int64_t> nCommits{0};
+	std::atomic<int64_t> nTime{0};
+	std::atomic<int64_t> nTimeMax{0};
+
+	void Add(int64_t nMicros);
+};
+
+// LevelDB properties and counters of one database, see getdbstats
+struct CLevelDBStats {
+	std::string strStats;  // leveldb.stats
+	uint64_t    nApproximateSize = 0;
+	uint64_t    nMemoryUsage     = 0;
+	size_t      nCacheUsage      = 0;
+	size_t      nWriteBufferSize = 0;
+	size_t      nMaxFileSize     = 0;
+	int64_t     nCommits         = 0;
+	int64_t     nCommitTime      = 0;
+	int64_t     nCommitTimeMax   = 0;
+};
+
+// Progress of one shard of the peg balances rebuild of LoadUtxoData: the
+// utxo address key range [sBegin, sEnd) is done up to and including sLast.
+struct CUtxoLoadShard {
+	std::string sBegin;
+	std::string sEnd;  // empty for the last shard
+	std::string sLast;
+	bool        fDone = false;
+
+	IMPLEMENT_SERIALIZE(READWRITE(sBegin); READWRITE(sEnd); READWRITE(sLast); READWRITE(fDone);)
+};
+
+// Progress of one key range of a one-shot index migration, see
+// CTxDB::MigrateIndex: records of the range are done up to hashLast.
+struct CIndexMigrationRange {
+	uint256 hashLast;  // 0 when not started
+	bool    fDone = false;
+
+	IMPLEMENT_SERIALIZE(READWRITE(hashLast); READWRITE(fDone);)
+};
+
+class CTxDB;
+// Rewrites one record of a migration from its stored value
+typedef std::function<bool(CTxDB& txdb, const uint256& hash, CDataStream& ssValue)>
+    IndexMigrationFn;
+
+bool GetLevelDBStats(leveldb::DB*               pdb,
+                     const leveldb::Options&    options,
+                     const CLevelDBCommitTimes& times,
+                     CLevelDBStats&             stats);
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -40,6 +100,8 @@ public:
 	// Destroys the underlying shared global state accessed by this TxDB.
 	void Close();
 
+	static bool GetStats(CLevelDBStats& stats);
+
 	struct cmpBySlice {
 		bool operator()(const std::string& a, const std::string& b) const {
 			leveldb::Slice sa(a);
@@ -362,6 +424,7 @@ public:
 	bool WriteVersion(int nVersion) { return Write(std::string("version"), nVersion); }
 
 	static CBlockIndex* InsertBlockIndex(uint256 hash);
+	static CBlockIndex* InsertDiskBlockIndex(const uint256& hash, const CDiskBlockIndex& diskindex);
 
 	bool ReadTxIndex(uint256 hash, CTxIndex& txindex);
 	bool UpdateTxIndex(uint256 hash, const CTxIndex& txindex);
@@ -376,14 +439,46 @@ public:
 	bool ReadDiskTx(COutPoint outpoint, CTransaction& tx, CTxIndex& txindex);
 	bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
 	bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+	bool WriteBlockIndex(const uint256& hashBlock, const CDiskBlockIndex& blockindex);
 	bool ReadHashBestChain(uint256& hashBestChain);
 	bool WriteHashBestChain(uint256 hashBestChain);
 	bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
 	bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
 	bool LoadBlockIndex(LoadMsg load_msg);
+	bool LoadBlockIndexRecords(LoadMsg load_msg);
+
+	// One-shot rewrite of all records of strType keyed by hash, run over
+	// key ranges in parallel, committed in chunks with the progress of
+	// every range kept under strName so an interrupted run resumes.
+	bool MigrateIndex(const std::string& strType,
+	                  const std::string& strName,
+	                  const std::string& strProgress,
+	                  IndexMigrationFn   fn,
+	                  LoadMsg            load_msg);
+	bool MigrateIndexRange(const std::string&    strType,
+	                       const std::string&    strName,
+	                       int                   nRange,
+	                       CIndexMigrationRange& range,
+	                       IndexMigrationFn      fn,
+	                       std::atomic<int64_t>& nRecords,
+	                       std::atomic<bool>&    fFailed);
+	bool EraseIndexMigration(const std::string& strName);
+	// flat copy of the block index written on clean shutdown, see
+	// -blockindexsnapshot; valid while its id is in the db
+	bool ReadBlockIndexSnapshot(LoadMsg load_msg);
+	bool WriteBlockIndexSnapshot();
+	bool ReadBlockIndexSnapshotId(uint64_t& nId);
+	bool WriteBlockIndexSnapshotId(uint64_t nId);
+	bool EraseBlockIndexSnapshotId();
 	bool LoadUtxoData(LoadMsg load_msg);
 	bool CleanupUtxoData(LoadMsg load_msg);
 	bool CleanupPegBalances(LoadMsg load_msg);
+	bool RebuildPegBalances(LoadMsg load_msg);
+	bool RebuildPegBalancesShard(int                          nShard,
+	                             CUtxoLoadShard&              shard,
+	                             const std::set<std::string>& setSkipAddresses,
+	                             std::atomic<int64_t>&        nUnspents,
+	                             std::atomic<bool>&           fFailed);
 
 	// flags for peg system peg
 	bool ReadPegStartHeight(int& nHeight);
@@ -404,55 +499,74 @@ public:
 	bool ReadUtxoDbIsReady(bool& bReady);
 	bool WriteUtxoDbIsReady(bool bReady);
 
+	bool ReadUtxoDbKeysVersion(int& nKeysVersion);
+	bool WriteUtxoDbKeysVersion(int nKeysVersion);
+
+	// checkpoints of an interrupted utxo db rebuild
+	bool ReadUtxoLoadHeight(int& nHeight);
+	bool WriteUtxoLoadHeight(int nHeight);
+	bool ReadUtxoLoadShards(int& nShards);
+	bool WriteUtxoLoadShards(int nShards);
+	bool ReadUtxoLoadShard(int nShard, CUtxoLoadShard& shard);
+	bool WriteUtxoLoadShard(int nShard, const CUtxoLoadShard& shard);
+	bool EraseUtxoLoadCheckpoints();
+
 	bool ReadAddressLastBalance(string addr, CAddressBalance& balance, int64_t& nIdx);
 	bool ReadFrozenQueue(uint64_t nLockTime, std::vector<CFrozenQueued>&);
 	bool ReadFrozenQueued(uint64_t nLockTime, uint320 txoutid, CFrozenQueued&);
 
+	// Address index records (utxo, ftxo, balances, frozen queue, peg
+	// balances) are keyed by one type byte and fixed width binary fields:
+	// 34 chars address, big endian index/locktime, 40 bytes txoutid stored
+	// in GetHex() order so scans keep the same ordering as hex text keys.
+	enum {
+		DBKEY_UTXO       = 0x01,
+		DBKEY_FTXO       = 0x02,
+		DBKEY_BALANCE    = 0x03,
+		DBKEY_FQUEUE     = 0x04,
+		DBKEY_PEGBALANCE = 0x05,
+	};
+	static std::string AddressKey(char type, const std::string& sAddress);
+	static std::string TxoutKey(char type, const std::string& sAddress, const uint320& txoutid);
+	static std::string BalanceKey(const std::string& sAddress, int64_t nIndex);
+	static std::string FrozenQueueKey(uint64_t nLockTime, const uint320& txoutid);
+	static uint64_t    ParseKeyBE64(const std::string& sKey, size_t nPos);
+	static uint320     ParseKeyTxout(const std::string& sKey, size_t nPos);
+
 	bool AddUnspent(std::string sAddress, uint320 txoutid, const CAddressUnspent& utxo) {
-		string sTxout = txoutid.GetHex();
-		return Write("utxo" + sAddress + sTxout, utxo);
+		return Write(TxoutKey(DBKEY_UTXO, sAddress, txoutid), utxo);
 	}
 	bool ReadUnspent(std::string sAddress, uint320 txoutid, CAddressUnspent& utxo) {
-		string sTxout = txoutid.GetHex();
-		return Read("utxo" + sAddress + sTxout, utxo);
+		return Read(TxoutKey(DBKEY_UTXO, sAddress, txoutid), utxo);
 	}
 	bool EraseUnspent(std::string sAddress, uint320 txoutid) {
-		string sTxout = txoutid.GetHex();
-		return Erase("utxo" + sAddress + sTxout);
+		return Erase(TxoutKey(DBKEY_UTXO, sAddress, txoutid));
 	}
 	bool AddFrozen(std::string sAddress, uint320 txoutid, const CAddressUnspent& ftxo) {
-		string sTxout = txoutid.GetHex();
-		return Write("ftxo" + sAddress + sTxout, ftxo);
+		return Write(TxoutKey(DBKEY_FTXO, sAddress, txoutid), ftxo);
 	}
 	bool ReadFrozen(std::string sAddress, uint320 txoutid, CAddressUnspent& ftxo) {
-		string sTxout = txoutid.GetHex();
-		return Read("ftxo" + sAddress + sTxout, ftxo);
+		return Read(TxoutKey(DBKEY_FTXO, sAddress, txoutid), ftxo);
 	}
 	bool EraseFrozen(std::string sAddress, uint320 txoutid) {
-		string sTxout = txoutid.GetHex();
-		return Erase("ftxo" + sAddress + sTxout);
+		return Erase(TxoutKey(DBKEY_FTXO, sAddress, txoutid));
 	}
 	bool AddBalance(std::string sAddress, int64_t nIndex, const CAddressBalance& balance) {
-		string sRIndex = strprintf("%016x", INT64_MAX - nIndex);
-		return Write("addr" + sAddress + sRIndex, balance);
+		return Write(BalanceKey(sAddress, nIndex), balance);
 	}
 	bool EraseBalance(std::string sAddress, int64_t nIndex) {
-		string sRIndex = strprintf("%016x", INT64_MAX - nIndex);
-		return Erase("addr" + sAddress + sRIndex);
+		return Erase(BalanceKey(sAddress, nIndex));
 	}
 	bool AddToFrozenQueue(uint64_t nLockTime, uint320 txoutid, const CFrozenQueued& record) {
-		string sTime  = strprintf("%016x", nLockTime);
-		string sTxout = txoutid.GetHex();
-		return Write("fqueue" + sTime + sTxout, record);
+		return Write(FrozenQueueKey(nLockTime, txoutid), record);
 	}
 	bool EraseFromFrozenQueue(uint64_t nLockTime, uint320 txoutid) {
-		string sTime  = strprintf("%016x", nLockTime);
-		string sTxout = txoutid.GetHex();
-		return Erase("fqueue" + sTime + sTxout);
+		return Erase(FrozenQueueKey(nLockTime, txoutid));
 	}
 	bool DeductSpent(std::string sAddress, const CFractions& fractions, bool peg_on);
 	bool AppendUnspent(std::string sAddress, const CFractions& fractions, bool peg_on);
 	bool ReadPegBalance(std::string sAddress, CFractions& fractions);
+	bool WritePegBalance(std::string sAddress, const CFractions& fractions);
 
 	// warning: this method use disk Seek and ignores current batch
 	bool ReadAddressBalanceRecords(string addr, vector<CAddressBalance>& records);
@@ -462,6 +576,43 @@ public:
 	bool ReadAddressFrozen(string addr, vector<CAddressUnspent>& records);
 };
 
+// Address state of the block being connected: last balance record and
+// peg balance of each touched address are read once, kept in memory while
+// the transactions of the block are connected, and the peg balances are
+// written once in Flush() instead of a read-modify-write per txout.
+class CAddressBlockOverlay {
+	struct CAddressState {
+		bool            fBalanceLoaded = false;
+		bool            fHasBalance    = false;
+		int64_t         nLastIndex     = -1;
+		CAddressBalance balance;
+		bool            fPegLoaded = false;
+		bool            fPegDirty  = false;
+		CFractions      pegbalance;
+	};
+	std::map<std::string, CAddressState> mapStates;
+
+	CAddressState* GetPegState(CTxDB& txdb, const std::string& sAddress);
+
+public:
+	// same as CTxDB::ReadAddressLastBalance but sees records of this block
+	bool ReadAddressLastBalance(CTxDB&             txdb,
+	                            const std::string& sAddress,
+	                            CAddressBalance&   balance,
+	                            int64_t&           nIdx);
+	bool AddBalance(CTxDB&                 txdb,
+	                const std::string&     sAddress,
+	                int64_t                nIndex,
+	                const CAddressBalance& balance);
+	bool DeductSpent(CTxDB& txdb, const std::string& sAddress, const CFractions& fractions,
+	                 bool peg_on);
+	bool AppendUnspent(CTxDB& txdb, const std::string& sAddress, const CFractions& fractions,
+	                   bool peg_on);
+	// write changed peg balances, one write per address
+	bool Flush(CTxDB& txdb);
+	size_t size() const { return mapStates.size(); }
+};
+
 extern leveldb::DB* txdb;  // global pointer for LevelDB object instance
 
 #endif  // BITCOIN_DB_H
@@ -8,6 +8,10 @@
 #include "main.h"  // for CTransaction
 #include "txdb.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 using namespace std;
 
 CTxMemPool::CTxMemPool() {}
@@ -22,10 +26,136 @@ void CTxMemPool::AddTransactionsUpdated(uint32_t n) {
 	nTransactionsUpdated += n;
 }
 
-bool CTxMemPool::addUnchecked(const uint256&    hash,
-                              CTransaction&     tx,
-                              const MapPrevOut& mapInputs,
-                              MapFractions&     mapFractions) {
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& tx,
+                                 const MapPrevTx&    mapInputs,
+                                 int64_t             nFeeIn,
+                                 int                 nHeight,
+                                 int64_t             nTimeIn) {
+	nTxSize              = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+	nFee                 = nFeeIn;
+	nValueIn             = nFeeIn + tx.GetValueOut();
+	nEntryHeight         = nHeight;
+	nTime                = nTimeIn;
+	nSizeWithAncestors   = nTxSize;
+	nFeesWithAncestors   = nFee;
+	nSizeWithDescendants = nTxSize;
+	nFeesWithDescendants = nFee;
+
+	// priority is sum(valuein * age) / txsize, inputs from the pool have no age
+	double dPriority = 0;
+	for (const CTxIn& txin : tx.vin) {
+		int64_t nValue = 0;
+		int     nConf  = 0;
+		if (tx.IsCoinMint()) {
+			nConf = nHeight - tx.nTime /*for CoinMint nTime is set as merkle height +1*/;
+			if (txin.prevout.hash != 0)
+				nValue = tx.vout[0].nValue + MINT_TX_FEE;
+		} else {
+			auto it = mapInputs.find(txin.prevout.hash);
+			if (it == mapInputs.end())
+				continue;
+			const CTxIndex&     txindex = it->second.first;
+			const CTransaction& txPrev  = it->second.second;
+			if (txindex.pos.IsNull() || txindex.pos == CDiskTxPos(1, 1, 1))
+				continue;
+			if (txin.prevout.n < txPrev.vout.size())
+				nValue = txPrev.vout[txin.prevout.n].nValue;
+			nConf = txindex.nHeight > 0 ? nHeight - int(txindex.nHeight) + 1
+			                            : txindex.GetDepthInMainChain();
+		}
+		nChainValueIn += nValue;
+		dPriority += double(nValue) * nConf;
+	}
+	dEntryPriority = dPriority / nTxSize;
+}
+
+double CTxMemPoolEntry::GetPriority(int nHeight) const {
+	return dEntryPriority + double(nChainValueIn) * (nHeight - nEntryHeight) / nTxSize;
+}
+
+bool CPegReviewInfo::NeedsReview(int nSupplyNew) const {
+	if (fAlwaysReview)
+		return true;
+	// slots [nFrom, nTo) change side between reserve and liquidity
+	int nFrom = std::min(nSupply, nSupplyNew);
+	int nTo   = std::max(nSupply, nSupplyNew);
+	return nFrom <= nSlotMax && nTo > nSlotMin;
+}
+
+static CPegReviewInfo MakePegReviewInfo(const CTransaction& tx,
+                                        int                 nSupply,
+                                        const MapFractions& mapInputsFractions) {
+	CPegReviewInfo info;
+	info.nSupply       = nSupply;
+	info.fAlwaysReview = tx.IsCoinMint();
+
+	for (const CTxOut& txout : tx.vout) {
+		string sNotary;
+		if (txout.scriptPubKey.ToNotary(sNotary))
+			info.fAlwaysReview = true;
+	}
+
+	const uint32_t nMarks =
+	    CFractions::NOTARY_F | CFractions::NOTARY_L | CFractions::NOTARY_V | CFractions::NOTARY_C;
+	for (const CTxIn& txin : tx.vin) {
+		if (info.fAlwaysReview)
+			break;
+		auto it = mapInputsFractions.find(uint320(txin.prevout.hash, txin.prevout.n));
+		if (it == mapInputsFractions.end() || (it->second.nFlags & nMarks)) {
+			info.fAlwaysReview = true;
+			break;
+		}
+		const CFractions& fr = it->second;
+		if (fr.nFlags & CFractions::VALUE) {
+			// not yet distributed, can land on any slot
+			info.nSlotMin = 0;
+			info.nSlotMax = PEG_SIZE - 1;
+			continue;
+		}
+		for (int i = 0; i < PEG_SIZE; i++) {
+			if (fr.f[i] == 0)
+				continue;
+			if (info.nSlotMax < info.nSlotMin || i < info.nSlotMin)
+				info.nSlotMin = i;
+			if (i > info.nSlotMax)
+				info.nSlotMax = i;
+		}
+	}
+	return info;
+}
+
+// Heap usage estimates: allocations round up to 16 bytes and tree nodes
+// carry three pointers and a color next to the value.
+static size_t MallocUsage(size_t nAlloc) {
+	return nAlloc == 0 ? 0 : ((nAlloc + 31) >> 4) << 4;
+}
+
+template <typename T>
+static size_t NodeUsage() {
+	return MallocUsage(sizeof(T) + 4 * sizeof(void*));
+}
+
+static size_t TxUsage(const CTransaction& tx) {
+	size_t nUsage = MallocUsage(tx.vin.capacity() * sizeof(CTxIn)) +
+	                MallocUsage(tx.vout.capacity() * sizeof(CTxOut));
+	for (const CTxIn& txin : tx.vin)
+		nUsage += MallocUsage(txin.scriptSig.capacity());
+	for (const CTxOut& txout : tx.vout)
+		nUsage += MallocUsage(txout.scriptPubKey.capacity());
+	return nUsage;
+}
+
+static size_t PackedUsage(const string& strPacked) {
+	return NodeUsage<pair<const uint320, string>>() +
+	       (strPacked.capacity() > 15 ? MallocUsage(strPacked.capacity() + 1) : 0);
+}
+
+bool CTxMemPool::addUnchecked(const uint256&         hash,
+                              CTransaction&          tx,
+                              const CTxMemPoolEntry& entry,
+                              const MapPrevOut&      mapInputs,
+                              const MapFractions&    mapInputsFractions,
+                              MapFractions&          mapFractions) {
 	// Add to memory pool without checking anything.
 	// Used by main.cpp AcceptToMemoryPool(), which DOES do
 	// all the appropriate checks.
@@ -39,17 +169,53 @@ bool CTxMemPool::addUnchecked(const uint256&    hash,
 			}
 		}
 		nTransactionsUpdated++;
+		mapPrevOuts[hash] = mapInputs;
+		if (pindexBest)
+			mapPegReview[hash] =
+			    MakePegReviewInfo(tx, pindexBest->nPegSupplyIndex, mapInputsFractions);
+		// index the entry
+		mapEntries[hash] = entry;
+		updateAncestorState(hash, entry);
+		CTxMemPoolEntry& added = mapEntries[hash];
+		setByAncestorFeeRate.insert(make_pair(added.GetAncestorFeePerKb(), hash));
+		setByDescendantScore.insert(make_pair(added.GetDescendantScore(), hash));
+		setByTime.insert(make_pair(added.nTime, hash));
+		updateDescendantsOnAdd(hash);
 		// store fractions
 		for (MapFractions::iterator mi = mapFractions.begin(); mi != mapFractions.end(); ++mi) {
 			CDataStream fout(SER_DISK, CLIENT_VERSION);
 			(*mi).second.Pack(fout);
-			mapPackedFractions[(*mi).first] = fout.str();
+			setPackedFractions((*mi).first, fout.str());
 		}
-		mapPrevOuts[hash] = mapInputs;
+		// memory of the entry besides fractions
+		added.nUsage = NodeUsage<pair<const uint256, CTransaction>>() + TxUsage(tx) +
+		               NodeUsage<pair<const uint256, MapPrevOut>>() +
+		               NodeUsage<pair<const uint256, CTxMemPoolEntry>>() +
+		               NodeUsage<pair<const uint256, CPegReviewInfo>>() +
+		               3 * NodeUsage<pair<double, uint256>>();
+		for (const auto& item : mapInputs)
+			added.nUsage += NodeUsage<pair<const uint320, CTxOut>>() +
+			                MallocUsage(item.second.scriptPubKey.capacity());
+		added.nUsage += tx.vin.size() * NodeUsage<pair<const COutPoint, CInPoint>>();
+		nUsage += added.nUsage;
+		nBytes += added.nTxSize;
 	}
 	return true;
 }
 
+bool CTxMemPool::addUncheckedAndTrim(const uint256&         hash,
+                                     CTransaction&          tx,
+                                     const CTxMemPoolEntry& entry,
+                                     const MapPrevOut&      mapInputs,
+                                     const MapFractions&    mapInputsFractions,
+                                     MapFractions&          mapFractions,
+                                     size_t                 nMaxUsage) {
+	LOCK(cs);
+	addUnchecked(hash, tx, entry, mapInputs, mapInputsFractions, mapFractions);
+	TrimToSize(nMaxUsage);
+	return mapTx.count(hash) != 0;
+}
+
 bool CTxMemPool::remove(const CTransaction& tx, bool fRecursive) {
 	// Remove transaction from memory pool
 	{
@@ -67,17 +233,211 @@ bool CTxMemPool::remove(const CTransaction& tx, bool fRecursive) {
 				mapNextTx.erase(txin.prevout);
 			}
 			for (size_t i = 0; i < tx.vout.size(); i++) {
-				auto fkey = uint320(hash, i);
-				mapPackedFractions.erase(fkey);
+				auto fkey     = uint320(hash, i);
+				auto itPacked = mapPackedFractions.find(fkey);
+				if (itPacked == mapPackedFractions.end())
+					continue;
+				nFractionsUsage -= PackedUsage(itPacked->second);
+				mapPackedFractions.erase(itPacked);
+			}
+			auto itEntry = mapEntries.find(hash);
+			if (itEntry != mapEntries.end()) {
+				const CTxMemPoolEntry& entry = itEntry->second;
+				updateDescendantsOnRemove(tx, entry);
+				updateAncestorsOnRemove(hash, entry);
+				setByAncestorFeeRate.erase(make_pair(entry.GetAncestorFeePerKb(), hash));
+				setByDescendantScore.erase(make_pair(entry.GetDescendantScore(), hash));
+				setByTime.erase(make_pair(entry.nTime, hash));
+				nUsage -= entry.nUsage;
+				nBytes -= entry.nTxSize;
+				mapEntries.erase(itEntry);
 			}
 			mapTx.erase(hash);
 			mapPrevOuts.erase(hash);
+			mapPegReview.erase(hash);
 			nTransactionsUpdated++;
 		}
 	}
 	return true;
 }
 
+void CTxMemPool::getAncestors(const uint256& hash, set<uint256>& setAncestors) const {
+	LOCK(cs);
+	vector<uint256> vStack(1, hash);
+	while (!vStack.empty()) {
+		auto it = mapTx.find(vStack.back());
+		vStack.pop_back();
+		if (it == mapTx.end())
+			continue;
+		for (const CTxIn& txin : it->second.vin) {
+			const uint256& prevhash = txin.prevout.hash;
+			if (mapTx.count(prevhash) && setAncestors.insert(prevhash).second)
+				vStack.push_back(prevhash);
+		}
+	}
+}
+
+void CTxMemPool::getDescendants(const uint256& hash, set<uint256>& setDescendants) const {
+	LOCK(cs);
+	vector<uint256> vStack(1, hash);
+	while (!vStack.empty()) {
+		uint256 txhash = vStack.back();
+		vStack.pop_back();
+		auto itTx = mapTx.find(txhash);
+		if (itTx == mapTx.end())
+			continue;
+		for (uint32_t i = 0; i < itTx->second.vout.size(); i++) {
+			auto it = mapNextTx.find(COutPoint(txhash, i));
+			if (it == mapNextTx.end())
+				continue;
+			uint256 childhash = it->second.ptx->GetHash();
+			if (setDescendants.insert(childhash).second)
+				vStack.push_back(childhash);
+		}
+	}
+}
+
+void CTxMemPool::updateAncestorState(const uint256& hash, const CTxMemPoolEntry& entry) {
+	set<uint256> setAncestors;
+	getAncestors(hash, setAncestors);
+	CTxMemPoolEntry& e    = mapEntries[hash];
+	e.nCountWithAncestors = 1 + setAncestors.size();
+	e.nSizeWithAncestors  = entry.nTxSize;
+	e.nFeesWithAncestors  = entry.nFee;
+	for (const uint256& ancestor : setAncestors) {
+		auto it = mapEntries.find(ancestor);
+		if (it == mapEntries.end())
+			continue;
+		CTxMemPoolEntry& a = it->second;
+		e.nSizeWithAncestors += a.nTxSize;
+		e.nFeesWithAncestors += a.nFee;
+		setByDescendantScore.erase(make_pair(a.GetDescendantScore(), ancestor));
+		a.nCountWithDescendants++;
+		a.nSizeWithDescendants += entry.nTxSize;
+		a.nFeesWithDescendants += entry.nFee;
+		setByDescendantScore.insert(make_pair(a.GetDescendantScore(), ancestor));
+	}
+}
+
+void CTxMemPool::updateAncestorsOnRemove(const uint256& hash, const CTxMemPoolEntry& entry) {
+	// a tx leaving the pool is no longer a descendant of its ancestors
+	set<uint256> setAncestors;
+	getAncestors(hash, setAncestors);
+	for (const uint256& ancestor : setAncestors) {
+		auto it = mapEntries.find(ancestor);
+		if (it == mapEntries.end())
+			continue;
+		CTxMemPoolEntry& a = it->second;
+		setByDescendantScore.erase(make_pair(a.GetDescendantScore(), ancestor));
+		a.nCountWithDescendants--;
+		a.nSizeWithDescendants -= entry.nTxSize;
+		a.nFeesWithDescendants -= entry.nFee;
+		setByDescendantScore.insert(make_pair(a.GetDescendantScore(), ancestor));
+	}
+}
+
+void CTxMemPool::setPackedFractions(const uint320& fkey, const string& strPacked) {
+	string& strValue = mapPackedFractions[fkey];
+	if (!strValue.empty())
+		nFractionsUsage -= PackedUsage(strValue);
+	strValue = strPacked;
+	nFractionsUsage += PackedUsage(strValue);
+}
+
+size_t CTxMemPool::TrimToSize(size_t nMaxUsage) {
+	LOCK(cs);
+	size_t nRemoved = 0;
+	while (nUsage + nFractionsUsage > nMaxUsage && !setByDescendantScore.empty()) {
+		uint256 hash = setByDescendantScore.begin()->second;
+		auto    it   = mapTx.find(hash);
+		if (it == mapTx.end()) {
+			setByDescendantScore.erase(setByDescendantScore.begin());
+			continue;
+		}
+		size_t       nSizeBefore = mapTx.size();
+		CTransaction tx          = it->second;
+		remove(tx, true /*with descendants*/);
+		nRemoved += nSizeBefore - mapTx.size();
+	}
+	if (nRemoved) {
+		nEvicted += nRemoved;
+		LogPrint("mempool", "TrimToSize() : evicted %u txs, usage %u of %u\n", nRemoved,
+		         nUsage + nFractionsUsage, nMaxUsage);
+	}
+	return nRemoved;
+}
+
+void CTxMemPool::updateDescendantsOnRemove(const CTransaction& tx, const CTxMemPoolEntry& entry) {
+	// a tx leaving the pool (mined) is no longer an ancestor of its descendants
+	set<uint256> setDescendants;
+	getDescendants(tx.GetHash(), setDescendants);
+	for (const uint256& hash : setDescendants) {
+		auto it = mapEntries.find(hash);
+		if (it == mapEntries.end())
+			continue;
+		CTxMemPoolEntry& e = it->second;
+		setByAncestorFeeRate.erase(make_pair(e.GetAncestorFeePerKb(), hash));
+		e.nCountWithAncestors--;
+		e.nSizeWithAncestors -= entry.nTxSize;
+		e.nFeesWithAncestors -= entry.nFee;
+		setByAncestorFeeRate.insert(make_pair(e.GetAncestorFeePerKb(), hash));
+	}
+}
+
+void CTxMemPool::updateDescendantsOnAdd(const uint256& hash) {
+	// a tx coming back from a disconnected block may already have children
+	// in the pool: they gain it and its ancestors, which gain them. Recounted
+	// rather than incremented, some of these links may already exist through
+	// another path.
+	set<uint256> setDescendants;
+	getDescendants(hash, setDescendants);
+	if (setDescendants.empty())
+		return;
+	for (const uint256& descendant : setDescendants) {
+		auto it = mapEntries.find(descendant);
+		if (it == mapEntries.end())
+			continue;
+		CTxMemPoolEntry& e = it->second;
+		set<uint256>     setAncestors;
+		getAncestors(descendant, setAncestors);
+		setByAncestorFeeRate.erase(make_pair(e.GetAncestorFeePerKb(), descendant));
+		e.nCountWithAncestors = 1 + setAncestors.size();
+		e.nSizeWithAncestors  = e.nTxSize;
+		e.nFeesWithAncestors  = e.nFee;
+		for (const uint256& ancestor : setAncestors) {
+			auto itAncestor = mapEntries.find(ancestor);
+			if (itAncestor == mapEntries.end())
+				continue;
+			e.nSizeWithAncestors += itAncestor->second.nTxSize;
+			e.nFeesWithAncestors += itAncestor->second.nFee;
+		}
+		setByAncestorFeeRate.insert(make_pair(e.GetAncestorFeePerKb(), descendant));
+	}
+	set<uint256> setAncestors;
+	getAncestors(hash, setAncestors);
+	setAncestors.insert(hash);
+	for (const uint256& ancestor : setAncestors) {
+		auto it = mapEntries.find(ancestor);
+		if (it == mapEntries.end())
+			continue;
+		CTxMemPoolEntry& a = it->second;
+		set<uint256>     setOfAncestor;
+		getDescendants(ancestor, setOfAncestor);
+		setByDescendantScore.erase(make_pair(a.GetDescendantScore(), ancestor));
+		a.nCountWithDescendants = 1 + setOfAncestor.size();
+		a.nSizeWithDescendants  = a.nTxSize;
+		a.nFeesWithDescendants  = a.nFee;
+		for (const uint256& descendant : setOfAncestor) {
+			auto itDescendant = mapEntries.find(descendant);
+			if (itDescendant == mapEntries.end())
+				continue;
+			a.nSizeWithDescendants += itDescendant->second.nTxSize;
+			a.nFeesWithDescendants += itDescendant->second.nFee;
+		}
+		setByDescendantScore.insert(make_pair(a.GetDescendantScore(), ancestor));
+	}
+}
+
 bool CTxMemPool::removeConflicts(const CTransaction& tx) {
 	// Remove transactions which depend on inputs of tx, recursively
 	LOCK(cs);
@@ -92,122 +452,255 @@ bool CTxMemPool::removeConflicts(const CTransaction& tx) {
 	return true;
 }
 
-void CTxMemPool::reviewOnPegChange() {
-	LOCK(cs);
-	vector<uint256> vRemove;
+// One transaction to recalculate; inputs spent from the pool are filled in
+// advance so workers never have to look up the pool (and take its lock).
+struct CPegReviewJob {
+	CTransaction* ptx = nullptr;
+	MapPrevTx     mapInputs;
+	MapFractions  mapInputsFractions;
+	MapFractions  mapOutputsFractions;
+	bool          fOk = false;
+};
 
-	// build reverse map in->out to find roots
-	map<CInPoint, COutPoint> mapPrevTx;
-	for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
-		CTransaction& tx   = (*mi).second;
-		uint256       hash = tx.GetHash();
-		for (uint32_t i = 0; i < tx.vout.size(); i++) {
-			std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-			if (it != mapNextTx.end()) {
-				mapPrevTx[it->second] = COutPoint(hash, i);
-			}
-		}
-	}
+struct CPegReviewContext {
+	CBlockIndex*             pindex = nullptr;
+	map<string, CBridgeInfo> bridges;
+	int64_t                  nVirtBlockTime = 0;
+};
 
-	// start peg checks from tx non-dependent on other tx
-	for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
-		CTransaction& tx         = (*mi).second;
-		bool          fDependent = false;
-		for (uint32_t i = 0; i < tx.vin.size(); i++) {
-			std::map<CInPoint, COutPoint>::iterator it = mapPrevTx.find(CInPoint(&tx, i));
-			if (it != mapPrevTx.end()) {
-				fDependent = true;
-			}
+static void ReviewPegJob(CPegReviewJob&           job,
+                         const CPegReviewContext& ctx,
+                         CTxDB&                   txdb,
+                         CPegDB&                  pegdb) {
+	CTransaction&          tx = *job.ptx;
+	map<uint256, CTxIndex> mapUnused;
+	MapFractions           mapTestFractionsUnused;
+	CFractions             feesFractions;
+	CBlockIndex*           pindex          = ctx.pindex;
+	int                    nBridgePoolNout = pindex->nHeight;
+	auto fnMerkleIn = [&](string hash) { return pindex->ReadMerkleIn(pegdb, hash); };
+
+	job.fOk = false;
+	try {
+		bool fInvalid = false;
+		if (!tx.FetchInputs(txdb, pegdb, nBridgePoolNout, false /*to read*/, ctx.bridges,
+		                    fnMerkleIn, mapUnused, mapTestFractionsUnused, false /*is block*/,
+		                    false /*is miner*/, ctx.nVirtBlockTime, false /*skip pruned*/,
+		                    job.mapInputs, job.mapInputsFractions, fInvalid)) {
+			if (fInvalid)
+				return;
 		}
-		if (!fDependent) {
-			reviewOnPegChange(tx, vRemove);
+
+		string sPegFailCause;
+		if (tx.IsCoinMint()) {
+			job.fOk = CalculateCoinMintFractions(
+			    tx, pindex->nPegSupplyIndex, pindex->nTime, ctx.bridges, fnMerkleIn,
+			    nBridgePoolNout, job.mapInputs, job.mapInputsFractions, job.mapOutputsFractions,
+			    feesFractions, sPegFailCause);
+		} else {
+			set<uint32_t> sTimeLockPassInputs;
+			job.fOk = CalculateStandardFractions(
+			    tx, pindex->nPegSupplyIndex, pindex->nTime, job.mapInputs,
+			    job.mapInputsFractions, sTimeLockPassInputs, job.mapOutputsFractions,
+			    feesFractions, sPegFailCause);
 		}
+		if (!job.fOk)
+			LogPrint("mempool", "reviewOnPegChange : remove %s: %s\n", tx.GetHash().ToString(),
+			         sPegFailCause);
+	} catch (std::exception& e) {
+		PrintExceptionContinue(&e, "ReviewPegJob()");
+		job.fOk = false;
 	}
+}
 
-	// remove collected and all dependent
-	for (uint256 hash : vRemove) {
-		std::map<uint256, CTransaction>::const_iterator it = mapTx.find(hash);
-		if (it == mapTx.end())
-			continue;
-		const CTransaction& tx = (*it).second;
-		remove(tx, true /*recursive*/);
+static void ReviewPegJobs(vector<CPegReviewJob>&   vJobs,
+                          std::atomic<size_t>&     nNext,
+                          const CPegReviewContext& ctx) {
+	CTxDB  txdb("r");
+	CPegDB pegdb("r");
+	for (size_t i = nNext++; i < vJobs.size(); i = nNext++) {
+		ReviewPegJob(vJobs[i], ctx, txdb, pegdb);
 	}
 }
 
-void CTxMemPool::reviewOnPegChange(CTransaction& tx, vector<uint256>& vRemove) {
-	uint256 hash = tx.GetHash();
+void CTxMemPool::reviewOnPegChange() {
+	LOCK(cs);
+	int64_t nStart = GetTimeMicros();
 
-	MapPrevTx              mapInputs;
-	MapFractions           mapInputsFractions;
-	map<uint256, CTxIndex> mapUnused;
-	MapFractions           mapOutputsFractions;
-	CFractions             feesFractions;
-	int                    nBridgePoolNout = pindexBest->nHeight;
-	int64_t                nVirtBlockTime  = GetAdjustedTime();
+	CPegReviewContext ctx;
+	ctx.pindex         = pindexBest;
+	ctx.nVirtBlockTime = GetAdjustedTime();
+	int nSupply        = ctx.pindex->nPegSupplyIndex;
+
+	int nThreads = GetArg("-pegreviewthreads", 0);
+	if (nThreads <= 0)
+		nThreads = boost::thread::hardware_concurrency();
+	nThreads = std::max(1, std::min(nThreads, 16));
 
+	vector<uint256> vRemove;
 	{
-		CTxDB  txdb("r");
 		CPegDB pegdb("r");
-
-		map<string, CBridgeInfo> bridges;
-		if (!pindexBest->ReadBridges(pegdb, bridges)) {
-			vRemove.push_back(hash);
-			return;
+		if (!ctx.pindex->ReadBridges(pegdb, ctx.bridges)) {
+			// nothing can be rechecked, same as every tx failing
+			for (const auto& item : mapTx)
+				vRemove.push_back(item.first);
 		}
-		auto fnMerkleIn = [&](string hash) { return pindexBest->ReadMerkleIn(pegdb, hash); };
+	}
 
-		bool fInvalid = false;
-		if (!tx.FetchInputs(txdb, pegdb, nBridgePoolNout, false /*to read*/, bridges, fnMerkleIn,
-							mapUnused, mapOutputsFractions, false /*is block*/, false /*is miner*/,
-							nVirtBlockTime, false /*skip pruned*/, mapInputs, mapInputsFractions,
-							fInvalid)) {
-			if (fInvalid) {
-				vRemove.push_back(hash);
-				return;
+	// count inputs spending the pool, txs without them are the roots
+	map<uint256, int>     mapPending;
+	vector<CTransaction*> vLevel;
+	if (vRemove.empty()) {
+		for (auto& item : mapTx) {
+			CTransaction& tx       = item.second;
+			int           nPending = 0;
+			for (const CTxIn& txin : tx.vin) {
+				if (mapTx.count(txin.prevout.hash))
+					nPending++;
 			}
+			if (nPending == 0)
+				vLevel.push_back(&tx);
+			else
+				mapPending[item.first] = nPending;
 		}
+	}
 
-		bool peg_ok = false;
+	set<uint256> setChanged;  // outputs fractions rewritten in this pass
+	set<uint256> setFailed;
+	MapFractions mapReviewed;  // unpacked outputs of this pass, inputs of children
+	size_t       nReviewed = 0;
+	size_t       nSkipped  = 0;
 
-		if (tx.IsCoinMint()) {
-			string sPegFailCause;
-			peg_ok = CalculateCoinMintFractions(tx, pindexBest->nPegSupplyIndex, pindexBest->nTime,
-												bridges, fnMerkleIn, nBridgePoolNout, mapInputs,
-			                                    mapInputsFractions, mapOutputsFractions,
-			                                    feesFractions, sPegFailCause);
-			if (!peg_ok) {
-				vRemove.push_back(hash);
-				return;
+	// process the pool level by level: all parents of a level are done
+	while (!vLevel.empty()) {
+		vector<CPegReviewJob> vJobs;
+		for (CTransaction* ptx : vLevel) {
+			const CTransaction& tx             = *ptx;
+			uint256             hash           = tx.GetHash();
+			bool                fParentFailed  = false;
+			bool                fParentChanged = false;
+			for (const CTxIn& txin : tx.vin) {
+				if (setFailed.count(txin.prevout.hash))
+					fParentFailed = true;
+				if (setChanged.count(txin.prevout.hash))
+					fParentChanged = true;
 			}
-		} else {
-			string        sPegFailCause;
-			set<uint32_t> sTimeLockPassInputs;
-			peg_ok = CalculateStandardFractions(tx, pindexBest->nPegSupplyIndex, pindexBest->nTime,
-			                                    mapInputs, mapInputsFractions, sTimeLockPassInputs,
-			                                    mapOutputsFractions, feesFractions, sPegFailCause);
-			if (!peg_ok) {
-				vRemove.push_back(hash);
-				return;
+			if (fParentFailed) {
+				setFailed.insert(hash);  // removed with its parent
+				continue;
+			}
+
+			auto itInfo = mapPegReview.find(hash);
+			if (!fParentChanged && itInfo != mapPegReview.end() &&
+			    !itInfo->second.NeedsReview(nSupply)) {
+				itInfo->second.nSupply = nSupply;
+				nSkipped++;
+				continue;
+			}
+
+			vJobs.push_back(CPegReviewJob());
+			CPegReviewJob& job = vJobs.back();
+			job.ptx            = ptx;
+			for (const CTxIn& txin : tx.vin) {
+				const uint256& prevhash = txin.prevout.hash;
+				auto           itPrev   = mapTx.find(prevhash);
+				if (itPrev == mapTx.end() || job.mapInputs.count(prevhash))
+					continue;
+				const CTransaction& txPrev = itPrev->second;
+				auto&               input  = job.mapInputs[prevhash];
+				input.first.vSpent.resize(txPrev.vout.size());
+				input.second              = txPrev;
+				input.second.nTimeFetched = txPrev.nTime != 0 ? txPrev.nTime : ctx.nVirtBlockTime;
+				for (size_t i = 0; i < txPrev.vout.size(); i++) {
+					auto fkey = uint320(prevhash, i);
+					auto itFr = mapReviewed.find(fkey);
+					if (itFr != mapReviewed.end()) {
+						job.mapInputsFractions[fkey] = itFr->second;
+						continue;
+					}
+					auto itPacked = mapPackedFractions.find(fkey);
+					if (itPacked == mapPackedFractions.end())
+						continue;  // fails on missing input fractions
+					const string& strValue = itPacked->second;
+					CFractions    f(txPrev.vout[i].nValue, CFractions::STD);
+					CDataStream   finp(strValue.data(), strValue.data() + strValue.size(),
+					                   SER_DISK, CLIENT_VERSION);
+					f.Unpack(finp);
+					job.mapInputsFractions[fkey] = f;
+				}
 			}
 		}
 
-		if (peg_ok) {
+		// independent txs of the level in parallel
+		std::atomic<size_t> nNext(0);
+		int nLevelThreads = std::min<int>(nThreads, vJobs.size());
+		if (nLevelThreads > 1) {
+			boost::thread_group workers;
+			for (int i = 0; i < nLevelThreads; i++)
+				workers.create_thread(
+				    boost::bind(&ReviewPegJobs, boost::ref(vJobs), boost::ref(nNext),
+				                boost::cref(ctx)));
+			workers.join_all();
+		} else if (!vJobs.empty()) {
+			ReviewPegJobs(vJobs, nNext, ctx);
+		}
+
+		for (CPegReviewJob& job : vJobs) {
+			const CTransaction& tx   = *job.ptx;
+			uint256             hash = tx.GetHash();
+			nReviewed++;
+			if (!job.fOk) {
+				setFailed.insert(hash);
+				vRemove.push_back(hash);
+				continue;
+			}
 			// overwrite fractions (changed due to new peg supply index)
-			for (MapFractions::iterator mi = mapOutputsFractions.begin();
-			     mi != mapOutputsFractions.end(); ++mi) {
+			bool fChanged = false;
+			for (const auto& item : job.mapOutputsFractions) {
 				CDataStream fout(SER_DISK, CLIENT_VERSION);
-				(*mi).second.Pack(fout);
-				mapPackedFractions[(*mi).first] = fout.str();
-			}
-			// check dependent transactions
-			for (uint32_t i = 0; i < tx.vout.size(); i++) {
-				map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-				if (it != mapNextTx.end()) {
-					reviewOnPegChange(*it->second.ptx, vRemove);
+				item.second.Pack(fout);
+				auto itPacked = mapPackedFractions.find(item.first);
+				if (itPacked == mapPackedFractions.end() || itPacked->second != fout.str()) {
+					setPackedFractions(item.first, fout.str());
+					fChanged = true;
 				}
+				mapReviewed[item.first] = item.second;
 			}
+			if (fChanged)
+				setChanged.insert(hash);
+			mapPegReview[hash] = MakePegReviewInfo(tx, nSupply, job.mapInputsFractions);
 		}
+
+		// children whose pool parents are all done form the next level
+		vector<CTransaction*> vNext;
+		for (CTransaction* ptx : vLevel) {
+			uint256 hash = ptx->GetHash();
+			for (uint32_t i = 0; i < ptx->vout.size(); i++) {
+				auto it = mapNextTx.find(COutPoint(hash, i));
+				if (it == mapNextTx.end())
+					continue;
+				CTransaction* pchild = it->second.ptx;
+				if (--mapPending[pchild->GetHash()] == 0)
+					vNext.push_back(pchild);
+			}
+		}
+		vLevel.swap(vNext);
 	}
+
+	// remove collected and all dependent
+	for (uint256 hash : vRemove) {
+		std::map<uint256, CTransaction>::const_iterator it = mapTx.find(hash);
+		if (it == mapTx.end())
+			continue;
+		const CTransaction& tx = (*it).second;
+		remove(tx, true /*recursive*/);
+	}
+
+	LogPrint("mempool",
+	         "reviewOnPegChange() : supply %d, %u rechecked, %u skipped, %u removed, %d threads, "
+	         "%.2fms\n",
+	         nSupply, nReviewed, nSkipped, vRemove.size(), nThreads,
+	         (GetTimeMicros() - nStart) * 0.001);
 }
 
 void CTxMemPool::clear() {
@@ -215,6 +708,15 @@ void CTxMemPool::clear() {
 	mapTx.clear();
 	mapPrevOuts.clear();
 	mapNextTx.clear();
+	mapPegReview.clear();
+	mapEntries.clear();
+	mapPackedFractions.clear();
+	setByAncestorFeeRate.clear();
+	setByDescendantScore.clear();
+	setByTime.clear();
+	nUsage          = 0;
+	nFractionsUsage = 0;
+	nBytes          = 0;
 	++nTransactionsUpdated;
 }
 
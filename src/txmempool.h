@@ -9,6 +9,65 @@
 #include "peg.h"
 #include "sync.h"
 
+/*
+ * What the last peg review of a pool transaction depends on: the supply
+ * index its output fractions were calculated at and the range of slots
+ * holding value in its inputs. Moving the supply index across slots which
+ * hold no input value does not change the reserve/liquidity split, so such
+ * a transaction keeps its fractions unless a parent in the pool changed.
+ */
+struct CPegReviewInfo {
+	int  nSupply       = 0;
+	int  nSlotMin      = 0;
+	int  nSlotMax      = -1;
+	bool fAlwaysReview = true;  // coin mints, notaries and marked inputs
+
+	bool NeedsReview(int nSupplyNew) const;
+};
+
+/*
+ * Per transaction data cached when it enters the pool, so block assembly
+ * does not have to read inputs of every pool transaction. Ancestor and
+ * descendant values include the transaction itself and all its unconfirmed
+ * parents or children in the pool.
+ */
+class CTxMemPoolEntry {
+public:
+	uint32_t nTxSize               = 0;
+	int64_t  nFee                  = 0;
+	int64_t  nValueIn              = 0;
+	int64_t  nChainValueIn         = 0;  // value of inputs confirmed in the chain
+	double   dEntryPriority        = 0;
+	int      nEntryHeight          = 0;
+	int64_t  nTime                 = 0;
+	uint64_t nCountWithAncestors   = 1;
+	uint64_t nSizeWithAncestors    = 0;
+	int64_t  nFeesWithAncestors    = 0;
+	uint64_t nCountWithDescendants = 1;
+	uint64_t nSizeWithDescendants  = 0;
+	int64_t  nFeesWithDescendants  = 0;
+	size_t   nUsage                = 0;  // heap bytes of tx, prevouts and index nodes
+
+	CTxMemPoolEntry() {}
+	CTxMemPoolEntry(const CTransaction& tx,
+	                const MapPrevTx&    mapInputs,
+	                int64_t             nFee,
+	                int                 nHeight,
+	                int64_t             nTime);
+
+	double GetPriority(int nHeight) const;
+	double GetFeePerKb() const { return double(nFee) / (double(nTxSize) / 1000.0); }
+	double GetAncestorFeePerKb() const {
+		return double(nFeesWithAncestors) / (double(nSizeWithAncestors) / 1000.0);
+	}
+	// eviction score: a parent paid for by its children is kept with them
+	double GetDescendantScore() const {
+		double dDescendantFeePerKb =
+		    double(nFeesWithDescendants) / (double(nSizeWithDescendants) / 1000.0);
+		return std::max(GetFeePerKb(), dDescendantFeePerKb);
+	}
+};
+
 /*
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -24,22 +83,47 @@ private:
 	uint32_t nTransactionsUpdated;
 
 public:
-	mutable CCriticalSection        cs;
-	std::map<uint256, CTransaction> mapTx;
-	std::map<uint256, MapPrevOut>   mapPrevOuts;
-	std::map<COutPoint, CInPoint>   mapNextTx;
-	std::map<uint320, std::string>  mapPackedFractions;  // #NOTE3
+	mutable CCriticalSection          cs;
+	std::map<uint256, CTransaction>   mapTx;
+	std::map<uint256, MapPrevOut>     mapPrevOuts;
+	std::map<COutPoint, CInPoint>     mapNextTx;
+	std::map<uint320, std::string>    mapPackedFractions;  // #NOTE3
+	std::map<uint256, CPegReviewInfo> mapPegReview;
+
+	// indexes over the pool: entries by txid, ordered by fee rate with
+	// ancestors, by eviction score and by entry time; spent outpoints are
+	// in mapNextTx
+	std::map<uint256, CTxMemPoolEntry>    mapEntries;
+	std::set<std::pair<double, uint256>>  setByAncestorFeeRate;
+	std::set<std::pair<double, uint256>>  setByDescendantScore;
+	std::set<std::pair<int64_t, uint256>> setByTime;
+
+	// memory accounting, see CTxMemPoolEntry::nUsage
+	size_t   nUsage          = 0;
+	size_t   nFractionsUsage = 0;
+	uint64_t nBytes          = 0;  // serialized size of all transactions
+	uint64_t nEvicted        = 0;
 
 	CTxMemPool();
 
-	bool     addUnchecked(const uint256&    hash,
-	                      CTransaction&     tx,
-	                      const MapPrevOut& mapPrevOuts,
-	                      MapFractions&     mapOutputsFractions);
+	bool     addUnchecked(const uint256&         hash,
+	                      CTransaction&          tx,
+	                      const CTxMemPoolEntry& entry,
+	                      const MapPrevOut&      mapPrevOuts,
+	                      const MapFractions&    mapInputsFractions,
+	                      MapFractions&          mapOutputsFractions);
+	// addUnchecked then TrimToSize(nMaxUsage), false when the new
+	// transaction has the lowest score and was evicted itself
+	bool     addUncheckedAndTrim(const uint256&         hash,
+	                             CTransaction&          tx,
+	                             const CTxMemPoolEntry& entry,
+	                             const MapPrevOut&      mapPrevOuts,
+	                             const MapFractions&    mapInputsFractions,
+	                             MapFractions&          mapOutputsFractions,
+	                             size_t                 nMaxUsage);
 	bool     remove(const CTransaction& tx, bool fRecursive = false);
 	bool     removeConflicts(const CTransaction& tx);
 	void     reviewOnPegChange();
-	void     reviewOnPegChange(CTransaction&, std::vector<uint256>& vRemove);
 	void     clear();
 	void     queryHashes(std::vector<uint256>& vtxid);
 	uint32_t GetTransactionsUpdated() const;
@@ -57,6 +141,26 @@ public:
 
 	bool lookup(uint256 hash, CTransaction& result, MapFractions&) const;
 	bool lookup(uint256 hash, size_t n, CFractions&) const;
+
+	// in-pool ancestors of hash, not including itself
+	void getAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+	// in-pool descendants of hash, not including itself
+	void getDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
+	// evict lowest scored transactions with their descendants until the
+	// pool uses at most nMaxUsage bytes, returns number of evicted txs
+	size_t TrimToSize(size_t nMaxUsage);
+	size_t DynamicMemoryUsage() const {
+		LOCK(cs);
+		return nUsage + nFractionsUsage;
+	}
+
+private:
+	void updateAncestorState(const uint256& hash, const CTxMemPoolEntry& entry);
+	void updateDescendantsOnAdd(const uint256& hash);
+	void updateDescendantsOnRemove(const CTransaction& tx, const CTxMemPoolEntry& entry);
+	void updateAncestorsOnRemove(const uint256& hash, const CTxMemPoolEntry& entry);
+	void setPackedFractions(const uint320& fkey, const std::string& strPacked);
 };
 
 #endif /* BITCOIN_TXMEMPOOL_H */
@@ -33,7 +33,10 @@ std::string to_internal(const std::string&);
 
 #include <openssl/crypto.h>
 #include <openssl/rand.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <atomic>
+#include <boost/functional/hash.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/program_options/detail/config_file.hpp>
@@ -65,6 +68,10 @@ std::string to_internal(const std::string&);
 #include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <fcntl.h>
+#endif
+
 using namespace std;
 
 map<string, string>          mapArgs;
@@ -191,9 +198,147 @@ uint256 GetRandHash() {
 
 static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
 // We use boost::call_once() to make sure these are initialized in
-// in a thread-safe manner the first time it is called:
-static FILE*         fileout       = NULL;
-static boost::mutex* mutexDebugLog = NULL;
+// in a thread-safe manner the first time it is called. Nothing here is
+// ever destroyed, so logging keeps working in global destructors.
+static FILE*                      fileout       = NULL;
+static boost::mutex*              mutexDebugLog = NULL;  // held by whoever writes the file
+static boost::condition_variable* condDebugLog  = NULL;
+
+// Lines are queued by the logging threads into a bounded ring without locks
+// (one sequence number per slot, see Vyukov's bounded MPMC queue) and written
+// to debug.log by the bitbay-log thread or by FlushDebugLog().
+static const size_t LOG_RING_SIZE = 8192;  // power of two
+
+struct CLogSlot {
+	std::atomic<uint64_t> nSeq;
+	int64_t               nTimeMicros;
+	char                  szThread[16];
+	std::string           str;
+};
+
+static CLogSlot*             pLogRing = NULL;
+static std::atomic<uint64_t> nLogEnqueue(0);
+static std::atomic<uint64_t> nLogDequeue(0);  // advanced under mutexDebugLog
+static std::atomic<uint64_t> nLogDropped(0);
+
+int nLogRateLimit = 0;
+
+#ifndef WIN32
+static int fdCrashLog = -1;  // debug.log for HandleCrashSignal, opened beforehand
+#endif
+
+static thread_local char szLogThreadName[16] = "";
+
+static bool PushLogLine(const std::string& str) {
+	uint64_t  nPos = nLogEnqueue.load(std::memory_order_relaxed);
+	CLogSlot* pslot;
+	while (true) {
+		pslot         = &pLogRing[nPos & (LOG_RING_SIZE - 1)];
+		uint64_t nSeq = pslot->nSeq.load(std::memory_order_acquire);
+		int64_t  nDif = (int64_t)nSeq - (int64_t)nPos;
+		if (nDif == 0) {
+			if (nLogEnqueue.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+				break;
+		} else if (nDif < 0) {
+			return false;  // full
+		} else {
+			nPos = nLogEnqueue.load(std::memory_order_relaxed);
+		}
+	}
+	pslot->nTimeMicros = GetTimeMicros();
+	strncpy(pslot->szThread, szLogThreadName[0] ? szLogThreadName : "-", sizeof(pslot->szThread));
+	pslot->szThread[sizeof(pslot->szThread) - 1] = 0;
+	pslot->str                                   = str;
+	pslot->nSeq.store(nPos + 1, std::memory_order_release);
+	return true;
+}
+
+// Writes the queued lines, requires mutexDebugLog
+static void DrainDebugLog() {
+	static bool fStartedNewLine = true;
+
+	// reopen the log file, if requested
+	if (fReopenDebugLog) {
+		fReopenDebugLog                   = false;
+		boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+		if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
+			setvbuf(fileout, NULL, _IOFBF, 1 << 16);
+#ifndef WIN32
+		int fdOld  = fdCrashLog;
+		fdCrashLog = open(pathDebug.string().c_str(), O_WRONLY | O_APPEND);
+		if (fdOld >= 0)
+			close(fdOld);
+#endif
+	}
+
+	bool fWritten = false;
+	while (true) {
+		CLogSlot& slot = pLogRing[nLogDequeue & (LOG_RING_SIZE - 1)];
+		if ((int64_t)slot.nSeq.load(std::memory_order_acquire) - (int64_t)(nLogDequeue + 1) < 0)
+			break;  // empty
+
+		// Debug print useful for profiling
+		if (fLogTimestamps && fStartedNewLine)
+			fprintf(fileout, "%s.%06d [%s] ",
+			        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", slot.nTimeMicros / 1000000).c_str(),
+			        (int)(slot.nTimeMicros % 1000000), slot.szThread);
+		const std::string& str = slot.str;
+		fStartedNewLine        = !str.empty() && str[str.size() - 1] == '\n';
+		fwrite(str.data(), 1, str.size(), fileout);
+		fWritten = true;
+
+		slot.str.clear();
+		slot.nSeq.store(nLogDequeue + LOG_RING_SIZE, std::memory_order_release);
+		nLogDequeue++;
+	}
+
+	uint64_t nDropped = nLogDropped.exchange(0);
+	if (nDropped > 0) {
+		fprintf(fileout, "%s%u log lines dropped, log buffer full\n", fStartedNewLine ? "" : "\n",
+		        (unsigned)nDropped);
+		fStartedNewLine = true;
+		fWritten        = true;
+	}
+	if (fWritten)
+		fflush(fileout);
+}
+
+static void ThreadDebugLogWriter() {
+	RenameThread("bitbay-log");
+	boost::unique_lock<boost::mutex> lock(*mutexDebugLog);
+	while (true) {
+		DrainDebugLog();
+		// producers do not lock, a missed wakeup costs at most the timeout
+		condDebugLog->timed_wait(lock, boost::posix_time::milliseconds(100));
+	}
+}
+
+#ifndef WIN32
+static void HandleCrashSignal(int nSignal) {
+	// Async-signal-safe calls only: the queued lines are written as they are,
+	// without timestamps, with write(2). Best effort, the writer thread may
+	// be draining the same slots or be the one that crashed.
+	if (fdCrashLog >= 0) {
+		uint64_t nPos = nLogDequeue.load(std::memory_order_acquire);
+		for (size_t i = 0; i < LOG_RING_SIZE; i++, nPos++) {
+			CLogSlot& slot = pLogRing[nPos & (LOG_RING_SIZE - 1)];
+			if (slot.nSeq.load(std::memory_order_acquire) != nPos + 1)
+				break;
+			const char* pch = slot.str.data();
+			size_t      n   = slot.str.size();
+			while (n > 0) {
+				ssize_t nWritten = write(fdCrashLog, pch, n);
+				if (nWritten <= 0)
+					break;
+				pch += nWritten;
+				n -= nWritten;
+			}
+		}
+	}
+	signal(nSignal, SIG_DFL);
+	raise(nSignal);
+}
+#endif
 
 static void DebugPrintInit() {
 	assert(fileout == NULL);
@@ -201,10 +346,33 @@ static void DebugPrintInit() {
 
 	boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
 	fileout                           = fopen(pathDebug.string().c_str(), "a");
-	if (fileout)
-		setbuf(fileout, NULL);  // unbuffered
+	if (!fileout)
+		return;
+	setvbuf(fileout, NULL, _IOFBF, 1 << 16);  // flushed by the writer after each batch
 
 	mutexDebugLog = new boost::mutex();
+	condDebugLog  = new boost::condition_variable();
+	pLogRing      = new CLogSlot[LOG_RING_SIZE];
+	for (size_t i = 0; i < LOG_RING_SIZE; i++)
+		pLogRing[i].nSeq.store(i, std::memory_order_relaxed);
+
+	new boost::thread(&ThreadDebugLogWriter);  // runs until the process exits
+	atexit(&FlushDebugLog);
+#ifndef WIN32
+	fdCrashLog = open(pathDebug.string().c_str(), O_WRONLY | O_APPEND);
+	signal(SIGSEGV, HandleCrashSignal);
+	signal(SIGBUS, HandleCrashSignal);
+	signal(SIGFPE, HandleCrashSignal);
+	signal(SIGILL, HandleCrashSignal);
+	signal(SIGABRT, HandleCrashSignal);
+#endif
+}
+
+void FlushDebugLog() {
+	if (fileout == NULL || mutexDebugLog == NULL)
+		return;
+	boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+	DrainDebugLog();
 }
 
 bool LogAcceptCategory(const char* category) {
@@ -231,38 +399,56 @@ bool LogAcceptCategory(const char* category) {
 	return true;
 }
 
+struct CLogRateBucket {
+	std::atomic<int64_t> nSecond;
+	std::atomic<int>     nLines;
+	std::atomic<int>     nSuppressed;
+};
+
+bool LogRateAccept(const char* category) {
+	// categories share a bucket when their names collide
+	static CLogRateBucket buckets[128];
+	if (category == NULL || nLogRateLimit <= 0)
+		return true;
+
+	size_t          nHash   = boost::hash_range(category, category + strlen(category));
+	CLogRateBucket& bucket  = buckets[nHash % 128];
+	int64_t         nNow    = GetTime();
+	int64_t         nSecond = bucket.nSecond.load();
+	if (nSecond != nNow && bucket.nSecond.compare_exchange_strong(nSecond, nNow)) {
+		bucket.nLines   = 0;
+		int nSuppressed = bucket.nSuppressed.exchange(0);
+		if (nSuppressed > 0)
+			LogPrintStr(strprintf("%d %s log lines suppressed by -lograte\n", nSuppressed, category));
+	}
+	if (bucket.nLines.fetch_add(1) < nLogRateLimit)
+		return true;
+	bucket.nSuppressed++;
+	return false;
+}
+
+void SetLogThreadName(const char* name) {
+	strncpy(szLogThreadName, name, sizeof(szLogThreadName));
+	szLogThreadName[sizeof(szLogThreadName) - 1] = 0;
+}
+
 int LogPrintStr(const std::string& str) {
 	int ret = 0;  // Returns total number of characters written
 	if (fPrintToConsole) {
 		// print to console
 		ret = fwrite(str.data(), 1, str.size(), stdout);
 	} else if (fPrintToDebugLog) {
-		static bool fStartedNewLine = true;
 		boost::call_once(&DebugPrintInit, debugPrintInitFlag);
 
 		if (fileout == NULL)
 			return ret;
 
-		boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-		// reopen the log file, if requested
-		if (fReopenDebugLog) {
-			fReopenDebugLog                   = false;
-			boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-			if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
-				setbuf(fileout, NULL);  // unbuffered
+		if (!PushLogLine(str)) {
+			nLogDropped++;
+			return ret;
 		}
-
-		// Debug print useful for profiling
-		if (fLogTimestamps && fStartedNewLine)
-			ret +=
-			    fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-		if (!str.empty() && str[str.size() - 1] == '\n')
-			fStartedNewLine = true;
-		else
-			fStartedNewLine = false;
-
-		ret = fwrite(str.data(), 1, str.size(), fileout);
+		condDebugLog->notify_one();
+		ret = str.size();
 	}
 
 	return ret;
@@ -749,6 +935,7 @@ void runCommand(std::string strCommand) {
 }
 
 void RenameThread(const char* name) {
+	SetLogThreadName(name);
 #if defined(PR_SET_NAME)
 	// Only the first 15 characters are used (16 - NUL terminator)
 	::prctl(PR_SET_NAME, name, 0, 0, 0);
@@ -92,14 +92,21 @@ extern std::string                                      strMiscWarning;
 extern bool                                             fNoListen;
 extern bool                                             fLogTimestamps;
 extern volatile bool                                    fReopenDebugLog;
+extern int                                              nLogRateLimit;
 
 void RandAddSeed();
 void RandAddSeedPerfmon();
 
 /* Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
-/* Send a string to the log output */
+/* Return false once category logged more than -lograte lines this second */
+bool LogRateAccept(const char* category);
+/* Send a string to the log output, written to debug.log by the log thread */
 int LogPrintStr(const std::string& str);
+/* Write the queued log lines to debug.log now */
+void FlushDebugLog();
+/* Name of the calling thread in timestamped log lines */
+void SetLogThreadName(const char* name);
 
 #define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
 
@@ -110,7 +117,7 @@ int LogPrintStr(const std::string& str);
 	/*   Print to debug.log if -debug=category switch is given OR category is NULL. */            \
 	template <TINYFORMAT_ARGTYPES(n)>                                                             \
 	static inline int LogPrint(const char* category, const char* format, TINYFORMAT_VARARGS(n)) { \
-		if (!LogAcceptCategory(category))                                                         \
+		if (!LogAcceptCategory(category) || !LogRateAccept(category))                             \
 			return 0;                                                                             \
 		return LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));                          \
 	}                                                                                             \
@@ -127,7 +134,7 @@ TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_AND_LOG_FUNC)
  * TINYFORMAT_FOREACH_ARGNUM
  */
 static inline int LogPrint(const char* category, const char* format) {
-	if (!LogAcceptCategory(category))
+	if (!LogAcceptCategory(category) || !LogRateAccept(category))
 		return 0;
 	return LogPrintStr(format);
 }
@@ -150,6 +157,7 @@ void                    FileCommit(FILE* fileout);
 bool                    RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 boost::filesystem::path GetDefaultDataDir();
 const boost::filesystem::path& GetDataDir(bool fNetSpecific = true);
+void                           ClearDatadirCache();
 boost::filesystem::path        GetConfigFile();
 boost::filesystem::path        GetPidFile();
 #ifndef WIN32
@@ -35,36 +35,15 @@ static const uint32_t pSHA256InitState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
                                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
 
 void SHA256Transform(void* pstate, void* pinput, const void* pinit) {
-	SHA256_CTX    ctx;
 	unsigned char data[64];
 
-	SHA256_Init(&ctx);
-
 	for (int i = 0; i < 16; i++)
 		((uint32_t*)data)[i] = ByteReverse(((uint32_t*)pinput)[i]);
 
-	for (int i = 0; i < 8; i++)
-		ctx.h[i] = ((uint32_t*)pinit)[i];
-
-	SHA256_Update(&ctx, data, sizeof(data));
-	for (int i = 0; i < 8; i++)
-		((uint32_t*)pstate)[i] = ctx.h[i];
+	memcpy(pstate, pinit, 32);
+	SHA256Compress((uint32_t*)pstate, data, 1);
 }
 
-// Some explaining would be appreciated
-class COrphan {
-public:
-	CTransaction* ptx;
-	set<uint256>  setDependsOn;
-	double        dPriority;
-	double        dFeePerKb;
-
-	COrphan(CTransaction* ptxIn) {
-		ptx       = ptxIn;
-		dPriority = dFeePerKb = 0;
-	}
-};
-
 uint64_t nLastBlockTx                 = 0;
 uint64_t nLastBlockSize               = 0;
 int64_t  nLastCoinStakeSearchInterval = 0;
@@ -155,88 +134,6 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 		CTxDB  txdb("r");
 		CPegDB pegdb("r");
 
-		// Priority order to process transactions
-		list<COrphan>                   vOrphan;  // list memory doesn't move
-		map<uint256, vector<COrphan*> > mapDependers;
-
-		// This vector will be sorted into a priority queue:
-		vector<TxPriority> vecPriority;
-		vecPriority.reserve(mempool.mapTx.size() + 1);
-		for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin();
-		     mi != mempool.mapTx.end(); ++mi) {
-			CTransaction& tx = (*mi).second;
-			if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-				continue;
-
-			COrphan* porphan        = NULL;
-			double   dPriority      = 0;
-			int64_t  nTotalIn       = 0;
-			bool     fMissingInputs = false;
-			for (const CTxIn& txin : tx.vin) {
-				int     nConf    = 0;
-				int64_t nValueIn = 0;
-				if (tx.IsCoinMint()) {
-					nConf = pindexBest->nHeight -
-					        tx.nTime /*for CoinMint nTime is set as merkle height +1*/;
-					if (txin.prevout.hash != 0) {
-						nValueIn = tx.vout[0].nValue + MINT_TX_FEE;
-					}
-
-				} else {
-					// Read prev transaction
-					CTransaction txPrev;
-					CTxIndex     txindex;
-					if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex)) {
-						// This should never happen; all transactions in the memory
-						// pool should connect to either transactions in the chain
-						// or other transactions in the memory pool.
-						if (!mempool.mapTx.count(txin.prevout.hash)) {
-							LogPrintf("ERROR: mempool transaction missing input\n");
-							if (fDebug)
-								assert("mempool transaction missing input" == 0);
-							fMissingInputs = true;
-							if (porphan)
-								vOrphan.pop_back();
-							break;
-						}
-
-						// Has to wait for dependencies
-						if (!porphan) {
-							// Use list for automatic deletion
-							vOrphan.push_back(COrphan(&tx));
-							porphan = &vOrphan.back();
-						}
-						mapDependers[txin.prevout.hash].push_back(porphan);
-						porphan->setDependsOn.insert(txin.prevout.hash);
-						nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
-						continue;
-					}
-					nConf    = txindex.GetDepthInMainChain();
-					nValueIn = txPrev.vout[txin.prevout.n].nValue;
-				}
-
-				nTotalIn += nValueIn;
-				dPriority += (double)nValueIn * nConf;
-			}
-			if (fMissingInputs)
-				continue;
-
-			// Priority is sum(valuein * age) / txsize
-			uint32_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-			dPriority /= nTxSize;
-
-			// This is a more accurate fee-per-kilobyte than is used by the client code, because the
-			// client code rounds up the size to the nearest 1K. That's good, because it gives an
-			// incentive to create smaller transactions.
-			double dFeePerKb = double(nTotalIn - tx.GetValueOut()) / (double(nTxSize) / 1000.0);
-
-			if (porphan) {
-				porphan->dPriority = dPriority;
-				porphan->dFeePerKb = dFeePerKb;
-			} else
-				vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
-		}
-
 		// Collect transactions into block
 		map<uint256, CTxIndex> mapTestPool;
 		MapFractions           mapTestFractionsPool;
@@ -253,27 +150,34 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 		set<string> timelockpasses;
 		pindexBest->ReadTimeLockPasses(pegdb, timelockpasses);
 
-		TxPriorityCompare comparer(fSortedByFee);
-		std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+		set<uint256> setInBlock;
+		set<uint256> setRejected;
 
-		while (!vecPriority.empty()) {
-			// Take highest priority transaction off the priority queue:
-			double        dPriority = vecPriority.front().get<0>();
-			double        dFeePerKb = vecPriority.front().get<1>();
-			CTransaction& tx        = *(vecPriority.front().get<2>());
+		// all parents from the pool are already in the block
+		auto fnParentsInBlock = [&](const CTransaction& tx) {
+			for (const CTxIn& txin : tx.vin) {
+				if (mempool.mapTx.count(txin.prevout.hash) && !setInBlock.count(txin.prevout.hash))
+					return false;
+			}
+			return true;
+		};
 
-			std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-			vecPriority.pop_back();
+		// fPackagePaid: the fees were checked for the tx with its unconfirmed
+		// ancestors together, a parent may pay less than its own minimum
+		auto fnAddTx = [&](CTransaction& tx, double dPriority, double dFeePerKb,
+		                   bool fPackagePaid) {
+			if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+				return false;
 
 			// Size limits
 			uint32_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 			if (nBlockSize + nTxSize >= nBlockMaxSize)
-				continue;
+				return false;
 
 			// Legacy limits on sigOps:
 			uint32_t nTxSigOps = GetLegacySigOpCount(tx);
 			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-				continue;
+				return false;
 
 			tx.nTimeFetched = tx.nTime;
 			if (tx.nTimeFetched == 0)
@@ -281,23 +185,15 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 
 			// Timestamp limit
 			if (tx.nTime > nBlockDraftTime || (fProofOfStake && tx.nTime > pblock->vtx[0].nTime))
-				continue;
+				return false;
 
 			// Transaction fee
 			int64_t nMinFee = GetMinFee(tx, nHeight, nBlockSize, GMF_BLOCK);
 
 			// Skip free transactions if we're past the minimum block size:
-			if (fSortedByFee && (dFeePerKb < nMinTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-				continue;
-
-			// Prioritize by fee once past the priority size or we run out of high-priority
-			// transactions:
-			if (!fSortedByFee &&
-			    ((nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250))) {
-				fSortedByFee = true;
-				comparer     = TxPriorityCompare(fSortedByFee);
-				std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-			}
+			if (!fPackagePaid && fSortedByFee && (dFeePerKb < nMinTxFee) &&
+			    (nBlockSize + nTxSize >= nBlockMinSize))
+				return false;
 
 			// Connecting shouldn't fail due to dependency on other memory pool transactions
 			// because we're already processing them in order of dependency
@@ -313,15 +209,15 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 								fnMerkleIn, mapTestPoolTmp, mapTestFractionsPoolTmp,
 			                    false /*is block*/, true /*is miner*/, nBlockDraftTime,
 			                    false /*skip pruned*/, mapInputs, mapInputsFractions, fInvalid))
-				continue;
+				return false;
 
 			int64_t nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
-			if (nTxFees < nMinFee)
-				continue;
+			if (!fPackagePaid && nTxFees < nMinFee)
+				return false;
 
 			nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
 			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-				continue;
+				return false;
 
 			// Note that flags: we don't want to set mempool/IsStandard()
 			// policy here, but we still have to ensure that the block we
@@ -331,7 +227,7 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 			                      timelockpasses, feesFractions, CDiskTxPos(1, 1, 1), pindexPrev,
 			                      false /*is ConnectBlock*/, true /*is CreateNewBlock*/,
 			                      MANDATORY_SCRIPT_VERIFY_FLAGS))
-				continue;
+				return false;
 			mapTestPoolTmp[tx.GetHash()] =
 			    CTxIndex(CDiskTxPos(1, 1, 1), tx.vout.size(), 0 /*nHeight*/,
 			             nBlockTx + 2 /*coinbase+coinstake*/);
@@ -339,6 +235,7 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 
 			// Added
 			pblock->vtx.push_back(tx);
+			setInBlock.insert(tx.GetHash());
 			nBlockSize += nTxSize;
 			++nBlockTx;
 			nBlockSigOps += nTxSigOps;
@@ -348,21 +245,127 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 				LogPrintf("priority %.1f feeperkb %.1f txid %s\n", dPriority, dFeePerKb,
 				          tx.GetHash().ToString());
 			}
+			return true;
+		};
+
+		// High priority transactions first, included regardless of the fees
+		// they pay. Priorities move with the height so they are recomputed
+		// from the cached entries, without reading any inputs.
+		if (!fSortedByFee) {
+			vector<TxPriority> vecPriority;
+			set<uint256>       setQueued;
+			vecPriority.reserve(mempool.mapEntries.size());
+			for (const auto& item : mempool.mapEntries) {
+				CTransaction& tx = mempool.mapTx[item.first];
+				if (fnParentsInBlock(tx) && setQueued.insert(item.first).second)
+					vecPriority.push_back(TxPriority(item.second.GetPriority(pindexPrev->nHeight),
+					                                 item.second.GetFeePerKb(), &tx));
+			}
+
+			TxPriorityCompare comparer(false /*by fee*/);
+			std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+			while (!vecPriority.empty()) {
+				double        dPriority = vecPriority.front().get<0>();
+				double        dFeePerKb = vecPriority.front().get<1>();
+				CTransaction& tx        = *(vecPriority.front().get<2>());
+
+				// Prioritize by fee once past the priority size or we run out of
+				// high-priority transactions:
+				uint32_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+				if ((nBlockSize + nTxSize >= nBlockPrioritySize) ||
+				    (dPriority < COIN * 144 / 250))
+					break;
+
+				std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+				vecPriority.pop_back();
+
+				if (!fnAddTx(tx, dPriority, dFeePerKb, false /*package paid*/))
+					continue;
 
-			// Add transactions that depend on this one to the priority queue
-			uint256 hash = tx.GetHash();
-			if (mapDependers.count(hash)) {
-				for (COrphan* porphan : mapDependers[hash]) {
-					if (!porphan->setDependsOn.empty()) {
-						porphan->setDependsOn.erase(hash);
-						if (porphan->setDependsOn.empty()) {
-							vecPriority.push_back(
-							    TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
-							std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-						}
-					}
+				// Add transactions that depend on this one to the priority queue
+				uint256 hash = tx.GetHash();
+				for (uint32_t i = 0; i < tx.vout.size(); i++) {
+					auto it = mempool.mapNextTx.find(COutPoint(hash, i));
+					if (it == mempool.mapNextTx.end())
+						continue;
+					CTransaction& txChild = *it->second.ptx;
+					auto          itEntry = mempool.mapEntries.find(txChild.GetHash());
+					if (itEntry == mempool.mapEntries.end() || !fnParentsInBlock(txChild) ||
+					    !setQueued.insert(itEntry->first).second)
+						continue;
+					vecPriority.push_back(
+					    TxPriority(itEntry->second.GetPriority(pindexPrev->nHeight),
+					               itEntry->second.GetFeePerKb(), &txChild));
+					std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
 				}
 			}
+			fSortedByFee = true;
+		}
+
+		// Then by fee rate including unconfirmed ancestors, so a parent paid
+		// for by its child gets in. Walks the index only until the block is
+		// full or the remaining transactions are free.
+		int nFailedNearFull = 0;
+		for (auto mi = mempool.setByAncestorFeeRate.rbegin();
+		     mi != mempool.setByAncestorFeeRate.rend(); ++mi) {
+			const uint256& hash = mi->second;
+			if (setInBlock.count(hash) || setRejected.count(hash))
+				continue;
+			if (mi->first < nMinTxFee && nBlockSize >= nBlockMinSize)
+				break;
+			if (nBlockSize + 200 >= nBlockMaxSize)
+				break;
+
+			// the transaction with its ancestors not yet in the block,
+			// parents go first: they have less ancestors than children
+			set<uint256> setAncestors;
+			mempool.getAncestors(hash, setAncestors);
+			vector<pair<uint64_t, uint256>> vPackage;
+			bool                            fRejected = false;
+			for (const uint256& ancestor : setAncestors) {
+				if (setInBlock.count(ancestor))
+					continue;
+				if (setRejected.count(ancestor))
+					fRejected = true;
+				vPackage.push_back(
+				    make_pair(mempool.mapEntries[ancestor].nCountWithAncestors, ancestor));
+			}
+			if (fRejected) {
+				setRejected.insert(hash);
+				continue;
+			}
+			vPackage.push_back(make_pair(mempool.mapEntries[hash].nCountWithAncestors, hash));
+			sort(vPackage.begin(), vPackage.end());
+
+			// the package pays the minimum fees of all its transactions
+			int64_t  nPackageFees   = 0;
+			int64_t  nPackageMinFee = 0;
+			uint64_t nPackageSize   = nBlockSize;
+			for (const auto& item : vPackage) {
+				const CTxMemPoolEntry& entry = mempool.mapEntries[item.second];
+				nPackageFees += entry.nFee;
+				nPackageMinFee +=
+				    GetMinFee(mempool.mapTx[item.second], nHeight, nPackageSize, GMF_BLOCK);
+				nPackageSize += entry.nTxSize;
+			}
+			if (nPackageFees < nPackageMinFee)
+				continue;
+
+			for (const auto& item : vPackage) {
+				const CTxMemPoolEntry& entry = mempool.mapEntries[item.second];
+				CTransaction&          tx    = mempool.mapTx[item.second];
+				if (!fnAddTx(tx, entry.GetPriority(pindexPrev->nHeight), entry.GetFeePerKb(),
+				             true /*package paid*/)) {
+					setRejected.insert(item.second);
+					// give up on a full block after too many misses
+					if (nBlockSize + 4000 > nBlockMaxSize)
+						nFailedNearFull++;
+					break;
+				}
+			}
+			if (nFailedNearFull > 1000)
+				break;
 		}
 
 		nLastBlockTx   = nBlockTx;
@@ -388,6 +391,58 @@ unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, i
 	return pblock;
 }
 
+// Proof-of-stake template reuse: signing only replaces coinbase time and
+// inserts the coinstake, so while the tip stays and the pool is unchanged
+// (or changed only recently) a copy of the last template is as good as a
+// new one.
+static CCriticalSection    cs_staketemplate;
+static unique_ptr<CBlock>  pStakeTemplate;
+static CBlockIndex*        pindexStakeTemplatePrev = NULL;
+static uint32_t            nStakeTemplateTxUpdated = 0;
+static int64_t             nStakeTemplateTime      = 0;
+static int64_t             nStakeTemplateFees      = 0;
+static CBlockTemplateStats stakeTemplateStats;
+
+unique_ptr<CBlock> CreateStakeBlockTemplate(CReserveKey& reservekey, int64_t* pFees) {
+	LOCK(cs_staketemplate);
+	int64_t  nNow          = GetTime();
+	uint32_t nTxUpdated    = mempool.GetTransactionsUpdated();
+	int64_t  nTemplateLife = GetArg("-staketemplatelife", 10);
+
+	if (!pStakeTemplate || pindexStakeTemplatePrev != pindexBest ||
+	    (nTxUpdated != nStakeTemplateTxUpdated && nNow - nStakeTemplateTime >= nTemplateLife)) {
+		int64_t            nStart     = GetTimeMicros();
+		int64_t            nFees      = 0;
+		CBlockIndex*       pindexPrev = pindexBest;
+		unique_ptr<CBlock> pblock(CreateNewBlock(reservekey, true, &nFees));
+		if (!pblock)
+			return nullptr;
+		int64_t nBuildMicros = GetTimeMicros() - nStart;
+
+		pStakeTemplate          = std::move(pblock);
+		pindexStakeTemplatePrev = pindexPrev;
+		nStakeTemplateTxUpdated = nTxUpdated;
+		nStakeTemplateTime      = nNow;
+		nStakeTemplateFees      = nFees;
+		stakeTemplateStats.nRebuilds++;
+		stakeTemplateStats.nLastBuildMicros = nBuildMicros;
+		stakeTemplateStats.nTotalBuildMicros += nBuildMicros;
+		LogPrint("bench", "CreateStakeBlockTemplate() : %u txs, %.2fms\n",
+		         pStakeTemplate->vtx.size(), nBuildMicros * 0.001);
+	} else {
+		stakeTemplateStats.nReuses++;
+	}
+
+	if (pFees)
+		*pFees = nStakeTemplateFees;
+	return unique_ptr<CBlock>(new CBlock(*pStakeTemplate));
+}
+
+CBlockTemplateStats GetBlockTemplateStats() {
+	LOCK(cs_staketemplate);
+	return stakeTemplateStats;
+}
+
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, uint32_t& nExtraNonce) {
 	// Update nExtraNonce
 	static uint256 hashPrevBlock;
@@ -565,7 +620,7 @@ void ThreadStakeMiner(CWallet* pwallet) {
 		// Create new block
 		//
 		int64_t            nFees;
-		unique_ptr<CBlock> pblock(CreateNewBlock(reservekey, true, &nFees));
+		unique_ptr<CBlock> pblock(CreateStakeBlockTemplate(reservekey, &nFees));
 		if (!pblock.get())
 			return;
 
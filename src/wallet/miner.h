@@ -14,6 +14,20 @@ std::unique_ptr<CBlock> CreateNewBlock(CReserveKey& reservekey,
                                        bool         fProofOfStake = false,
                                        int64_t*     pFees         = 0);
 
+struct CBlockTemplateStats {
+	uint64_t nRebuilds         = 0;
+	uint64_t nReuses           = 0;
+	int64_t  nLastBuildMicros  = 0;
+	int64_t  nTotalBuildMicros = 0;
+};
+
+/* Copy of the cached proof-of-stake template, rebuilt when the tip changes
+ * or the pool changed and the template is older than -staketemplatelife */
+std::unique_ptr<CBlock> CreateStakeBlockTemplate(CReserveKey& reservekey, int64_t* pFees = 0);
+
+/** Counters of the proof-of-stake template cache */
+CBlockTemplateStats GetBlockTemplateStats();
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, uint32_t& nExtraNonce);
 
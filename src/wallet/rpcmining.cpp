@@ -38,6 +38,17 @@ void ShutdownRPCMining() {
 	pMiningKey = NULL;
 }
 
+static Object BlockTemplateStatsToJSON() {
+	CBlockTemplateStats stats = GetBlockTemplateStats();
+	Object              obj;
+	obj.push_back(Pair("rebuilds", stats.nRebuilds));
+	obj.push_back(Pair("reuses", stats.nReuses));
+	obj.push_back(Pair("lastbuildms", stats.nLastBuildMicros * 0.001));
+	obj.push_back(Pair("avgbuildms",
+	                   stats.nRebuilds ? stats.nTotalBuildMicros * 0.001 / stats.nRebuilds : 0.0));
+	return obj;
+}
+
 Value getsubsidy(const Array& params, bool fHelp) {
 	if (fHelp || params.size() > 1)
 		throw runtime_error(
@@ -112,6 +123,7 @@ Value getmininginfo(const Array& params, bool fHelp) {
 	obj.push_back(Pair("netstakeweight", GetPoSKernelPS()));
 	obj.push_back(Pair("errors", GetWarnings("statusbar")));
 	obj.push_back(Pair("pooledtx", (uint64_t)mempool.size()));
+	obj.push_back(Pair("templatestats", BlockTemplateStatsToJSON()));
 
 	weight.push_back(Pair("minimum", (uint64_t)nWeight));
 	weight.push_back(Pair("maximum", (uint64_t)0));
@@ -160,6 +172,7 @@ Value getstakinginfo(const Array& params, bool fHelp) {
 	obj.push_back(Pair("netstakeweight", (uint64_t)nNetworkWeight));
 
 	obj.push_back(Pair("expectedtime", nExpectedTime));
+	obj.push_back(Pair("templatestats", BlockTemplateStatsToJSON()));
 
 	return obj;
 }
@@ -672,6 +685,7 @@ Value submitblock(const Array& params, bool fHelp) {
 
 			block.vtx.insert(block.vtx.begin() + 1, txCoinStake);
 			block.hashMerkleRoot = block.BuildMerkleTree();
+			block.ClearHashCache();
 
 			CPubKey pubkey;
 			if (!pMiningKey->GetReservedKey(pubkey))
@@ -840,9 +840,7 @@ int64_t CWallet::GetReserve(uint256 txhash, long n, const CTxOut& txout) const {
 				if (fF || fV)
 					return 0;
 
-				int64_t nReserve = 0;
-				wtx.vOutFractions[n].Ref().LowPart(nLastPegSupplyIndex, &nReserve);
-				return nReserve;
+				return wtx.vOutFractions[n].Ref().Low(nLastPegSupplyIndex);
 			}
 		}
 	}
@@ -876,9 +874,7 @@ int64_t CWallet::GetLiquidity(uint256 txhash, long n, const CTxOut& txout) const
 				if (fF || fV)
 					return 0;
 
-				int64_t nLiquidity = 0;
-				wtx.vOutFractions[n].Ref().HighPart(nLastPegSupplyIndex, &nLiquidity);
-				return nLiquidity;
+				return wtx.vOutFractions[n].Ref().High(nLastPegSupplyIndex);
 			}
 		}
 	}